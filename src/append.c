@@ -0,0 +1,379 @@
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <stdint.h> //uint64_t
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "hist.h"
+#include "slowlog.h"
+
+#define ACCESS_PERMISSION 0777
+#define NSEC 1000000000ULL
+#define MAX_GROUPS 32
+
+/*
+ WAL-style log writer: N writers append records to one shared file and
+ block until their record is durable, while a commit thread batches the
+ fdatasync() calls (group commit).
+
+ A group is committed when its pending bytes reach <group_bytes>, when the
+ first pending record waited <group_us>, or when every running writer is
+ waiting (nothing else can join the group then). 0 disables a trigger.
+
+ Records are appended either with write() on an O_APPEND descriptor per
+ writer (append) or by reserving the offset with an atomic add and pwrite()
+ (reserve).
+*/
+
+enum append_modes {
+    O_APPEND_WRITE,
+    RESERVE_PWRITE
+};
+
+typedef struct thread_load {
+    int thread_id;
+    int fd;
+    int num_records;
+    char *record;
+    hist commit_latencies;
+    hist write_latencies;
+} thread_load;
+
+typedef struct group_commit {
+    pthread_mutex_t lock;
+    pthread_cond_t pending_cv;   // signals the commit thread
+    pthread_cond_t durable_cv;   // signals the writers
+    uint64_t pending_bytes;
+    uint64_t pending_records;
+    uint64_t first_pending;      // arrival of the oldest pending record
+    uint64_t epoch;              // the next fdatasync() makes this epoch durable
+    uint64_t durable_epoch;
+    int waiting_writers;
+    int running_writers;
+    // stats of the run
+    uint64_t syncs;
+    uint64_t synced_records;
+    uint64_t max_group_records;
+    hist sync_latencies;
+} group_commit;
+
+int append_mode;
+int record_size;
+uint64_t group_bytes;
+uint64_t group_ns;
+int sync_fd;
+uint64_t tail;
+group_commit commit;
+// records with the slowest commits, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
+       perror("Error getting timestamp");
+       exit(EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+static int group_ready(void) {
+    if (commit.pending_records == 0) {
+        return 0;
+    }
+    return (group_bytes > 0 && commit.pending_bytes >= group_bytes) ||
+        commit.waiting_writers == commit.running_writers ||
+        (group_bytes == 0 && group_ns == 0);
+}
+
+/*
+ Commits the pending records in groups until every writer is done
+
+ Params:
+  - args: unused
+
+ Errors: It fails and exits the program if fdatasync() fails
+ Returns: NULL
+*/
+static void* committer(void* args) {
+    struct timespec deadline;
+    uint64_t epoch, records, begin, end;
+
+    (void) args;
+    pthread_mutex_lock(&commit.lock);
+    while (commit.running_writers > 0 || commit.pending_records > 0) {
+        if (!group_ready()) {
+            if (commit.pending_records > 0 && group_ns > 0) {
+                uint64_t due = commit.first_pending + group_ns;
+                if (stamp() < due) {
+                    deadline.tv_sec = due / NSEC;
+                    deadline.tv_nsec = due % NSEC;
+                    pthread_cond_timedwait(&commit.pending_cv, &commit.lock, &deadline);
+                    continue;
+                }
+            } else {
+                pthread_cond_wait(&commit.pending_cv, &commit.lock);
+                continue;
+            }
+        }
+
+        epoch = commit.epoch++;
+        records = commit.pending_records;
+        commit.pending_records = 0;
+        commit.pending_bytes = 0;
+        pthread_mutex_unlock(&commit.lock);
+
+        begin = stamp();
+        if (fdatasync(sync_fd) != 0) {
+            fprintf(stderr, "Couldn't fdatasync(): %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        end = stamp();
+
+        pthread_mutex_lock(&commit.lock);
+        commit.durable_epoch = epoch + 1;
+        commit.syncs++;
+        commit.synced_records += records;
+        if (records > commit.max_group_records) {
+            commit.max_group_records = records;
+        }
+        hist_add(&commit.sync_latencies, end - begin);
+        pthread_cond_broadcast(&commit.durable_cv);
+    }
+    pthread_mutex_unlock(&commit.lock);
+
+    return NULL;
+}
+
+/*
+ Appends the records of one writer, each one waiting for its group commit
+
+ Params:
+  - args: struct of thread load
+
+ Errors: It fails and exits the program if a record can't be written
+ Returns: NULL
+*/
+static void* writer(void* args) {
+    thread_load* load = (thread_load*) args;
+    uint64_t begin, written, epoch;
+    long offset;
+    ssize_t ret;
+    slowlog_probe probe;
+
+    for (int i = 0; i < load->num_records; ++i) {
+        // writer id and sequence number at the head of every record
+        memcpy(load->record, &load->thread_id, sizeof(int));
+        memcpy(load->record + sizeof(int), &i, sizeof(int));
+
+        slowlog_begin(slow_log, &probe);
+        begin = stamp();
+        if (append_mode == O_APPEND_WRITE) {
+            offset = -1;
+            ret = write(load->fd, load->record, record_size);
+        } else {
+            offset = (long) __atomic_fetch_add(&tail, (uint64_t) record_size, __ATOMIC_RELAXED);
+            ret = pwrite(load->fd, load->record, record_size, offset);
+        }
+        if (ret != record_size) {
+            fprintf(stderr, "Couldn't append record %d of writer %d: %s\n", i, load->thread_id,
+                    ret < 0 ? strerror(errno) : "short write");
+            exit(EXIT_FAILURE);
+        }
+        written = stamp();
+        hist_add(&load->write_latencies, written - begin);
+
+        pthread_mutex_lock(&commit.lock);
+        if (commit.pending_records == 0) {
+            commit.first_pending = written;
+        }
+        commit.pending_records++;
+        commit.pending_bytes += record_size;
+        epoch = commit.epoch;
+        commit.waiting_writers++;
+        pthread_cond_signal(&commit.pending_cv);
+        while (commit.durable_epoch <= epoch) {
+            pthread_cond_wait(&commit.durable_cv, &commit.lock);
+        }
+        commit.waiting_writers--;
+        pthread_mutex_unlock(&commit.lock);
+
+        hist_add(&load->commit_latencies, stamp() - begin);
+        slowlog_end(slow_log, &probe, load->thread_id, "commit", NULL, offset);
+    }
+
+    pthread_mutex_lock(&commit.lock);
+    commit.running_writers--;
+    pthread_cond_signal(&commit.pending_cv);
+    pthread_mutex_unlock(&commit.lock);
+
+    return NULL;
+}
+
+/*
+ Runs every writer once with one group size and prints:
+   append,<mode>,<group_bytes>,<group_us>,<records>,<syncs>,<records_per_sync>,<max_records_per_sync>,
+          <wall_ns>,<records/s>,<MB/s>,<commit latency count,mean,p50,p90,p99,p99.9,max>
+   append-write,<group_bytes>,<write latency count,mean,p50,p90,p99,p99.9,max>
+   append-sync,<group_bytes>,<fdatasync latency count,mean,p50,p90,p99,p99.9,max>
+
+ Params:
+  - path: log file, truncated first
+  - load: writer loads
+  - num_writers: number of writers
+
+ Errors: It fails and exits the program if the log can't be opened
+ Returns: none
+*/
+void run_group(const char *path, thread_load *load, int num_writers) {
+    static const char *mode_names[] = { "append", "reserve" };
+    hist commits, writes;
+    pthread_condattr_t attr;
+    uint64_t begin, wall, records;
+    int flags = O_WRONLY | O_LARGEFILE | (append_mode == O_APPEND_WRITE ? O_APPEND : 0);
+
+    sync_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE, ACCESS_PERMISSION);
+    if (sync_fd < 0) {
+        fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    tail = 0;
+
+    memset(&commit, 0, sizeof(commit));
+    pthread_mutex_init(&commit.lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&commit.pending_cv, &attr);
+    pthread_cond_init(&commit.durable_cv, NULL);
+    pthread_condattr_destroy(&attr);
+    hist_init(&commit.sync_latencies);
+    commit.running_writers = num_writers;
+
+    for (int thread = 0; thread < num_writers; ++thread) {
+        load[thread].fd = open(path, flags);
+        if (load[thread].fd < 0) {
+            fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        hist_init(&load[thread].commit_latencies);
+        hist_init(&load[thread].write_latencies);
+    }
+
+    pthread_t commit_thread;
+    pthread_t* writers = (pthread_t*) malloc(num_writers * sizeof(pthread_t));
+    begin = stamp();
+    pthread_create(&commit_thread, NULL, committer, NULL);
+    for (int thread = 0; thread < num_writers; ++thread) {
+        pthread_create(&writers[thread], NULL, writer, (void *) &load[thread]);
+    }
+    for (int thread = 0; thread < num_writers; ++thread) {
+        pthread_join(writers[thread], NULL);
+    }
+    pthread_join(commit_thread, NULL);
+    wall = stamp() - begin;
+
+    hist_init(&commits);
+    hist_init(&writes);
+    for (int thread = 0; thread < num_writers; ++thread) {
+        hist_merge(&commits, &load[thread].commit_latencies);
+        hist_merge(&writes, &load[thread].write_latencies);
+        close(load[thread].fd);
+    }
+    close(sync_fd);
+    free(writers);
+
+    records = commits.count;
+    printf("append,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.2f,%" PRIu64 ",%" PRIu64 ",%.1f,%.2f,",
+            mode_names[append_mode], group_bytes, group_ns / 1000, records, commit.syncs,
+            commit.syncs ? commit.synced_records / (double) commit.syncs : 0, commit.max_group_records,
+            wall, records * (double) NSEC / wall, records * (double) record_size / 1e6 / (wall / (double) NSEC));
+    hist_print_csv(stdout, &commits);
+    printf("\nappend-write,%" PRIu64 ",", group_bytes);
+    hist_print_csv(stdout, &writes);
+    printf("\nappend-sync,%" PRIu64 ",", group_bytes);
+    hist_print_csv(stdout, &commit.sync_latencies);
+    printf("\n");
+    fflush(stdout);
+
+    pthread_mutex_destroy(&commit.lock);
+    pthread_cond_destroy(&commit.pending_cv);
+    pthread_cond_destroy(&commit.durable_cv);
+}
+
+// To run, type: ./append <path> <num_writers> <records_per_writer> <record_size> append|reserve <group_bytes>[,<group_bytes>...] <group_us>
+//                        [slow=<us>] [slowtop=<K>] [slowcap=<N>]
+int main(int argc, char* argv[]) {
+    uint64_t groups[MAX_GROUPS];
+    int num_groups = 0;
+
+    if (argc < 8) {
+        fprintf(stderr, "Usage: ./append <path> <num_writers> <records_per_writer> <record_size> "
+                "append|reserve <group_bytes>[,<group_bytes>...] <group_us> [slow=<us>] [slowtop=<K>] [slowcap=<N>]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Log file shared by every writer
+    char* path = argv[1];
+    int num_writers = atoi(argv[2]);
+    int records_per_writer = atoi(argv[3]);
+    record_size = atoi(argv[4]);
+
+    if (strcmp(argv[5], "append") == 0) {
+        append_mode = O_APPEND_WRITE;
+    } else if (strcmp(argv[5], "reserve") == 0) {
+        append_mode = RESERVE_PWRITE;
+    } else {
+        fprintf(stderr, "Invalid parameter %s, must be one of: append or reserve.\n", argv[5]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Every group size is a separate run, so records/s can be compared across them
+    for (char *tok = strtok(argv[6], ","); tok != NULL && num_groups < MAX_GROUPS; tok = strtok(NULL, ",")) {
+        groups[num_groups++] = strtoull(tok, NULL, 10);
+    }
+    group_ns = strtoull(argv[7], NULL, 10) * 1000ULL;
+
+    slowlog_spec_init(&slow_spec);
+    for (int i = 8; i < argc; ++i) {
+        if (!slowlog_parse_option(&slow_spec, argv[i])) {
+            fprintf(stderr, "Invalid option %s, must be one of: slow=<us>, slowtop=<K> or slowcap=<N>.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (num_writers <= 0 || records_per_writer <= 0 || record_size < (int) (2 * sizeof(int))) {
+        fprintf(stderr, "Need at least one writer and one record of %zu bytes.\n", 2 * sizeof(int));
+        exit(EXIT_FAILURE);
+    }
+
+    thread_load* load = (thread_load*) calloc(num_writers, sizeof(struct thread_load));
+    for (int thread = 0; thread < num_writers; ++thread) {
+        load[thread].thread_id = thread;
+        load[thread].num_records = records_per_writer;
+        load[thread].record = (char*) malloc(record_size);
+        memset(load[thread].record, 'a' + thread % 26, record_size);
+    }
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) calloc(1, slowlog_size(&slow_spec, num_writers));
+        slowlog_init(slow_log, &slow_spec, num_writers);
+    }
+
+    for (int group = 0; group < num_groups; ++group) {
+        group_bytes = groups[group];
+        run_group(path, load, num_writers);
+    }
+    slowlog_print(stdout, slow_log);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,398 @@
+#define _LARGEFILE64_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include "blockio.h"
+
+static const char *mode_names[] = { "rand", "perm", "perm-slice" };
+
+// CLOCK_MONOTONIC in ns, the clock of every request timestamp
+uint64_t stamp(void) {
+    struct timespec tspec;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &tspec)) {
+        fprintf(stderr, "Error getting timestamp: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+void sleep_until(uint64_t when) {
+    struct timespec ts;
+
+    ts.tv_sec = when / NSEC;
+    ts.tv_nsec = when % NSEC;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+/*
+ Parses an offset mode of the command line: rand, perm or perm-slice
+
+ Params:
+  - mode: set to the parsed mode
+  - option: command line option
+
+ Returns: 1 if the option was an offset mode, 0 otherwise
+*/
+int offsets_parse_mode(int *mode, const char *option) {
+    for (int m = RANDOM_OFFSETS; m <= PERM_SLICE_OFFSETS; m++) {
+        if (strcmp(option, mode_names[m]) == 0) {
+            *mode = m;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char *offsets_mode_name(int mode) {
+    return mode_names[mode];
+}
+
+/*
+ Sets where the requests of one thread go
+
+ Params:
+  - o: offsets of the thread
+  - mode: RANDOM_OFFSETS, PERM_OFFSETS or PERM_SLICE_OFFSETS
+  - file_size: bytes of the file the requests go to
+  - blksize: request size
+  - align: alignment of the random offsets, 1 for none (the permutations are block-aligned)
+  - index: thread index among the threads sharing the permutation of PERM_SLICE_OFFSETS
+  - num_threads: threads sharing it
+  - seed: of the run, the same for every thread
+
+ Errors: none
+ Returns: 0 on success, -1 if the file has fewer blocks than threads in the permutation modes
+*/
+int offsets_init(offsets *o, int mode, uint64_t file_size, size_t blksize, size_t align, int index, int num_threads, uint64_t seed) {
+    uint64_t nblocks = file_size / blksize;
+
+    memset(o, 0, sizeof(*o));
+    o->mode = mode;
+    o->blksize = blksize;
+    o->align = align;
+    o->units = file_size > blksize ? (file_size - blksize) / align + 1 : 1;
+    o->seed = (unsigned int) (seed + index);
+    if (mode == RANDOM_OFFSETS) {
+        return 0;
+    }
+    if (nblocks < (uint64_t) num_threads) {
+        return -1;
+    }
+    if (mode == PERM_OFFSETS) {
+        // each thread covers the whole file, in its own order
+        perm_init(&o->blocks, nblocks, seed + index);
+        o->slice_first = 0;
+        o->slice_len = nblocks;
+    } else {
+        perm_init(&o->blocks, nblocks, seed);
+        o->slice_first = nblocks * index / num_threads;
+        o->slice_len = nblocks * (index + 1) / num_threads - o->slice_first;
+    }
+    return 0;
+}
+
+// offset of the i-th request, the permutations wrap around once the slice is covered
+uint64_t offsets_at(offsets *o, uint64_t i) {
+    uint64_t r;
+
+    if (o->mode == RANDOM_OFFSETS) {
+        r = ((uint64_t) rand_r(&o->seed) << 31) | (uint64_t) rand_r(&o->seed);
+        return (r % o->units) * o->align;
+    }
+    return perm_at(&o->blocks, o->slice_first + i % o->slice_len) * o->blksize;
+}
+
+/*
+ Sets the schedule of one thread. Paced threads are spread evenly over their
+ interval, so that the threads of a group don't issue their requests together.
+
+ Params:
+  - p: pacer of the thread
+  - rate: requests/s of all the threads together, 0 for as fast as they can
+  - index: thread index among them
+  - num_threads: threads sharing the rate
+  - start: when the schedule starts
+  - delay_ns: think time before every request when not paced
+
+ Returns: none
+*/
+void pacer_init(pacer *p, double rate, int index, int num_threads, uint64_t start, uint64_t delay_ns) {
+    p->interval = rate > 0 ? (uint64_t) (num_threads * NSEC / rate) : 0;
+    p->next = start + p->interval * index / num_threads;
+    p->delay = delay_ns;
+}
+
+/*
+ Waits for the next request of a thread: its scheduled start when paced, the
+ think time otherwise. A paced thread behind schedule doesn't wait, and its
+ latency is measured from the scheduled start.
+
+ Params:
+  - p: pacer of the thread
+  - deadline: no request starts at or past it, UINT64_MAX for none
+  - begin: set to the start the latency of the request is measured from, may be NULL
+
+ Returns: 1 if the request should be issued, 0 once the deadline is reached
+*/
+int pacer_wait(pacer *p, uint64_t deadline, uint64_t *begin) {
+    uint64_t now;
+
+    if (p->interval == 0) {
+        if (p->delay > 0) {
+            sleep_until(stamp() + p->delay);
+        }
+        now = stamp();
+        if (begin != NULL) {
+            *begin = now;
+        }
+        return now < deadline;
+    }
+    if (p->next >= deadline) {
+        // don't sleep past the deadline
+        sleep_until(deadline);
+        return 0;
+    }
+    if ((now = stamp()) >= deadline) {
+        return 0;
+    }
+    if (p->next > now) {
+        sleep_until(p->next);
+    }
+    if (begin != NULL) {
+        *begin = p->next;
+    }
+    p->next += p->interval;
+    return 1;
+}
+
+/*
+ Sets the default requests: pread/pwrite on one buffer, no counters, no
+ stamps, whatever the buffer holds for the writes
+
+ Params:
+  - spec: block request specification
+  - generation: of the stamps (1 for writers, 0 for readers to accept any)
+
+ Returns: none
+*/
+void blockio_spec_init(blockio_spec *spec, uint64_t generation) {
+    memset(spec, 0, sizeof(*spec));
+    spec->generation = generation;
+    bufpool_spec_init(&spec->buffers);
+    vecio_spec_init(&spec->vectored);
+    pattern_spec_init(&spec->pattern);
+    spec->slow_log = NULL;
+}
+
+/*
+ Parses one block request option of the command line
+
+ Accepted options:
+  - perf (perf_event_open counters around every request)
+  - verify (stamp the written blocks, check the read ones)
+  - gen=<generation> (of the stamps)
+  - a buffer option (see bufpool.c)
+  - a vectored I/O option (see vecio.c)
+  - a pattern option, for writes only (see pattern.c)
+
+ Params:
+  - spec: block request specification being built
+  - option: command line option
+  - writes: whether the requests are writes
+
+ Errors: It fails and exits the program if the option value is invalid
+ Returns: 1 if the option was a block request option, 0 otherwise
+*/
+int blockio_parse_option(blockio_spec *spec, const char *option, int writes) {
+    if (strcmp(option, "perf") == 0) {
+        spec->count_events = 1;
+    } else if (strcmp(option, "verify") == 0) {
+        spec->verify = 1;
+    } else if (strncmp(option, "gen=", 4) == 0) {
+        spec->generation = strtoull(option + 4, NULL, 10);
+    } else if (!bufpool_parse_option(&spec->buffers, option) && !vecio_parse_option(&spec->vectored, option) &&
+            !(writes && pattern_parse_option(&spec->pattern, option))) {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ Prepares the requests of one thread, before the workers start
+
+ Params:
+  - io: requests of the thread
+  - spec: block request specification
+  - fd: file of the requests
+  - blksize: request size
+  - thread_id: thread of the requests, in the slow log
+  - verified: verification results of the thread
+  - seed: of the written content
+
+ Returns: none
+*/
+void blockio_init(blockio *io, const blockio_spec *spec, int fd, size_t blksize, int thread_id, verify_stats *verified, uint64_t seed) {
+    io->fd = fd;
+    io->thread_id = thread_id;
+    io->blksize = blksize;
+    io->plain = 0;
+    io->verified = verified;
+    vecio_stats_init(&io->vec);
+    if (spec->pattern.kind != PATTERN_UNINIT) {
+        pattern_init(&io->pattern, &spec->pattern, blksize, seed);
+    }
+}
+
+/*
+ Starts the requests of one thread, in the thread: maps its buffers and opens its counters
+
+ Params:
+  - io: requests of the thread
+  - spec: block request specification
+
+ Errors: It fails and exits the program if the perf events are unavailable
+ Returns: none
+*/
+void blockio_begin(blockio *io, const blockio_spec *spec) {
+    bufpool_setup(&io->bufs, &spec->buffers, io->blksize);
+    if (spec->count_events && perf_counters_open(&io->counters) < 0) {
+        fprintf(stderr, "No perf events available: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    bufpool_run_begin(&io->bufs);
+}
+
+// one read or write, timed between begin and end when they aren't NULL
+static ssize_t blockio_issue(blockio *io, const blockio_spec *spec, off_t offset, int is_write, char *buf,
+        uint64_t *begin, uint64_t *end) {
+    slowlog_probe probe;
+    ssize_t ret;
+
+    if (spec->count_events) {
+        perf_counters_enable(&io->counters);
+    }
+    slowlog_begin(spec->slow_log, &probe);
+    if (begin != NULL) {
+        *begin = stamp();
+    }
+    if (spec->vectored.enabled) {
+        // offset -1 keeps the plain requests on the file position
+        ret = is_write ? vecio_write(&spec->vectored, io->fd, buf, io->blksize, io->plain ? -1 : offset, &io->vec)
+                : vecio_read(&spec->vectored, io->fd, buf, io->blksize, io->plain ? -1 : offset, &io->vec);
+    } else if (io->plain) {
+        ret = is_write ? write(io->fd, buf, io->blksize) : read(io->fd, buf, io->blksize);
+    } else {
+        ret = is_write ? pwrite(io->fd, buf, io->blksize, offset) : pread(io->fd, buf, io->blksize, offset);
+    }
+    if (end != NULL) {
+        *end = stamp();
+    }
+    slowlog_end(spec->slow_log, &probe, io->thread_id, is_write ? "write" : "read", NULL, offset);
+    if (spec->count_events) {
+        perf_counters_disable(&io->counters);
+    }
+    return ret;
+}
+
+/*
+ Reads one block into the next buffer and checks its stamps in verify mode
+
+ Params:
+  - io: requests of the thread
+  - spec: block request specification
+  - offset: of the block
+  - begin, end: set to the start and end of the call, may be NULL to skip the timestamps
+
+ Errors: none, the result of the call is returned
+ Returns: The result of the read call
+*/
+ssize_t blockio_read(blockio *io, const blockio_spec *spec, off_t offset, uint64_t *begin, uint64_t *end) {
+    char *buf = bufpool_next(&io->bufs);
+    ssize_t ret = blockio_issue(io, spec, offset, 0, buf, begin, end);
+
+    if (spec->verify && ret > 0) {
+        verify_check(buf, ret, offset, spec->generation, io->verified);
+    }
+    return ret;
+}
+
+/*
+ Writes one block from the next buffer, filled with the pattern and stamped in verify mode
+
+ Params:
+  - io: requests of the thread
+  - spec: block request specification
+  - offset: of the block
+  - begin, end: set to the start and end of the call, may be NULL to skip the timestamps
+
+ Errors: none, the result of the call is returned
+ Returns: The result of the write call
+*/
+ssize_t blockio_write(blockio *io, const blockio_spec *spec, off_t offset, uint64_t *begin, uint64_t *end) {
+    char *buf = bufpool_next(&io->bufs);
+
+    if (spec->pattern.kind != PATTERN_UNINIT) {
+        // into the pool buffer, so that bufs, huge, mlock and prefault still apply
+        pattern_fill(&io->pattern, buf);
+    }
+    if (spec->verify) {
+        verify_stamp(buf, io->blksize, offset, spec->generation, io->verified);
+    }
+    return blockio_issue(io, spec, offset, 1, buf, begin, end);
+}
+
+// ends the requests of one thread, in the thread: reads and closes its counters
+void blockio_end(blockio *io, const blockio_spec *spec) {
+    bufpool_run_end(&io->bufs);
+    if (spec->count_events) {
+        perf_counters_read(&io->counters);
+        perf_counters_close(&io->counters);
+    }
+}
+
+void blockio_totals_init(blockio_totals *total) {
+    memset(total, 0, sizeof(*total));
+    vecio_stats_init(&total->vec);
+}
+
+void blockio_merge(blockio_totals *total, const blockio *io) {
+    bufpool_merge(&total->bufs, &io->bufs);
+    vecio_merge(&total->vec, &io->vec);
+    perf_counters_merge(&total->counters, &io->counters);
+}
+
+/*
+ Prints the summary lines of the enabled options:
+   the buffer pool line (see bufpool.c) with buffer options
+   the vectored I/O line (see vecio.c) with vectored I/O options
+   perf,<op>,<ops>,<counters per op> with perf
+
+ Params:
+  - out: output stream
+  - op: read or write, or the name of the requests
+  - spec: block request specification
+  - blksize: request size
+  - bytes: bytes transferred by every thread
+  - ops: requests of every thread
+  - total: merged threads
+
+ Returns: none
+*/
+void blockio_print_summary(FILE *out, const char *op, const blockio_spec *spec, size_t blksize, uint64_t bytes, uint64_t ops, const blockio_totals *total) {
+    if (spec->buffers.enabled) {
+        bufpool_print_summary(out, op, &spec->buffers, blksize, bytes, &total->bufs);
+    }
+    if (spec->vectored.enabled) {
+        vecio_print_summary(out, op, &spec->vectored, blksize, &total->vec);
+    }
+    if (spec->count_events) {
+        fprintf(out, "perf,%s,%" PRIu64 ",", op, ops);
+        perf_counters_print_csv(out, &total->counters, ops);
+        fprintf(out, "\n");
+    }
+}
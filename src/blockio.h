@@ -0,0 +1,98 @@
+#ifndef BLOCKIO_H
+#define BLOCKIO_H
+
+#include <stdio.h>
+#include <stddef.h> //size_t
+#include <stdint.h> //uint64_t
+#include <sys/types.h> //off_t, ssize_t
+#include "perm.h"
+#include "perfctr.h"
+#include "verify.h"
+#include "bufpool.h"
+#include "slowlog.h"
+#include "vecio.h"
+#include "pattern.h"
+
+#define NSEC 1000000000ULL
+
+enum offset_modes {
+    RANDOM_OFFSETS,     // random offsets, may repeat, aligned to the offsets alignment
+    PERM_OFFSETS,       // every block of the file once, in pseudo-random order
+    PERM_SLICE_OFFSETS  // as above, each thread walks a disjoint slice of one permutation
+};
+
+// Where the requests of one thread go, block-aligned but in RANDOM_OFFSETS
+typedef struct offsets {
+    int mode;
+    size_t blksize;
+    uint64_t units;         // random offsets are a multiple of align below units * align
+    size_t align;
+    unsigned int seed;
+    perm blocks;
+    uint64_t slice_first;
+    uint64_t slice_len;
+} offsets;
+
+// When the requests of one thread start: on a fixed schedule shared by the
+// threads of a group (open loop), or as soon as the previous one ended, after
+// an optional think time.
+typedef struct pacer {
+    uint64_t interval;      // ns between two requests of the thread, 0 when not paced
+    uint64_t next;          // scheduled start of the next request
+    uint64_t delay;         // ns of think time before every request when not paced
+} pacer;
+
+// How the block requests are issued, the same for every thread
+typedef struct blockio_spec {
+    int count_events;       // perf_event_open counters around every request
+    int verify;             // stamp the written blocks, check the read ones
+    uint64_t generation;    // of the stamps, 0 accepts any on reads
+    bufpool_spec buffers;
+    vecio_spec vectored;
+    pattern_spec pattern;   // content of the written blocks
+    slowlog *slow_log;      // shared by the threads, NULL when disabled
+} blockio_spec;
+
+// The requests of one thread on one file
+typedef struct blockio {
+    int fd;
+    int thread_id;
+    size_t blksize;
+    int plain;              // read()/write() at the file position, kept by the caller at the offsets it passes
+    bufpool bufs;
+    pattern_pool pattern;
+    vecio_stats vec;
+    perf_counters counters;
+    verify_stats *verified;
+} blockio;
+
+// What the threads of one run did, for blockio_print_summary()
+typedef struct blockio_totals {
+    bufpool bufs;
+    vecio_stats vec;
+    perf_counters counters;
+} blockio_totals;
+
+uint64_t stamp(void);
+void sleep_until(uint64_t when);
+
+int offsets_parse_mode(int *mode, const char *option);
+const char *offsets_mode_name(int mode);
+int offsets_init(offsets *o, int mode, uint64_t file_size, size_t blksize, size_t align, int index, int num_threads, uint64_t seed);
+uint64_t offsets_at(offsets *o, uint64_t i);
+
+void pacer_init(pacer *p, double rate, int index, int num_threads, uint64_t start, uint64_t delay_ns);
+int pacer_wait(pacer *p, uint64_t deadline, uint64_t *begin);
+
+void blockio_spec_init(blockio_spec *spec, uint64_t generation);
+int blockio_parse_option(blockio_spec *spec, const char *option, int writes);
+void blockio_init(blockio *io, const blockio_spec *spec, int fd, size_t blksize, int thread_id, verify_stats *verified, uint64_t seed);
+void blockio_begin(blockio *io, const blockio_spec *spec);
+ssize_t blockio_read(blockio *io, const blockio_spec *spec, off_t offset, uint64_t *begin, uint64_t *end);
+ssize_t blockio_write(blockio *io, const blockio_spec *spec, off_t offset, uint64_t *begin, uint64_t *end);
+void blockio_end(blockio *io, const blockio_spec *spec);
+void blockio_totals_init(blockio_totals *total);
+void blockio_merge(blockio_totals *total, const blockio *io);
+void blockio_print_summary(FILE *out, const char *op, const blockio_spec *spec, size_t blksize, uint64_t bytes, uint64_t ops, const blockio_totals *total);
+
+#endif
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h> //getrusage
+#include "bufpool.h"
+
+#define SMALL_PAGE (4UL << 10)
+#define HUGE_PAGE (2UL << 20)
+
+static const char *huge_names[] = { "none", "thp", "hugetlb" };
+
+/*
+ Sets the default pool: one buffer on 4K pages, faulted in by the first request
+
+ Params:
+  - spec: pool specification
+
+ Returns: none
+*/
+void bufpool_spec_init(bufpool_spec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->bufs = 1;
+    spec->huge = HUGE_NONE;
+}
+
+/*
+ Parses one buffer pool option of the command line
+
+ Accepted options:
+  - bufs=<M> (buffers per worker, rotated per request)
+  - huge=none|thp|hugetlb (page size backing the buffers)
+  - mlock (lock the buffers in memory before the run)
+  - prefault (touch every page of the buffers before the run)
+
+ Params:
+  - spec: pool specification being built
+  - option: command line option
+
+ Errors: It fails and exits the program if the option value is invalid
+ Returns: 1 if the option was a pool option, 0 otherwise
+*/
+int bufpool_parse_option(bufpool_spec *spec, const char *option) {
+    if (strncmp(option, "bufs=", 5) == 0) {
+        spec->bufs = atoi(option + 5);
+        if (spec->bufs < 1) {
+            fprintf(stderr, "Invalid %s, need at least one buffer\n", option);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strncmp(option, "huge=", 5) == 0) {
+        for (spec->huge = HUGE_NONE; spec->huge <= HUGE_HUGETLB; spec->huge++) {
+            if (strcmp(option + 5, huge_names[spec->huge]) == 0) {
+                break;
+            }
+        }
+        if (spec->huge > HUGE_HUGETLB) {
+            fprintf(stderr, "Invalid %s, must be one of: none, thp or hugetlb\n", option);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strcmp(option, "mlock") == 0) {
+        spec->mlock = 1;
+    } else if (strcmp(option, "prefault") == 0) {
+        spec->prefault = 1;
+    } else {
+        return 0;
+    }
+    spec->enabled = 1;
+    return 1;
+}
+
+static size_t round_up(size_t value, size_t unit) {
+    return (value + unit - 1) / unit * unit;
+}
+
+/*
+ Maps the buffers of a worker. Called by the worker itself, so that in
+ process mode the pages are faulted and locked by the process using them
+ (mlock() isn't inherited and prefaulted private pages would be copied on
+ write after fork()).
+
+ Params:
+  - pool: pool of the worker
+  - spec: pool specification
+  - buf_size: size of one buffer, the request size
+
+ Errors: It fails and exits the program if the memory can't be mapped or locked
+ Returns: none
+*/
+void bufpool_setup(bufpool *pool, const bufpool_spec *spec, size_t buf_size) {
+    size_t page = spec->huge == HUGE_NONE ? SMALL_PAGE : HUGE_PAGE;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    char *map;
+
+    pool->bufs = spec->bufs;
+    pool->next = 0;
+    pool->stride = round_up(buf_size, SMALL_PAGE);
+    pool->length = round_up(pool->stride * pool->bufs, page);
+
+    if (spec->huge == HUGE_HUGETLB) {
+        flags |= MAP_HUGETLB;
+    }
+    // THP needs a 2M-aligned range, map one more huge page and align inside it
+    map = mmap(NULL, pool->length + (spec->huge == HUGE_THP ? HUGE_PAGE : 0), PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Couldn't map %zu bytes of buffers (huge=%s): %s%s\n", pool->length, huge_names[spec->huge],
+                strerror(errno), spec->huge == HUGE_HUGETLB ? ", are enough pages reserved in vm.nr_hugepages?" : "");
+        exit(EXIT_FAILURE);
+    }
+    pool->base = spec->huge == HUGE_THP ? (char*) round_up((size_t) map, HUGE_PAGE) : map;
+
+    if (spec->huge == HUGE_NONE) {
+        madvise(pool->base, pool->length, MADV_NOHUGEPAGE);
+    } else if (spec->huge == HUGE_THP && madvise(pool->base, pool->length, MADV_HUGEPAGE) != 0) {
+        fprintf(stderr, "madvise(MADV_HUGEPAGE) failed: %s\n", strerror(errno));
+    }
+
+    if (spec->prefault) {
+        for (size_t off = 0; off < pool->length; off += SMALL_PAGE) {
+            pool->base[off] = 0;
+        }
+    }
+    if (spec->mlock && mlock(pool->base, pool->length) != 0) {
+        fprintf(stderr, "Couldn't mlock %zu bytes of buffers: %s\n", pool->length, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+// buffer of the next request
+char *bufpool_next(bufpool *pool) {
+    char *buf = pool->base + pool->next * pool->stride;
+
+    pool->next = pool->next + 1 < pool->bufs ? pool->next + 1 : 0;
+    return buf;
+}
+
+static uint64_t bufpool_stamp(void) {
+    struct timespec tspec;
+
+    clock_gettime(CLOCK_MONOTONIC, &tspec);
+    return (tspec.tv_sec * 1000000000ULL) + tspec.tv_nsec;
+}
+
+// page faults of the calling thread (of the process in process mode, it has one)
+static void bufpool_faults(uint64_t *minor, uint64_t *major) {
+    struct rusage usage;
+
+    getrusage(RUSAGE_THREAD, &usage);
+    *minor = usage.ru_minflt;
+    *major = usage.ru_majflt;
+}
+
+void bufpool_run_begin(bufpool *pool) {
+    bufpool_faults(&pool->minor_faults, &pool->major_faults);
+    pool->run_begin = bufpool_stamp();
+}
+
+void bufpool_run_end(bufpool *pool) {
+    uint64_t minor, major;
+
+    pool->run_end = bufpool_stamp();
+    bufpool_faults(&minor, &major);
+    pool->minor_faults = minor - pool->minor_faults;
+    pool->major_faults = major - pool->major_faults;
+}
+
+// adds the faults of a worker to a zeroed total and widens its run to cover the worker's
+void bufpool_merge(bufpool *total, const bufpool *pool) {
+    if (total->run_end == 0 || pool->run_begin < total->run_begin) {
+        total->run_begin = pool->run_begin;
+    }
+    if (pool->run_end > total->run_end) {
+        total->run_end = pool->run_end;
+    }
+    total->minor_faults += pool->minor_faults;
+    total->major_faults += pool->major_faults;
+}
+
+/*
+ Prints the throughput of the run along with the buffer policy that produced it:
+   bufpool,<op>,<bufs>,<buf_size>,<huge>,<mlock>,<prefault>,<bytes>,<span_ns>,<MB/s>,<minor_faults>,<major_faults>
+ The faults are those the workers took between their first and last request.
+
+ Params:
+  - out: output stream
+  - op: read or write
+  - spec: pool specification
+  - buf_size: size of one buffer
+  - bytes: bytes transferred by every worker
+  - total: merged pools of the workers
+
+ Returns: none
+*/
+void bufpool_print_summary(FILE *out, const char *op, const bufpool_spec *spec, size_t buf_size, uint64_t bytes, const bufpool *total) {
+    uint64_t span_ns = total->run_end - total->run_begin;
+
+    fprintf(out, "bufpool,%s,%d,%zu,%s,%d,%d,%lu,%lu,%.1f,%lu,%lu\n", op, spec->bufs, buf_size, huge_names[spec->huge],
+            spec->mlock, spec->prefault, (unsigned long) bytes, (unsigned long) span_ns,
+            span_ns ? bytes / 1e6 / (span_ns / 1e9) : 0, (unsigned long) total->minor_faults,
+            (unsigned long) total->major_faults);
+}
@@ -0,0 +1,46 @@
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <stdio.h>
+#include <stddef.h> //size_t
+#include <stdint.h> //uint64_t
+
+enum bufpool_huge {
+    HUGE_NONE,     // 4K pages, transparent hugepages disabled on the pool
+    HUGE_THP,      // 2M-aligned pool advised for transparent hugepages
+    HUGE_HUGETLB   // MAP_HUGETLB, needs reserved pages (vm.nr_hugepages)
+};
+
+// Memory of the I/O buffers of a worker: <bufs> buffers rotated per request,
+// backed by 4K or 2M pages, optionally locked and prefaulted before the run.
+typedef struct bufpool_spec {
+    int bufs;
+    int huge;
+    int mlock;
+    int prefault;
+    int enabled;    // any pool option given, print the summary line
+} bufpool_spec;
+
+// Buffers of one worker and the page faults it took while issuing requests
+typedef struct bufpool {
+    char *base;
+    size_t stride;
+    size_t length;
+    int bufs;
+    int next;
+    uint64_t run_begin;
+    uint64_t run_end;
+    uint64_t minor_faults;
+    uint64_t major_faults;
+} bufpool;
+
+void bufpool_spec_init(bufpool_spec *spec);
+int bufpool_parse_option(bufpool_spec *spec, const char *option);
+void bufpool_setup(bufpool *pool, const bufpool_spec *spec, size_t buf_size);
+char *bufpool_next(bufpool *pool);
+void bufpool_run_begin(bufpool *pool);
+void bufpool_run_end(bufpool *pool);
+void bufpool_merge(bufpool *total, const bufpool *pool);
+void bufpool_print_summary(FILE *out, const char *op, const bufpool_spec *spec, size_t buf_size, uint64_t bytes, const bufpool *total);
+
+#endif
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "json.h"
+
+#define DEFAULT_ALPHA 0.05
+#define DEFAULT_THRESHOLD_PCT 5.0
+#define EXIT_REGRESSION 2
+
+/*
+ Compares two JSON reports of the same benchmark, a baseline and a
+ candidate run, e.g. before and after a kernel or filesystem upgrade:
+ ./engine (report= in the job file), or stat, mix_metadata, rr, rw, seqr
+ and seqw (json=<file>).
+
+ Every metric of the groups the two runs share is tested with Welch's
+ t-test on the samples of their interval series: requests/s of every
+ interval, and the mean latency of every operation in every interval.
+ rr, rw, seqr and seqw split their run into intervals of their own; stat
+ and mix_metadata, without intervals, report one sample per thread instead.
+ A metric regressed (or improved) when the difference is significant
+ (p < alpha) and at least threshold% of the baseline mean.
+
+ Differences in environment and configuration are listed first, as they
+ may explain (or invalidate) what follows.
+*/
+
+enum verdicts {
+    UNCHANGED,
+    REGRESSION,
+    IMPROVEMENT,
+    INSUFFICIENT,
+    NUM_VERDICTS
+};
+
+static const char *verdict_names[NUM_VERDICTS] = { "unchanged", "regression", "improvement", "insufficient" };
+
+// samples of one metric: the non-null numbers of an interval series
+typedef struct sample {
+    int n;
+    double mean;
+    double var;
+} sample;
+
+double alpha = DEFAULT_ALPHA;
+double threshold_pct = DEFAULT_THRESHOLD_PCT;
+int verdicts[NUM_VERDICTS];
+
+// continued fraction of the incomplete beta function (modified Lentz)
+static double beta_fraction(double a, double b, double x) {
+    const double tiny = 1e-300;
+    double c = 1, d = 1 - (a + b) * x / (a + 1), h;
+
+    d = 1 / (fabs(d) < tiny ? tiny : d);
+    h = d;
+    for (int m = 1; m <= 300; m++) {
+        double num = m * (b - m) * x / ((a - 1 + 2 * m) * (a + 2 * m)), delta;
+
+        d = 1 + num * d;
+        d = 1 / (fabs(d) < tiny ? tiny : d);
+        c = 1 + num / c;
+        c = fabs(c) < tiny ? tiny : c;
+        h *= d * c;
+
+        num = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 1 + 2 * m));
+        d = 1 + num * d;
+        d = 1 / (fabs(d) < tiny ? tiny : d);
+        c = 1 + num / c;
+        c = fabs(c) < tiny ? tiny : c;
+        delta = d * c;
+        h *= delta;
+        if (fabs(delta - 1) < 1e-12) {
+            break;
+        }
+    }
+    return h;
+}
+
+// regularized incomplete beta function I_x(a, b)
+static double incomplete_beta(double a, double b, double x) {
+    double front;
+
+    if (x <= 0) {
+        return 0;
+    }
+    if (x >= 1) {
+        return 1;
+    }
+    front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1 - x));
+    if (x < (a + 1) / (a + b + 2)) {
+        return front * beta_fraction(a, b, x) / a;
+    }
+    return 1 - front * beta_fraction(b, a, 1 - x) / b;
+}
+
+/*
+ Welch's t-test of two samples with possibly different variances
+
+ Params:
+  - x, y: the samples, at least two values each
+  - t, df: set to the t statistic and the Welch-Satterthwaite degrees of freedom
+
+ Returns: The two-sided p-value
+*/
+double welch_test(const sample *x, const sample *y, double *t, double *df) {
+    double vx = x->var / x->n, vy = y->var / y->n;
+
+    if (vx + vy == 0) {
+        // constant samples (e.g. a paced rate): equal or certainly different
+        *t = x->mean == y->mean ? 0 : INFINITY;
+        *df = x->n + y->n - 2;
+        return x->mean == y->mean ? 1 : 0;
+    }
+    *t = (y->mean - x->mean) / sqrt(vx + vy);
+    *df = (vx + vy) * (vx + vy) / (vx * vx / (x->n - 1) + vy * vy / (y->n - 1));
+    return incomplete_beta(*df / 2, 0.5, *df / (*df + *t * *t));
+}
+
+static void sample_of(sample *s, const json *series) {
+    double sum = 0, squares = 0;
+
+    memset(s, 0, sizeof(*s));
+    for (int i = 0; series != NULL && series->type == JSON_ARRAY && i < series->length; i++) {
+        if (series->items[i].type == JSON_NUMBER) {
+            s->n++;
+            sum += series->items[i].number;
+        }
+    }
+    if (s->n == 0) {
+        return;
+    }
+    s->mean = sum / s->n;
+    for (int i = 0; i < series->length; i++) {
+        if (series->items[i].type == JSON_NUMBER) {
+            squares += (series->items[i].number - s->mean) * (series->items[i].number - s->mean);
+        }
+    }
+    s->var = s->n > 1 ? squares / (s->n - 1) : 0;
+}
+
+/*
+ Tests one metric and prints:
+   compare,<group>,<metric>,<baseline_mean>,<candidate_mean>,<change_pct>,<t>,<df>,<p>,<verdict>
+ verdict being unchanged, regression, improvement or insufficient (fewer than
+ two samples on a side, t, df and p are then empty)
+
+ Params:
+  - name: group name
+  - metric: metric name
+  - base, cand: interval (or thread) series of the baseline and the candidate
+  - higher_is_better: 1 for throughput, 0 for latency
+
+ Returns: none
+*/
+void compare_metric(const char *name, const char *metric, const json *base, const json *cand, int higher_is_better) {
+    sample x, y;
+    double t, df, p, change;
+    int verdict;
+
+    sample_of(&x, base);
+    sample_of(&y, cand);
+    change = x.mean != 0 ? 100 * (y.mean - x.mean) / x.mean : 0;
+    if (x.n < 2 || y.n < 2) {
+        verdicts[INSUFFICIENT]++;
+        printf("compare,%s,%s,%.1f,%.1f,%.2f,,,,%s\n", name, metric, x.mean, y.mean, change, verdict_names[INSUFFICIENT]);
+        return;
+    }
+    p = welch_test(&x, &y, &t, &df);
+    verdict = UNCHANGED;
+    if (p < alpha && fabs(change) >= threshold_pct) {
+        verdict = (change > 0) == higher_is_better ? IMPROVEMENT : REGRESSION;
+    }
+    verdicts[verdict]++;
+    printf("compare,%s,%s,%.1f,%.1f,%.2f,%.3f,%.1f,%.3g,%s\n", name, metric, x.mean, y.mean, change, t, df, p,
+            verdict_names[verdict]);
+}
+
+static void value_text(const json *value, char *buf, size_t size) {
+    if (value == NULL) {
+        snprintf(buf, size, "missing");
+    } else if (value->type == JSON_STRING) {
+        snprintf(buf, size, "%s", value->string);
+    } else if (value->type == JSON_NUMBER) {
+        snprintf(buf, size, "%g", value->number);
+    } else {
+        snprintf(buf, size, "-");
+    }
+}
+
+// prints <kind>,<scope>,<key>,<baseline>,<candidate> if a member differs
+static void diff_member(const char *kind, const char *scope, const json *base, const json *cand, const char *key) {
+    char x[512], y[512];
+
+    value_text(json_get(base, key), x, sizeof x);
+    value_text(json_get(cand, key), y, sizeof y);
+    if (strcmp(x, y) != 0) {
+        printf("%s,%s,%s,%s,%s\n", kind, scope, key, x, y);
+    }
+}
+
+static int is_scalar(const json *value) {
+    return value->type != JSON_ARRAY && value->type != JSON_OBJECT;
+}
+
+// prints every scalar member of either object that differs, as diff_member()
+static void diff_members(const char *kind, const char *scope, const json *base, const json *cand) {
+    for (int i = 0; base != NULL && base->type == JSON_OBJECT && i < base->length; i++) {
+        if (is_scalar(&base->items[i])) {
+            diff_member(kind, scope, base, cand, base->items[i].key);
+        }
+    }
+    for (int i = 0; cand != NULL && cand->type == JSON_OBJECT && i < cand->length; i++) {
+        if (is_scalar(&cand->items[i]) && json_get(base, cand->items[i].key) == NULL) {
+            diff_member(kind, scope, base, cand, cand->items[i].key);
+        }
+    }
+}
+
+static const json *find_group(const json *groups, const char *name) {
+    for (int i = 0; groups != NULL && groups->type == JSON_ARRAY && i < groups->length; i++) {
+        if (strcmp(json_get_string(&groups->items[i], "name", ""), name) == 0) {
+            return &groups->items[i];
+        }
+    }
+    return NULL;
+}
+
+// samples of a group: its interval series, or its per-thread series for the benchmarks without intervals
+static const json *group_series(const json *group) {
+    const json *series = json_get(group, "intervals");
+
+    return series != NULL ? series : json_get(group, "threads");
+}
+
+/*
+ Lists what differs between the runs besides their results:
+   compare-env,<scope>,<key>,<baseline>,<candidate> for the kernel, CPUs and filesystems
+   compare-config,<group>,<key>,<baseline>,<candidate> for the groups
+ Filesystems are matched by position, as their groups are. Every scalar
+ member of the configurations is compared, whatever the benchmark.
+*/
+void diff_setup(const json *base, const json *cand) {
+    static const char *env_keys[] = { "sysname", "release", "version", "machine", "cpus_online" };
+    static const char *fs_keys[] = { "path", "fs_type", "mount_source", "mount_options" };
+    const json *env_x = json_get(base, "environment"), *env_y = json_get(cand, "environment");
+    const json *fs_x = json_get(env_x, "filesystems"), *fs_y = json_get(env_y, "filesystems");
+    const json *cfg_x = json_get(base, "config"), *cfg_y = json_get(cand, "config");
+    const json *groups = json_get(cfg_x, "groups");
+    char scope[32];
+
+    for (size_t k = 0; k < sizeof env_keys / sizeof env_keys[0]; k++) {
+        diff_member("compare-env", "kernel", env_x, env_y, env_keys[k]);
+    }
+    for (int i = 0; fs_x != NULL && fs_y != NULL && i < fs_x->length && i < fs_y->length; i++) {
+        snprintf(scope, sizeof scope, "fs%d", i);
+        for (size_t k = 0; k < sizeof fs_keys / sizeof fs_keys[0]; k++) {
+            diff_member("compare-env", scope, &fs_x->items[i], &fs_y->items[i], fs_keys[k]);
+        }
+    }
+
+    diff_members("compare-config", "global", cfg_x, cfg_y);
+    for (int i = 0; groups != NULL && groups->type == JSON_ARRAY && i < groups->length; i++) {
+        const char *name = json_get_string(&groups->items[i], "name", "");
+        const json *other = find_group(json_get(cfg_y, "groups"), name);
+
+        if (other == NULL) {
+            printf("compare-config,%s,group,present,missing\n", name);
+            continue;
+        }
+        diff_members("compare-config", name, &groups->items[i], other);
+    }
+}
+
+// To run, type: ./compare <baseline.json> <candidate.json> [alpha=<p>] [threshold=<pct>]
+int main(int argc, char* argv[]) {
+    json *base, *cand;
+    const json *groups;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: ./compare <baseline.json> <candidate.json> [alpha=<p>] [threshold=<pct>]\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 3; i < argc; ++i) {
+        if (strncmp(argv[i], "alpha=", 6) == 0) {
+            alpha = atof(argv[i] + 6);
+        } else if (strncmp(argv[i], "threshold=", 10) == 0) {
+            threshold_pct = atof(argv[i] + 10);
+        } else {
+            fprintf(stderr, "Invalid option %s, must be one of: alpha=<p> or threshold=<pct>.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (alpha <= 0 || alpha >= 1 || threshold_pct < 0) {
+        fprintf(stderr, "alpha must be in (0, 1) and threshold at least 0.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    base = json_load(argv[1]);
+    cand = json_load(argv[2]);
+    if (json_get_string(base, "tool", "")[0] == '\0'
+            || strcmp(json_get_string(base, "tool", ""), json_get_string(cand, "tool", "")) != 0) {
+        fprintf(stderr, "Both files must be reports of the same benchmark.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    diff_setup(base, cand);
+
+    groups = json_get(json_get(base, "results"), "groups");
+    for (int i = 0; groups != NULL && groups->type == JSON_ARRAY && i < groups->length; i++) {
+        const char *name = json_get_string(&groups->items[i], "name", "");
+        const json *other = find_group(json_get(json_get(cand, "results"), "groups"), name);
+        const json *series_x = group_series(&groups->items[i]), *series_y = group_series(other);
+        const json *lat_x = json_get(series_x, "mean_latency_ns"), *lat_y = json_get(series_y, "mean_latency_ns");
+        char metric[64];
+
+        if (other == NULL) {
+            continue;
+        }
+        compare_metric(name, "requests/s", json_get(series_x, "requests_per_s"), json_get(series_y, "requests_per_s"), 1);
+        for (int op = 0; lat_x != NULL && op < lat_x->length; op++) {
+            const json *cand_series = json_get(lat_y, lat_x->items[op].key);
+
+            if (cand_series == NULL) {
+                continue;
+            }
+            snprintf(metric, sizeof metric, "%s_latency_ns", lat_x->items[op].key);
+            compare_metric(name, metric, &lat_x->items[op], cand_series, 0);
+        }
+    }
+
+    // compare-summary,<alpha>,<threshold_pct>,<regressions>,<improvements>,<unchanged>,<insufficient>
+    printf("compare-summary,%g,%g,%d,%d,%d,%d\n", alpha, threshold_pct, verdicts[REGRESSION], verdicts[IMPROVEMENT],
+            verdicts[UNCHANGED], verdicts[INSUFFICIENT]);
+
+    json_free(base);
+    json_free(cand);
+    // a distinct status lets scripts fail a run on a regression
+    return verdicts[REGRESSION] ? EXIT_REGRESSION : EXIT_SUCCESS;
+}
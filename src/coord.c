@@ -0,0 +1,696 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <stdint.h> //uint64_t
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "hist.h"
+#include "workload.h"
+
+#define NSEC 1000000000ULL
+#define MAX_FIELDS 32
+#define MAX_ARGS 64
+#define CONNECT_RETRIES 100
+#define MAX_LINE 65536
+
+/*
+ Runs one workload of this repository on many clients at once and merges the
+ results in one report.
+
+ The coordinator listens on tcp:<host>:<port> or unix:<path> and waits for
+ <num_agents> agents. It then sends every agent the workload (where %a in an
+ argument becomes the agent id, so agents can use their own files) and a
+ CLOCK_REALTIME start time <start_delay_ms> in the future. Agents sleep until
+ that time, run the workload, and stream back its interval stats as each
+ interval closes and its latency histograms once it is done, taken from its
+ standard output like repeat does:
+  - lat:<col>[,<col>...]: every line has latencies in nanoseconds at these
+          columns (0-based, e.g. full-lat output of stat, or columns 0,1,2 of
+          the full-lat output of mix_metadata); one histogram per column
+  - span:<begin_col>:<end_col>: every line has CLOCK_MONOTONIC begin and end
+          timestamps in nanoseconds (e.g. debug output of rr, rw, seqr and
+          seqw, columns 2 and 3); gives the interval stats too
+ rr, stat and mix_metadata print their per-operation lines once they are
+ done, so the interval stats of these lines only reach the coordinator at
+ the end of the run. To stream them while it goes, give the workload
+ live=<interval_ms>: it then prints live,<now_ns>,<ops>,<latency_sum>,<latency_max>
+ every interval (see livestats.c), which the agent takes as the interval
+ stats instead, whatever the metrics.
+ The other output lines of the workload are forwarded as they are.
+
+ Protocol, one line per message:
+   agent -> coordinator: hello <host>
+   coordinator -> agent: job <agent_id> <start_ns> <interval_ms> <metrics> <argc>
+                         arg <argument>   (argc times)
+   agent -> coordinator: out <line>
+                         interval <index> <ops> <latency_sum> <latency_max>
+                         hist <col> <count> <sum> <min> <max>
+                         bucket <col> <index> <count>
+                         span <first_begin_ns> <last_end_ns>
+                         done <exit_status> <wall_ns> <start_skew_ns>
+ Interval indexes and span timestamps are relative to the start time. An
+ interval is sent once the agent clock is past its end; operations the
+ workload prints later for it are sent in further interval messages, which
+ the coordinator adds up.
+*/
+
+typedef struct interval_stats {
+    uint64_t ops;
+    uint64_t latency_sum;
+    uint64_t latency_max;
+} interval_stats;
+
+typedef struct agent {
+    int id;
+    char host[64];
+    FILE *in;
+    FILE *out;
+    hist *hists;
+    int exit_status;
+    uint64_t wall_ns;
+    int64_t start_skew_ns;
+    int64_t first_begin_ns;
+    int64_t last_end_ns;
+    int done;
+} agent;
+
+metric_spec metrics_spec;
+uint64_t interval_ns;
+
+// merged by the coordinator as the agents report
+pthread_mutex_t merge_lock = PTHREAD_MUTEX_INITIALIZER;
+interval_stats *intervals;
+long num_intervals;
+
+static uint64_t stamp (clockid_t clock) {
+   struct timespec tspec;
+   if (clock_gettime (clock, &tspec)) {
+       perror("Error getting timestamp");
+       exit(EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+// parses the metrics spec: lat:<col>[,<col>...] or span:<begin_col>:<end_col>
+void parse_metrics(const char *spec) {
+    if (!metric_spec_parse(&metrics_spec, spec) || metrics_spec.source == METRIC_LAST) {
+        fprintf(stderr, "Invalid metrics %s, must be one of: lat:<col>[,<col>...] or span:<begin>:<end>.\n", spec);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ Opens a listening or connected stream socket
+
+ Params:
+  - spec: tcp:<host>:<port> (host may be empty to listen on every address) or unix:<path>
+  - listening: 1 to bind and listen, 0 to connect
+
+ Errors: It fails and exits the program if the socket can't be set up; connecting
+         retries for a while so that agents can be started before the coordinator
+ Returns: The socket
+*/
+int open_socket(const char *spec, int listening) {
+    struct sockaddr_un unix_addr;
+    struct addrinfo hints, *addrs, *addr;
+    char host[256], *port;
+    int fd = -1, err, one = 1;
+
+    if (strncmp(spec, "unix:", 5) == 0) {
+        memset(&unix_addr, 0, sizeof(unix_addr));
+        unix_addr.sun_family = AF_UNIX;
+        snprintf(unix_addr.sun_path, sizeof unix_addr.sun_path, "%s", spec + 5);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            perror("Couldn't create socket");
+            exit(EXIT_FAILURE);
+        }
+        if (listening) {
+            unlink(unix_addr.sun_path);
+            if (bind(fd, (struct sockaddr*) &unix_addr, sizeof(unix_addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+                fprintf(stderr, "Couldn't listen on %s: %s\n", spec, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            return fd;
+        }
+        for (int retry = 0; connect(fd, (struct sockaddr*) &unix_addr, sizeof(unix_addr)) < 0; retry++) {
+            if ((errno != ENOENT && errno != ECONNREFUSED) || retry == CONNECT_RETRIES) {
+                fprintf(stderr, "Couldn't connect to %s: %s\n", spec, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            usleep(100000);
+        }
+        return fd;
+    }
+
+    if (strncmp(spec, "tcp:", 4) != 0 || (port = strrchr(spec + 4, ':')) == NULL) {
+        fprintf(stderr, "Invalid address %s, must be one of: tcp:<host>:<port> or unix:<path>.\n", spec);
+        exit(EXIT_FAILURE);
+    }
+    snprintf(host, sizeof host, "%.*s", (int) (port - spec - 4), spec + 4);
+    port++;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    for (int retry = 0; ; retry++) {
+        err = getaddrinfo(host[0] ? host : NULL, port, &hints, &addrs);
+        if (err != 0) {
+            fprintf(stderr, "Couldn't resolve %s: %s\n", spec, gai_strerror(err));
+            exit(EXIT_FAILURE);
+        }
+        for (addr = addrs; addr != NULL; addr = addr->ai_next) {
+            fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            if (listening) {
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                if (bind(fd, addr->ai_addr, addr->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) {
+                    break;
+                }
+            } else if (connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+                break;
+            }
+            err = errno;
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(addrs);
+        if (fd >= 0) {
+            return fd;
+        }
+        if (listening || err != ECONNREFUSED || retry == CONNECT_RETRIES) {
+            fprintf(stderr, "Couldn't %s %s: %s\n", listening ? "listen on" : "connect to", spec, strerror(err));
+            exit(EXIT_FAILURE);
+        }
+        usleep(100000);
+    }
+}
+
+/*
+ Adds one operation to the interval stats, growing them as needed
+
+ Params:
+  - stats, count: interval stats and their number (updated)
+  - index: interval of the operation
+  - ops, latency_sum, latency_max: stats to add
+
+ Returns: none
+*/
+void add_interval(interval_stats **stats, long *count, long index, uint64_t ops, uint64_t latency_sum, uint64_t latency_max) {
+    if (index >= *count) {
+        long new_count = index + 1 > *count * 2 ? index + 1 : *count * 2;
+        *stats = (interval_stats*) realloc(*stats, new_count * sizeof(interval_stats));
+        memset(*stats + *count, 0, (new_count - *count) * sizeof(interval_stats));
+        *count = new_count;
+    }
+    (*stats)[index].ops += ops;
+    (*stats)[index].latency_sum += latency_sum;
+    if (latency_max > (*stats)[index].latency_max) {
+        (*stats)[index].latency_max = latency_max;
+    }
+}
+
+// what an agent gathered from the workload output so far
+typedef struct agent_results {
+    hist *hists;
+    interval_stats *pending;    // interval stats not sent yet
+    long num_pending;
+    uint64_t base;              // CLOCK_MONOTONIC at the start time
+    uint64_t first_begin;
+    uint64_t last_end;
+    int live;                   // the workload prints live lines, the intervals come from them only
+} agent_results;
+
+/*
+ Takes the metrics of one workload output line, or forwards the line
+
+ Params:
+  - res: results of the agent
+  - line: output line
+  - to_coord: stream to the coordinator
+
+ Returns: none
+*/
+static void agent_line(agent_results *res, const char *line, FILE *to_coord) {
+    const int *columns = metrics_spec.columns;
+    double numbers[MAX_FIELDS];
+    int live = strncmp(line, "live,", 5) == 0;
+    char *copy = strdup(live ? line + 5 : line);
+    int count = parse_numbers(copy, numbers, MAX_FIELDS), used = 0;
+
+    free(copy);
+    if (live && count == 4) {
+        // live,<now_ns>,<ops>,<latency_sum>,<latency_max>, for the interval that ended at now_ns
+        uint64_t now = (uint64_t) numbers[0];
+
+        res->live = 1;
+        if (interval_ns > 0 && numbers[1] > 0) {
+            add_interval(&res->pending, &res->num_pending, now > res->base ? (now - res->base - 1) / interval_ns : 0,
+                    (uint64_t) numbers[1], (uint64_t) numbers[2], (uint64_t) numbers[3]);
+        }
+        return;
+    }
+    if (live) {
+        count = 0;
+    }
+    if (count > 0 && metrics_spec.source == METRIC_LATENCY) {
+        for (int col = 0; col < metrics_spec.num_columns; col++) {
+            if (count > columns[col]) {
+                hist_add(&res->hists[col], (uint64_t) numbers[columns[col]]);
+                used = 1;
+            }
+        }
+    } else if (count > columns[0] && count > columns[1] && numbers[columns[1]] >= numbers[columns[0]]) {
+        uint64_t begin = (uint64_t) numbers[columns[0]], end = (uint64_t) numbers[columns[1]];
+
+        hist_add(&res->hists[0], end - begin);
+        if (begin < res->first_begin) {
+            res->first_begin = begin;
+        }
+        if (end > res->last_end) {
+            res->last_end = end;
+        }
+        if (interval_ns > 0 && end >= res->base && !res->live) {
+            add_interval(&res->pending, &res->num_pending, (end - res->base) / interval_ns, 1, end - begin, end - begin);
+        }
+        used = 1;
+    }
+    if (!used) {
+        fprintf(to_coord, "out %s\n", line);
+    }
+}
+
+/*
+ Sends the pending stats of every interval that closed, or of all of them
+
+ Params:
+  - res: results of the agent
+  - now: CLOCK_MONOTONIC time
+  - all: 1 to send every interval, e.g. once the workload is done
+  - to_coord: stream to the coordinator
+
+ Returns: none
+*/
+static void agent_send_intervals(agent_results *res, uint64_t now, int all, FILE *to_coord) {
+    for (long i = 0; i < res->num_pending; i++) {
+        interval_stats *st = &res->pending[i];
+
+        if (st->ops == 0 || (!all && res->base + (i + 1) * interval_ns > now)) {
+            continue;
+        }
+        fprintf(to_coord, "interval %ld %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", i, st->ops, st->latency_sum, st->latency_max);
+        memset(st, 0, sizeof(*st));
+    }
+    fflush(to_coord);
+}
+
+/*
+ Runs the workload on behalf of the coordinator and streams its results back
+
+ Params:
+  - spec: address of the coordinator
+
+ Errors: It fails and exits the program if the coordinator can't be reached
+         or sends an invalid job
+ Returns: none
+*/
+void run_agent(const char *spec) {
+    char *argv[MAX_ARGS + 1], *line = NULL, host[64];
+    char metrics[64], id_str[16];
+    static char buf[MAX_LINE];
+    size_t line_size = 0, have = 0;
+    int id, interval_ms, num_args, out_fd, status;
+    uint64_t start_ns, end;
+    int64_t start_skew_ns;
+    agent_results res;
+    struct timespec start;
+    struct pollfd pfd;
+    FILE *to_coord, *from_coord;
+    pid_t pid;
+
+    int fd = open_socket(spec, 0);
+    to_coord = fdopen(fd, "w");
+    from_coord = fdopen(dup(fd), "r");
+
+    gethostname(host, sizeof host);
+    host[sizeof host - 1] = '\0';
+    fprintf(to_coord, "hello %s\n", host);
+    fflush(to_coord);
+
+    if (getline(&line, &line_size, from_coord) < 0 ||
+            sscanf(line, "job %d %" SCNu64 " %d %63s %d", &id, &start_ns, &interval_ms, metrics, &num_args) != 5 ||
+            num_args < 1 || num_args > MAX_ARGS) {
+        fprintf(stderr, "Invalid job from %s\n", spec);
+        exit(EXIT_FAILURE);
+    }
+    parse_metrics(metrics);
+    interval_ns = (uint64_t) interval_ms * 1000000ULL;
+    snprintf(id_str, sizeof id_str, "%d", id);
+    for (int i = 0; i < num_args; i++) {
+        if (getline(&line, &line_size, from_coord) < 0 || strncmp(line, "arg ", 4) != 0) {
+            fprintf(stderr, "Invalid job argument from %s\n", spec);
+            exit(EXIT_FAILURE);
+        }
+        line[strcspn(line, "\n")] = '\0';
+        // %a becomes the agent id
+        char *arg = (char*) malloc(strlen(line) * 8 + 1), *dst = arg;
+        for (char *src = line + 4; *src; src++) {
+            if (src[0] == '%' && src[1] == 'a') {
+                dst += sprintf(dst, "%s", id_str);
+                src++;
+            } else {
+                *dst++ = *src;
+            }
+        }
+        *dst = '\0';
+        argv[i] = arg;
+    }
+    argv[num_args] = NULL;
+    free(line);
+
+    start.tv_sec = start_ns / NSEC;
+    start.tv_nsec = start_ns % NSEC;
+    while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &start, NULL) == EINTR);
+    start_skew_ns = (int64_t) (stamp(CLOCK_REALTIME) - start_ns);
+
+    memset(&res, 0, sizeof(res));
+    res.base = stamp(CLOCK_MONOTONIC);
+    res.first_begin = UINT64_MAX;
+    res.hists = (hist*) calloc(metrics_spec.num_columns, sizeof(hist));
+    for (int col = 0; col < metrics_spec.num_columns; col++) {
+        hist_init(&res.hists[col]);
+    }
+
+    pid = workload_spawn(argv, &out_fd);
+
+    // the output is polled rather than read line by line, so that intervals
+    // are sent as they close even while the workload prints nothing
+    pfd.fd = out_fd;
+    pfd.events = POLLIN;
+    while (1) {
+        uint64_t now = stamp(CLOCK_MONOTONIC);
+        int timeout = -1;
+        ssize_t n;
+
+        if (interval_ns > 0) {
+            agent_send_intervals(&res, now, 0, to_coord);
+            timeout = (int) ((interval_ns - (now - res.base) % interval_ns) / 1000000ULL) + 1;
+        }
+        if (poll(&pfd, 1, timeout) <= 0) {
+            continue;
+        }
+        n = read(out_fd, buf + have, sizeof buf - 1 - have);
+        if (n <= 0) {
+            break;
+        }
+        have += n;
+
+        char *begin = buf, *newline;
+        while ((newline = memchr(begin, '\n', buf + have - begin)) != NULL) {
+            *newline = '\0';
+            agent_line(&res, begin, to_coord);
+            begin = newline + 1;
+        }
+        have -= begin - buf;
+        memmove(buf, begin, have);
+        // a line longer than the buffer is taken in pieces
+        if (have == sizeof buf - 1) {
+            buf[have] = '\0';
+            agent_line(&res, buf, to_coord);
+            have = 0;
+        }
+        fflush(to_coord);
+    }
+    if (have > 0) {
+        buf[have] = '\0';
+        agent_line(&res, buf, to_coord);
+    }
+    close(out_fd);
+
+    status = workload_wait(pid);
+    end = stamp(CLOCK_MONOTONIC);
+
+    agent_send_intervals(&res, end, 1, to_coord);
+    for (int col = 0; col < metrics_spec.num_columns; col++) {
+        fprintf(to_coord, "hist %d %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", col,
+                res.hists[col].count, res.hists[col].sum, res.hists[col].min, res.hists[col].max);
+        for (int i = 0; i < HIST_BUCKETS; i++) {
+            if (res.hists[col].buckets[i]) {
+                fprintf(to_coord, "bucket %d %d %" PRIu64 "\n", col, i, res.hists[col].buckets[i]);
+            }
+        }
+    }
+    if (res.last_end > 0) {
+        fprintf(to_coord, "span %" PRId64 " %" PRId64 "\n", (int64_t) (res.first_begin - res.base),
+                (int64_t) (res.last_end - res.base));
+    }
+    fprintf(to_coord, "done %d %" PRIu64 " %" PRId64 "\n", status, end - res.base, start_skew_ns);
+    fclose(to_coord);
+    fclose(from_coord);
+}
+
+/*
+ Reads the results of one agent until it is done. Forwarded output and
+ intervals are printed as they arrive:
+   agent-out,<id>,<line>
+   agent-interval,<id>,<start_ms>,<ops>,<mean_ns>,<max_ns>
+
+ Params:
+  - arg: the agent
+
+ Errors: It warns if the agent disconnects before being done
+ Returns: NULL
+*/
+static void *collect (void *arg) {
+    agent *a = (agent*) arg;
+    char *line = NULL;
+    size_t line_size = 0;
+    int col, index;
+    long interval;
+    uint64_t count, sum, min, max;
+
+    while (!a->done && getline(&line, &line_size, a->in) >= 0) {
+        if (strncmp(line, "out ", 4) == 0) {
+            pthread_mutex_lock(&merge_lock);
+            printf("agent-out,%d,%s", a->id, line + 4);
+            pthread_mutex_unlock(&merge_lock);
+        } else if (sscanf(line, "hist %d %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64, &col, &count, &sum, &min, &max) == 5
+                && col >= 0 && col < metrics_spec.num_columns) {
+            a->hists[col].count = count;
+            a->hists[col].sum = sum;
+            a->hists[col].min = min;
+            a->hists[col].max = max;
+        } else if (sscanf(line, "bucket %d %d %" SCNu64, &col, &index, &count) == 3
+                && col >= 0 && col < metrics_spec.num_columns && index >= 0 && index < HIST_BUCKETS) {
+            a->hists[col].buckets[index] = count;
+        } else if (sscanf(line, "interval %ld %" SCNu64 " %" SCNu64 " %" SCNu64, &interval, &count, &sum, &max) == 4
+                && interval >= 0) {
+            pthread_mutex_lock(&merge_lock);
+            add_interval(&intervals, &num_intervals, interval, count, sum, max);
+            printf("agent-interval,%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", a->id,
+                    (uint64_t) (interval * interval_ns / 1000000ULL), count, count ? sum / count : 0, max);
+            fflush(stdout);
+            pthread_mutex_unlock(&merge_lock);
+        } else if (sscanf(line, "span %" SCNd64 " %" SCNd64, &a->first_begin_ns, &a->last_end_ns) == 2) {
+            continue;
+        } else if (sscanf(line, "done %d %" SCNu64 " %" SCNd64, &a->exit_status, &a->wall_ns, &a->start_skew_ns) == 3) {
+            a->done = 1;
+        }
+    }
+    if (!a->done) {
+        fprintf(stderr, "Agent %d (%s) disconnected before reporting\n", a->id, a->host);
+    }
+    free(line);
+    return NULL;
+}
+
+/*
+ Prints the merged report:
+   agent,<id>,<host>,<exit_status>,<start_skew_ns>,<wall_ns>,<ops>
+   lat,<col>|span,<count>,<mean>,<p50>,<p90>,<p99>,<p99.9>,<max>
+   interval,<start_ms>,<ops>,<ops_s>,<mean_ns>,<max_ns>
+   total,<agents>,<failed_agents>,<ops>,<span_s>,<ops_s>,<max_abs_start_skew_ns>
+ The total throughput spans from the first begin to the last end of every
+ agent with span metrics, or the longest agent wall time otherwise.
+
+ Params:
+  - agents: every agent
+  - num_agents: number of agents
+
+ Returns: none
+*/
+void print_report(agent *agents, int num_agents) {
+    hist total;
+    uint64_t ops = 0, max_wall = 0, max_skew = 0;
+    int64_t first_begin = INT64_MAX, last_end = INT64_MIN;
+    int failed = 0;
+
+    for (int i = 0; i < num_agents; i++) {
+        agent *a = &agents[i];
+        uint64_t skew = a->start_skew_ns < 0 ? -a->start_skew_ns : a->start_skew_ns;
+
+        if (!a->done || a->exit_status != 0) {
+            failed++;
+        }
+        printf("agent,%d,%s,%d,%" PRId64 ",%" PRIu64 ",%" PRIu64 "\n", a->id, a->host,
+                a->done ? a->exit_status : -1, a->start_skew_ns, a->wall_ns, a->hists[0].count);
+        ops += a->hists[0].count;
+        max_wall = a->wall_ns > max_wall ? a->wall_ns : max_wall;
+        max_skew = skew > max_skew ? skew : max_skew;
+        if (a->last_end_ns > 0) {
+            first_begin = a->first_begin_ns < first_begin ? a->first_begin_ns : first_begin;
+            last_end = a->last_end_ns > last_end ? a->last_end_ns : last_end;
+        }
+    }
+
+    for (int col = 0; col < metrics_spec.num_columns; col++) {
+        hist_init(&total);
+        for (int i = 0; i < num_agents; i++) {
+            hist_merge(&total, &agents[i].hists[col]);
+        }
+        if (metrics_spec.source == METRIC_SPAN) {
+            printf("span,");
+        } else {
+            printf("lat,%d,", metrics_spec.columns[col]);
+        }
+        hist_print_csv(stdout, &total);
+        printf("\n");
+    }
+
+    // the array grows by doubling, drop the empty tail
+    while (num_intervals > 0 && intervals[num_intervals - 1].ops == 0) {
+        num_intervals--;
+    }
+    for (long i = 0; i < num_intervals; i++) {
+        interval_stats *s = &intervals[i];
+        printf("interval,%" PRIu64 ",%" PRIu64 ",%.1f,%" PRIu64 ",%" PRIu64 "\n", (uint64_t) (i * interval_ns / 1000000ULL),
+                s->ops, s->ops / (interval_ns / (double) NSEC), s->ops ? s->latency_sum / s->ops : 0, s->latency_max);
+    }
+
+    double span_s = (last_end > first_begin ? (uint64_t) (last_end - first_begin) : max_wall) / (double) NSEC;
+    printf("total,%d,%d,%" PRIu64 ",%.3f,%.1f,%" PRIu64 "\n", num_agents, failed, ops, span_s,
+            span_s > 0 ? ops / span_s : 0, max_skew);
+}
+
+/*
+ Waits for every agent, hands them the job and merges their results
+
+ Params:
+  - spec: address to listen on
+  - num_agents: number of agents to wait for
+  - start_delay_ms: time between the last agent connecting and the start
+  - interval_ms: interval stats length, 0 to disable
+  - metrics: metrics spec
+  - workload: argv of the workload, NULL terminated
+
+ Errors: It fails and exits the program if the socket can't be set up
+ Returns: The number of agents that failed or didn't report
+*/
+int run_coordinator(const char *spec, int num_agents, int start_delay_ms, int interval_ms, const char *metrics, char **workload) {
+    char *line = NULL;
+    size_t line_size = 0;
+    int num_args, failed = 0;
+    uint64_t start_ns;
+
+    parse_metrics(metrics);
+    interval_ns = (uint64_t) interval_ms * 1000000ULL;
+    for (num_args = 0; workload[num_args] != NULL; num_args++);
+
+    int listen_fd = open_socket(spec, 1);
+    agent *agents = (agent*) calloc(num_agents, sizeof(agent));
+    for (int i = 0; i < num_agents; i++) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            perror("Couldn't accept agent");
+            exit(EXIT_FAILURE);
+        }
+        agents[i].id = i;
+        agents[i].in = fdopen(fd, "r");
+        agents[i].out = fdopen(dup(fd), "w");
+        agents[i].hists = (hist*) calloc(metrics_spec.num_columns, sizeof(hist));
+        for (int col = 0; col < metrics_spec.num_columns; col++) {
+            hist_init(&agents[i].hists[col]);
+        }
+        if (getline(&line, &line_size, agents[i].in) < 0 || sscanf(line, "hello %63s", agents[i].host) != 1) {
+            fprintf(stderr, "Invalid hello from agent %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(stderr, "Agent %d connected from %s\n", i, agents[i].host);
+    }
+    free(line);
+    close(listen_fd);
+    if (strncmp(spec, "unix:", 5) == 0) {
+        unlink(spec + 5);
+    }
+
+    start_ns = stamp(CLOCK_REALTIME) + (uint64_t) start_delay_ms * 1000000ULL;
+    for (int i = 0; i < num_agents; i++) {
+        fprintf(agents[i].out, "job %d %" PRIu64 " %d %s %d\n", i, start_ns, interval_ms, metrics, num_args);
+        for (int arg = 0; arg < num_args; arg++) {
+            fprintf(agents[i].out, "arg %s\n", workload[arg]);
+        }
+        fflush(agents[i].out);
+    }
+
+    pthread_t *collectors = (pthread_t*) malloc(num_agents * sizeof(pthread_t));
+    for (int i = 0; i < num_agents; i++) {
+        pthread_create(&collectors[i], NULL, collect, (void *) &agents[i]);
+    }
+    for (int i = 0; i < num_agents; i++) {
+        pthread_join(collectors[i], NULL);
+        fclose(agents[i].in);
+        fclose(agents[i].out);
+    }
+
+    print_report(agents, num_agents);
+    for (int i = 0; i < num_agents; i++) {
+        if (!agents[i].done || agents[i].exit_status != 0) {
+            failed++;
+        }
+    }
+    return failed;
+}
+
+// To run, type: ./coord serve tcp:<host>:<port>|unix:<path> <num_agents> <start_delay_ms> <interval_ms>
+//                       lat:<col>[,<col>...]|span:<begin>:<end> -- <workload> [args...]
+//          or:  ./coord agent tcp:<host>:<port>|unix:<path>
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "agent") == 0) {
+        run_agent(argv[2]);
+        return EXIT_SUCCESS;
+    }
+
+    if (argc < 9 || strcmp(argv[1], "serve") != 0 || strcmp(argv[7], "--") != 0) {
+        fprintf(stderr, "Usage: ./coord serve tcp:<host>:<port>|unix:<path> <num_agents> <start_delay_ms> <interval_ms> "
+                "lat:<col>[,<col>...]|span:<begin>:<end> -- <workload> [args...]\n"
+                "       ./coord agent tcp:<host>:<port>|unix:<path>\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int num_agents = atoi(argv[3]);
+    int start_delay_ms = atoi(argv[4]);
+    int interval_ms = atoi(argv[5]);
+
+    if (num_agents < 1 || argc - 8 > MAX_ARGS) {
+        fprintf(stderr, "Need at least one agent and at most %d workload arguments.\n", MAX_ARGS);
+        exit(EXIT_FAILURE);
+    }
+
+    return run_coordinator(argv[2], num_agents, start_delay_ms, interval_ms, argv[6], &argv[8]) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,372 @@
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE // copy_file_range, splice
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h> //getrusage
+#include <linux/fs.h> //FICLONE, FICLONERANGE
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <stdint.h> //uint64_t
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "workers.h"
+
+#define ACCESS_PERMISSION 0777
+#define NSEC 1000000000ULL
+#define MAX_BLKSIZES 32
+
+enum copy_methods {
+    READ_WRITE,
+    COPY_FILE_RANGE,
+    SENDFILE,
+    SPLICE,
+    CLONE,
+    CLONE_RANGE,
+    NUM_METHODS
+};
+
+static const char *method_names[NUM_METHODS] = {
+    "rw", "copy_file_range", "sendfile", "splice", "ficlone", "ficlonerange"
+};
+
+typedef struct thread_load {
+    int thread_id;
+    char src_path[256];
+    char dst_path[256];
+    long file_size;
+    int method;
+    long blksize;
+    char *buf;
+    int pipe_fds[2];
+    uint64_t bytes;
+    uint64_t begin;
+    uint64_t end;
+    int error;
+} thread_load;
+
+pthread_barrier_t *start_barrier;
+int sync_dst;
+int cold_src;
+// pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
+       fprintf (stderr, "Error getting timestamp: %s\n", strerror(errno));
+       exit (EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+/*
+ Copies with user-space read() and write() calls of blksize bytes
+
+ Returns: 0 on success, the errno otherwise
+*/
+static int copy_read_write (thread_load *load, int src, int dst) {
+    ssize_t nread, nwritten, done;
+
+    while ((nread = read (src, load->buf, load->blksize)) > 0) {
+        for (done = 0; done < nread; done += nwritten) {
+            nwritten = write (dst, load->buf + done, nread - done);
+            if (nwritten < 0) {
+                return errno;
+            }
+        }
+        load->bytes += nread;
+    }
+    return nread < 0 ? errno : 0;
+}
+
+static int copy_range (thread_load *load, int src, int dst) {
+    ssize_t ret;
+
+    while ((ret = copy_file_range (src, NULL, dst, NULL, load->blksize, 0)) > 0) {
+        load->bytes += ret;
+    }
+    return ret < 0 ? errno : 0;
+}
+
+static int copy_sendfile (thread_load *load, int src, int dst) {
+    ssize_t ret;
+
+    while ((ret = sendfile (dst, src, NULL, load->blksize)) > 0) {
+        load->bytes += ret;
+    }
+    return ret < 0 ? errno : 0;
+}
+
+/*
+ Copies by splicing from the source into a pipe and from the pipe into the
+ destination, so that data never goes through user space
+
+ Returns: 0 on success, the errno otherwise
+*/
+static int copy_splice (thread_load *load, int src, int dst) {
+    ssize_t in, out;
+
+    while ((in = splice (src, NULL, load->pipe_fds[1], NULL, load->blksize, SPLICE_F_MOVE)) > 0) {
+        while (in > 0) {
+            out = splice (load->pipe_fds[0], NULL, dst, NULL, in, SPLICE_F_MOVE);
+            if (out <= 0) {
+                return out < 0 ? errno : EIO;
+            }
+            in -= out;
+            load->bytes += out;
+        }
+    }
+    return in < 0 ? errno : 0;
+}
+
+static int copy_clone (thread_load *load, int src, int dst) {
+    if (ioctl (dst, FICLONE, src) < 0) {
+        return errno;
+    }
+    load->bytes = load->file_size;
+    return 0;
+}
+
+/*
+ Reflinks the file in ranges of blksize bytes (the last range is cloned up to
+ EOF, as FICLONERANGE requires block-aligned lengths otherwise)
+
+ Returns: 0 on success, the errno otherwise
+*/
+static int copy_clone_range (thread_load *load, int src, int dst) {
+    struct file_clone_range range;
+    long offset;
+
+    for (offset = 0; offset < load->file_size; offset += load->blksize) {
+        range.src_fd = src;
+        range.src_offset = offset;
+        range.src_length = (offset + load->blksize >= load->file_size) ? 0 : (uint64_t) load->blksize;
+        range.dest_offset = offset;
+        if (ioctl (dst, FICLONERANGE, &range) < 0) {
+            return errno;
+        }
+    }
+    load->bytes = load->file_size;
+    return 0;
+}
+
+static void *request (void *arg) {
+
+    thread_load* load = arg;
+    int src, dst;
+
+    load->bytes = 0;
+    load->error = 0;
+
+    src = open (load->src_path, O_RDONLY | O_LARGEFILE);
+    dst = open (load->dst_path, O_WRONLY | O_CREAT | O_TRUNC | O_LARGEFILE, ACCESS_PERMISSION);
+    if (src < 0 || dst < 0) {
+        fprintf (stderr, "Error opening %s or %s: %s\n", load->src_path, load->dst_path, strerror (errno));
+        exit (EXIT_FAILURE);
+    }
+    if (cold_src) {
+        posix_fadvise (src, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    pthread_barrier_wait (start_barrier);
+
+    load->begin = stamp ();
+    switch (load->method) {
+    case READ_WRITE:
+        load->error = copy_read_write (load, src, dst);
+        break;
+    case COPY_FILE_RANGE:
+        load->error = copy_range (load, src, dst);
+        break;
+    case SENDFILE:
+        load->error = copy_sendfile (load, src, dst);
+        break;
+    case SPLICE:
+        load->error = copy_splice (load, src, dst);
+        break;
+    case CLONE:
+        load->error = copy_clone (load, src, dst);
+        break;
+    case CLONE_RANGE:
+        load->error = copy_clone_range (load, src, dst);
+        break;
+    }
+    if (sync_dst && load->error == 0 && fsync (dst) < 0) {
+        load->error = errno;
+    }
+    load->end = stamp ();
+
+    close (src);
+    close (dst);
+
+    return NULL;
+}
+
+// CPU time of this process and of the worker processes reaped so far
+static uint64_t cpu_time_ns (void) {
+    struct rusage usage;
+    uint64_t ns = 0;
+    int who[2] = { RUSAGE_SELF, RUSAGE_CHILDREN };
+
+    for (int i = 0; i < 2; i++) {
+        getrusage (who[i], &usage);
+        ns += (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * NSEC +
+            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ULL;
+    }
+    return ns;
+}
+
+/*
+ Copies every per-thread file with one method and prints
+ method,blksize,bytes,wall_ns,GB/s,cpu_s_per_GB
+ or method,blksize,unsupported,<error> when the filesystem refuses the method
+*/
+static void run_method (thread_load *load, int num_threads, int method, long blksize) {
+
+    int i, error = 0;
+    uint64_t bytes = 0, first_begin = UINT64_MAX, last_end = 0, cpu_begin, cpu_ns;
+    for (i = 0; i < num_threads; i++) {
+        load[i].method = method;
+        load[i].blksize = blksize;
+    }
+
+    cpu_begin = cpu_time_ns ();
+    workers_start (&pool, request, load, sizeof (thread_load));
+    workers_join (&pool);
+    cpu_ns = cpu_time_ns () - cpu_begin;
+
+    for (i = 0; i < num_threads; i++) {
+        if (load[i].error != 0) {
+            error = load[i].error;
+        }
+        bytes += load[i].bytes;
+        if (load[i].begin < first_begin) {
+            first_begin = load[i].begin;
+        }
+        if (load[i].end > last_end) {
+            last_end = load[i].end;
+        }
+    }
+
+    if (error != 0) {
+        printf ("%s,%ld,unsupported,%s\n", method_names[method], blksize, strerror (error));
+    } else {
+        double gb = bytes / 1e9;
+        printf ("%s,%ld,%" PRIu64 ",%" PRIu64 ",%.3f,%.3f\n", method_names[method], blksize, bytes,
+                last_end - first_begin, gb / ((last_end - first_begin) / (double) NSEC),
+                gb > 0 ? (cpu_ns / (double) NSEC) / gb : 0);
+    }
+    fflush (stdout);
+}
+
+// To run, type: ./copy <num_threads> <src_path> <dst_path> <method>|all <blksize>[,<blksize>...] fsync|no-fsync cold|warm [threads|procs]
+int main (int argc, char* argv[]) {
+
+    int i, method, num_blksizes = 0;
+    long blksizes[MAX_BLKSIZES], max_blksize = 0;
+    struct stat st;
+    char *token;
+
+    if (argc < 8) {
+        fprintf (stderr, "Usage: ./copy <num_threads> <src_path> <dst_path> rw|copy_file_range|sendfile|splice|"
+                "ficlone|ficlonerange|all <blksize>[,<blksize>...] fsync|no-fsync cold|warm [threads|procs]\n");
+        exit (EXIT_FAILURE);
+    }
+
+    int num_threads = atoi (argv[1]);
+    char* src_path = argv[2];
+    char* dst_path = argv[3];
+
+    for (method = 0; method < NUM_METHODS && strcmp (argv[4], method_names[method]) != 0; method++);
+    if (method == NUM_METHODS && strcmp (argv[4], "all") != 0) {
+        fprintf (stderr, "Unknown copy method %s\n", argv[4]);
+        exit (EXIT_FAILURE);
+    }
+
+    for (token = strtok (argv[5], ","); token != NULL && num_blksizes < MAX_BLKSIZES; token = strtok (NULL, ",")) {
+        blksizes[num_blksizes] = atol (token);
+        if (blksizes[num_blksizes] <= 0) {
+            fprintf (stderr, "Invalid blksize %s\n", token);
+            exit (EXIT_FAILURE);
+        }
+        if (blksizes[num_blksizes] > max_blksize) {
+            max_blksize = blksizes[num_blksizes];
+        }
+        num_blksizes++;
+    }
+
+    if (strcmp (argv[6], "fsync") == 0) {
+        sync_dst = 1;
+    } else if (strcmp (argv[6], "no-fsync") == 0) {
+        sync_dst = 0;
+    } else {
+        fprintf (stderr, "Missing fsync or no-fsync flag\n");
+        exit (EXIT_FAILURE);
+    }
+
+    if (strcmp (argv[7], "cold") == 0) {
+        cold_src = 1;
+    } else if (strcmp (argv[7], "warm") == 0) {
+        cold_src = 0;
+    } else {
+        fprintf (stderr, "Missing cold or warm flag\n");
+        exit (EXIT_FAILURE);
+    }
+
+    for (i = 8; i < argc; i++) {
+        if (!workers_parse_option (&pool, argv[i])) {
+            fprintf (stderr, "Invalid option %s, must be one of: threads or procs\n", argv[i]);
+            exit (EXIT_FAILURE);
+        }
+    }
+
+    workers_init (&pool, num_threads);
+    start_barrier = (pthread_barrier_t*) workers_calloc (&pool, 1, sizeof (pthread_barrier_t));
+    workers_barrier_init (&pool, start_barrier, num_threads);
+
+    thread_load* load = (thread_load*) workers_calloc (&pool, num_threads, sizeof (thread_load));
+    for (i = 0; i < num_threads; i++) {
+
+	snprintf (load[i].src_path, sizeof load[i].src_path, "%s%d", src_path, i);
+	snprintf (load[i].dst_path, sizeof load[i].dst_path, "%s%d", dst_path, i);
+	if (stat (load[i].src_path, &st) < 0) {
+  	    fprintf (stderr, "Error opening file %s: %s\n", load[i].src_path, strerror (errno));
+	    exit (EXIT_FAILURE);
+	}
+
+	load[i].thread_id = i;
+	load[i].file_size = st.st_size;
+	load[i].buf = (char*) aligned_alloc (4096, ((max_blksize + 4095) / 4096) * 4096);
+	if (pipe (load[i].pipe_fds) < 0) {
+  	    fprintf (stderr, "Error creating pipe: %s\n", strerror (errno));
+	    exit (EXIT_FAILURE);
+	}
+	// a pipe as large as the splice length, when the system allows it
+	fcntl (load[i].pipe_fds[1], F_SETPIPE_SZ, (int) max_blksize);
+    }
+
+    for (i = 0; i < NUM_METHODS; i++) {
+        if (method != NUM_METHODS && method != i) {
+            continue;
+        }
+        for (int b = 0; b < num_blksizes; b++) {
+            run_method (load, num_threads, i, blksizes[b]);
+            // FICLONE always clones the whole file, blksize doesn't matter
+            if (i == CLONE) {
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,920 @@
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <stdint.h> //uint64_t
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "hist.h"
+#include "workers.h"
+#include "report.h"
+#include "blockio.h"
+#include "streams.h"
+#include "iostats.h"
+
+#define ACCESS_PERMISSION 0777
+#define MAX_GROUPS 32
+#define CPU_OP_ITERATIONS 1000
+#define MAX_INTERVALS 3600
+
+/*
+ Runs several workload groups at the same time, as described by a job file,
+ and reports every group on its own. A job file is made of sections; the
+ [global] one sets the run, every other one is a group named after it:
+
+   [global]
+   runtime=30              # seconds, 0 to stop every group on its ops= instead
+   workers=threads         # or procs, for every group
+   report=run.json         # JSON report of the run (- for stdout), see write_report()
+   interval=1000           # ms per interval of the report series, 1000 by default
+   iostat=1000             # kernel and device accounting of the run, as rr's iostat[=<ms>]
+   slow=500                # slow log of the block groups, as rr's slow=<us>, slowtop=<K>, slowcap=<N>
+
+   [oltp]
+   kind=randread           # randread|randwrite|seqread|seqwrite|metadata|stat|cpu
+   path=/mnt/test/data     # file, directory (metadata) or stat tree root (stat)
+   size=4g                 # bytes of the file used, the file size by default for reads
+   bs=8k
+   threads=8
+   rate=20000              # requests/s of the whole group, 0 (default) for as fast as it can
+   ops=0                   # requests per thread, 0 (default) for no limit
+   perm                    # rand (default), perm or perm-slice offsets, as in rr and rw
+   seed=42                 # of the offsets and the written content, random by default
+   bufs=16                 # and any other option of rr, rw, seqr and seqw (see below)
+
+   [log]
+   kind=seqwrite
+   path=/mnt/test/log
+   size=1g
+   bs=64k
+   threads=1
+   fsync=16                # fsync() every 16 writes (writes only)
+   delay=100               # us of think time before every request when not paced
+   streams=4               # stream options of seqr and seqw (but randstart and ra_kb)
+   pattern=random          # pattern options of rw and seqw (writes only)
+
+   [meta]
+   kind=metadata           # create, stat and unlink of one file per request
+   path=/mnt/test/meta
+   threads=2
+
+ stat groups stat() random files of a <path>/<dir>/<file> tree of dirs= x files=
+ (the tree of ./stat, created if missing); cpu groups burn CPU as background does.
+ Sizes take k, m and g suffixes. Sequential groups give every thread its own
+ slice of the file and wrap around at its end. Paced groups issue requests on
+ a fixed schedule, latency is measured from the scheduled start once they fall behind.
+
+ The block groups issue their requests with the code of rr, rw, seqr and seqw
+ (blockio.c), so they take the same options, one per line: perf, verify,
+ gen=<n> (1 by default for writes), the buffer options, the vectored I/O
+ options, and the offset, stream or pattern options of their kind. Their
+ summary lines are printed with the group name in place of read or write.
+*/
+
+enum kinds {
+    RANDREAD,
+    RANDWRITE,
+    SEQREAD,
+    SEQWRITE,
+    METADATA,
+    STAT_TREE,
+    CPU,
+    NUM_KINDS
+};
+
+static const char *kind_names[NUM_KINDS] = { "randread", "randwrite", "seqread", "seqwrite", "metadata", "stat", "cpu" };
+
+enum ops {
+    OP_READ,
+    OP_WRITE,
+    OP_SYNC,
+    OP_CREATE,
+    OP_STAT,
+    OP_UNLINK,
+    OP_CPU,
+    NUM_OPS
+};
+
+static const char *op_names[NUM_OPS] = { "read", "write", "fsync", "create", "stat", "unlink", "cpu" };
+
+typedef struct group {
+    char name[64];
+    int kind;
+    char path[256];
+    uint64_t size;
+    size_t bs;
+    int threads;
+    double rate;
+    uint64_t ops;
+    int dirs;
+    int files;
+    int fsync_every;
+    uint64_t delay_us;
+    int offset_mode;    // random groups
+    uint64_t seed;
+    stream_spec layout; // sequential groups
+    int pass;           // requests of a thread over its slice, sequential groups
+    blockio_spec io;    // block groups
+    char options[256];  // the options of rr, rw, seqr and seqw, as given
+    int fd;
+    int index;
+    int first_thread;
+} group;
+
+// what the threads of a group completed within one interval of the run
+typedef struct interval {
+    uint64_t requests;
+    uint64_t ops[NUM_OPS];
+    uint64_t latency_ns[NUM_OPS];
+} interval;
+
+typedef struct thread_load {
+    int thread_id;
+    int index;          // within the group
+    group *grp;
+    unsigned int seed;
+    offsets where;      // random groups
+    long start;         // of the slice of the thread, sequential groups
+    blockio io;         // block groups
+    uint64_t requests;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t last_end;
+    hist latencies[NUM_OPS];
+} thread_load;
+
+group groups[MAX_GROUPS];
+int num_groups;
+uint64_t runtime_ns;
+char report_path[256];
+uint64_t interval_ns;
+// <num_intervals> intervals of each group, shared between the workers; NULL without a report
+int num_intervals;
+interval *intervals;
+pthread_barrier_t *start_barrier;
+uint64_t *start_ns;
+// pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+// kernel and device accounting of the run, -1 when disabled
+int iostat_interval_ms = -1;
+// slow requests of every group with the context switches and faults of their thread, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+// verification results of every thread, for the groups in verify mode
+verify_stats *verified;
+
+// parses <n>[k|m|g], exits on junk
+static uint64_t parse_size(const char *value, const char *where) {
+    char *end;
+    uint64_t n = strtoull(value, &end, 10);
+
+    switch (tolower((unsigned char) *end)) {
+    case 'k': n <<= 10; end++; break;
+    case 'm': n <<= 20; end++; break;
+    case 'g': n <<= 30; end++; break;
+    }
+    if (end == value || *end != '\0') {
+        fprintf(stderr, "%s: invalid size %s\n", where, value);
+        exit(EXIT_FAILURE);
+    }
+    return n;
+}
+
+static char *trim(char *s) {
+    char *end;
+
+    while (isspace((unsigned char) *s)) {
+        s++;
+    }
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char) end[-1])) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+// whether a group issues block requests, through blockio.c
+static int is_block(const group *grp) {
+    return grp->kind == RANDREAD || grp->kind == RANDWRITE || grp->kind == SEQREAD || grp->kind == SEQWRITE;
+}
+
+// one option of rr, rw, seqr or seqw: iostat or a slow log option in [global], a request option in a group
+static void parse_option(group *grp, const char *option, const char *where) {
+    size_t used;
+
+    if (grp == NULL) {
+        if (strcmp(option, "iostat") == 0) {
+            iostat_interval_ms = 0;
+        } else if (strncmp(option, "iostat=", 7) == 0) {
+            iostat_interval_ms = atoi(option + 7);
+        } else if (!slowlog_parse_option(&slow_spec, option)) {
+            fprintf(stderr, "%s: unknown global key %s\n", where, option);
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+    if (!offsets_parse_mode(&grp->offset_mode, option) && !stream_parse_option(&grp->layout, option) &&
+            !blockio_parse_option(&grp->io, option, 1)) {
+        fprintf(stderr, "%s: unknown group key %s\n", where, option);
+        exit(EXIT_FAILURE);
+    }
+    used = strlen(grp->options);
+    snprintf(grp->options + used, sizeof grp->options - used, "%s%s", used ? " " : "", option);
+}
+
+/*
+ Reads the job file into the global settings and the groups. Lines without
+ a value are the flags of rr, rw, seqr and seqw (perf, verify, perm...)
+
+ Params:
+  - path: job file
+
+ Errors: It fails and exits the program if the file can't be read or a line is invalid
+ Returns: none
+*/
+void parse_job_file(const char *path) {
+    char line[512], where[320], option[512], *key, *value, *eq;
+    group *grp = NULL;
+    int lineno = 0, global = 0;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        fprintf(stderr, "Couldn't open job file %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof line, f) != NULL) {
+        lineno++;
+        snprintf(where, sizeof where, "%s:%d", path, lineno);
+        line[strcspn(line, "#;\n")] = '\0';
+        key = trim(line);
+        if (*key == '\0') {
+            continue;
+        }
+        if (*key == '[') {
+            char *close = strchr(key, ']');
+            if (close == NULL || close[1] != '\0') {
+                fprintf(stderr, "%s: invalid section %s\n", where, key);
+                exit(EXIT_FAILURE);
+            }
+            *close = '\0';
+            global = strcmp(key + 1, "global") == 0;
+            if (global) {
+                grp = NULL;
+                continue;
+            }
+            if (num_groups == MAX_GROUPS) {
+                fprintf(stderr, "%s: more than %d groups\n", where, MAX_GROUPS);
+                exit(EXIT_FAILURE);
+            }
+            grp = &groups[num_groups++];
+            memset(grp, 0, sizeof(*grp));
+            snprintf(grp->name, sizeof grp->name, "%s", key + 1);
+            grp->kind = -1;
+            grp->threads = 1;
+            grp->bs = 4096;
+            grp->dirs = 1;
+            grp->files = 1000;
+            grp->fd = -1;
+            grp->index = num_groups - 1;
+            grp->offset_mode = RANDOM_OFFSETS;
+            stream_spec_init(&grp->layout);
+            blockio_spec_init(&grp->io, 0);
+            continue;
+        }
+        if (!global && grp == NULL) {
+            fprintf(stderr, "%s: expected key=value inside a section\n", where);
+            exit(EXIT_FAILURE);
+        }
+        if ((eq = strchr(key, '=')) == NULL) {
+            parse_option(grp, key, where);
+            continue;
+        }
+        *eq = '\0';
+        value = trim(eq + 1);
+        key = trim(key);
+        snprintf(option, sizeof option, "%s=%s", key, value);
+
+        if (global) {
+            if (strcmp(key, "runtime") == 0) {
+                runtime_ns = (uint64_t) (atof(value) * NSEC);
+            } else if (strcmp(key, "report") == 0) {
+                snprintf(report_path, sizeof report_path, "%s", value);
+            } else if (strcmp(key, "interval") == 0) {
+                interval_ns = (uint64_t) (atof(value) * 1e6);
+                if (interval_ns == 0) {
+                    fprintf(stderr, "%s: interval must be a positive number of ms\n", where);
+                    exit(EXIT_FAILURE);
+                }
+            } else if (strcmp(key, "workers") == 0) {
+                if (!workers_parse_option(&pool, value)) {
+                    fprintf(stderr, "%s: workers must be one of: threads or procs\n", where);
+                    exit(EXIT_FAILURE);
+                }
+            } else {
+                parse_option(NULL, option, where);
+            }
+        } else if (strcmp(key, "kind") == 0) {
+            for (grp->kind = 0; grp->kind < NUM_KINDS && strcmp(value, kind_names[grp->kind]) != 0; grp->kind++);
+            if (grp->kind == NUM_KINDS) {
+                fprintf(stderr, "%s: kind must be one of: randread, randwrite, seqread, seqwrite, metadata, stat or cpu\n", where);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(key, "path") == 0) {
+            snprintf(grp->path, sizeof grp->path, "%s", value);
+        } else if (strcmp(key, "size") == 0) {
+            grp->size = parse_size(value, where);
+        } else if (strcmp(key, "bs") == 0) {
+            grp->bs = (size_t) parse_size(value, where);
+        } else if (strcmp(key, "threads") == 0) {
+            grp->threads = atoi(value);
+        } else if (strcmp(key, "rate") == 0) {
+            grp->rate = atof(value);
+        } else if (strcmp(key, "ops") == 0) {
+            grp->ops = strtoull(value, NULL, 10);
+        } else if (strcmp(key, "dirs") == 0) {
+            grp->dirs = atoi(value);
+        } else if (strcmp(key, "files") == 0) {
+            grp->files = atoi(value);
+        } else if (strcmp(key, "fsync") == 0) {
+            grp->fsync_every = atoi(value);
+        } else if (strcmp(key, "delay") == 0) {
+            grp->delay_us = strtoull(value, NULL, 10);
+        } else if (strcmp(key, "seed") == 0) {
+            grp->seed = strtoull(value, NULL, 10);
+        } else {
+            parse_option(grp, option, where);
+        }
+    }
+    fclose(f);
+}
+
+// the options of rr, rw, seqr and seqw a group was given only apply to their kind
+static void check_options(group *grp) {
+    int writes = grp->kind == RANDWRITE || grp->kind == SEQWRITE;
+    int sequential = grp->kind == SEQREAD || grp->kind == SEQWRITE;
+    stream_spec no_layout;
+    pattern_spec no_pattern;
+    const char *wrong = NULL;
+
+    stream_spec_init(&no_layout);
+    pattern_spec_init(&no_pattern);
+    if (!is_block(grp) && (grp->options[0] != '\0' || grp->delay_us > 0)) {
+        wrong = "the options of rr, rw, seqr and seqw only apply to the block groups";
+    } else if (sequential && grp->offset_mode != RANDOM_OFFSETS) {
+        wrong = "rand, perm and perm-slice only apply to randread and randwrite groups";
+    } else if (!sequential && memcmp(&grp->layout, &no_layout, sizeof no_layout) != 0) {
+        wrong = "the stream options only apply to seqread and seqwrite groups";
+    } else if (grp->layout.randstart || grp->layout.read_ahead_kb >= 0) {
+        wrong = "randstart and ra_kb don't apply to groups, every thread walks its own slice";
+    } else if (grp->kind == SEQWRITE && grp->layout.readahead_kb > 0) {
+        wrong = "readahead only applies to seqread groups";
+    } else if (!writes && memcmp(&grp->io.pattern, &no_pattern, sizeof no_pattern) != 0) {
+        wrong = "the pattern options only apply to randwrite and seqwrite groups";
+    }
+    if (wrong != NULL) {
+        fprintf(stderr, "Group %s: %s\n", grp->name, wrong);
+        exit(EXIT_FAILURE);
+    }
+    // stamps cover whole VERIFY_BLOCKs, partial ones would be overwritten or never stamped
+    if (grp->io.verify && (grp->bs % VERIFY_BLOCK != 0 || grp->layout.stride % VERIFY_BLOCK != 0)) {
+        fprintf(stderr, "Group %s: verify needs a block size and stride multiple of %d bytes\n", grp->name, VERIFY_BLOCK);
+        exit(EXIT_FAILURE);
+    }
+    if (writes && grp->io.generation == 0) {
+        grp->io.generation = 1;
+    }
+}
+
+/*
+ Checks a group and prepares its target: opens (and for writes creates) the
+ file, creates the metadata directory or the stat tree. Sequential groups
+ get the requests of a thread over its slice of the file.
+
+ Params:
+  - grp: group
+
+ Errors: It fails and exits the program if the group is incomplete or its target unusable
+ Returns: none
+*/
+void setup_group(group *grp) {
+    struct stat st;
+    char pathbuf[512];
+
+    if (grp->kind < 0 || (grp->kind != CPU && grp->path[0] == '\0') || grp->threads < 1 || grp->bs == 0) {
+        fprintf(stderr, "Group %s needs a kind, a path (but cpu), a thread and a block size\n", grp->name);
+        exit(EXIT_FAILURE);
+    }
+    if (runtime_ns == 0 && grp->ops == 0) {
+        fprintf(stderr, "Group %s would never stop: set runtime in [global] or ops in the group\n", grp->name);
+        exit(EXIT_FAILURE);
+    }
+    check_options(grp);
+
+    switch (grp->kind) {
+    case RANDREAD:
+    case SEQREAD:
+    case RANDWRITE:
+    case SEQWRITE:
+        if (grp->kind == RANDREAD || grp->kind == SEQREAD) {
+            grp->fd = open(grp->path, O_RDONLY | O_LARGEFILE);
+        } else {
+            grp->fd = open(grp->path, O_RDWR | O_CREAT | O_LARGEFILE, ACCESS_PERMISSION);
+        }
+        if (grp->fd < 0 || fstat(grp->fd, &st) != 0) {
+            fprintf(stderr, "Group %s: couldn't open %s: %s\n", grp->name, grp->path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (grp->size == 0) {
+            grp->size = st.st_size;
+        }
+        if (grp->size / grp->bs < (uint64_t) grp->threads) {
+            fprintf(stderr, "Group %s: %s needs at least one %zu-byte block per thread (set size= for writes)\n",
+                    grp->name, grp->path, grp->bs);
+            exit(EXIT_FAILURE);
+        }
+        if (grp->kind == SEQREAD || grp->kind == SEQWRITE) {
+            // as many requests as the streams fit in the slice, each thread wraps around at its end
+            long slice = (long) (grp->size / grp->bs / grp->threads * grp->bs);
+            long stride = grp->layout.stride > (long) grp->bs ? grp->layout.stride : (long) grp->bs;
+
+            grp->pass = (int) (slice / (grp->layout.streams * stride)) * grp->layout.streams;
+            if (grp->pass == 0) {
+                fprintf(stderr, "Group %s: the %ld-byte slice of a thread is too small for %d streams of stride %ld\n",
+                        grp->name, slice, grp->layout.streams, stride);
+                exit(EXIT_FAILURE);
+            }
+            stream_advise(&grp->layout, grp->fd);
+        }
+        break;
+    case METADATA:
+        if (mkdir(grp->path, ACCESS_PERMISSION) != 0 && errno != EEXIST) {
+            fprintf(stderr, "Group %s: couldn't create %s: %s\n", grp->name, grp->path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        break;
+    case STAT_TREE:
+        if (mkdir(grp->path, ACCESS_PERMISSION) != 0 && errno != EEXIST) {
+            fprintf(stderr, "Group %s: couldn't create %s: %s\n", grp->name, grp->path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        for (int dir = 0; dir < grp->dirs; ++dir) {
+            snprintf(pathbuf, sizeof pathbuf, "%s/%d", grp->path, dir);
+            if (mkdir(pathbuf, ACCESS_PERMISSION) != 0 && errno != EEXIST) {
+                fprintf(stderr, "Group %s: couldn't create %s: %s\n", grp->name, pathbuf, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            for (int file = 0; file < grp->files; ++file) {
+                snprintf(pathbuf, sizeof pathbuf, "%s/%d/%d", grp->path, dir, file);
+                if (mknod(pathbuf, S_IFREG | ACCESS_PERMISSION, 0) != 0 && errno != EEXIST) {
+                    fprintf(stderr, "Group %s: couldn't create %s: %s\n", grp->name, pathbuf, strerror(errno));
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+        break;
+    }
+}
+
+// the interval of the group of a thread a time falls in, NULL past the last one or without a report
+static interval *interval_at(thread_load *load, uint64_t when) {
+    uint64_t index;
+
+    if (intervals == NULL || (index = (when - *start_ns) / interval_ns) >= (uint64_t) num_intervals) {
+        return NULL;
+    }
+    return &intervals[load->grp->index * num_intervals + index];
+}
+
+// times one operation that ended at end into its histogram and interval, counting failures
+static void record_end(thread_load *load, int op, uint64_t begin, uint64_t end, int failed) {
+    interval *iv;
+
+    load->last_end = end;
+    if (failed) {
+        load->errors++;
+        return;
+    }
+    hist_add(&load->latencies[op], end - begin);
+    if ((iv = interval_at(load, end)) != NULL) {
+        __atomic_fetch_add(&iv->ops[op], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&iv->latency_ns[op], end - begin, __ATOMIC_RELAXED);
+    }
+}
+
+// times one operation that just ended
+static void record(thread_load *load, int op, uint64_t begin, int failed) {
+    record_end(load, op, begin, stamp(), failed);
+}
+
+// latency runs from the scheduled start when the schedule slipped past it
+static uint64_t latency_start(uint64_t scheduled, uint64_t begin) {
+    return scheduled && scheduled < begin ? scheduled : begin;
+}
+
+/*
+ Issues one request of the group of a thread
+
+ Params:
+  - load: thread load
+  - scheduled: when the request should start, 0 when not paced
+
+ Errors: none, failed operations are counted
+ Returns: none
+*/
+void issue_request(thread_load *load, uint64_t scheduled) {
+    group *grp = load->grp;
+    uint64_t begin, end;
+    char pathbuf[512];
+    struct stat st;
+    ssize_t ret;
+    off_t offset;
+    long ra_offset, ra_length;
+    int i;
+    interval *iv;
+    volatile double sink = 0;
+
+    switch (grp->kind) {
+    case RANDREAD:
+    case RANDWRITE:
+    case SEQREAD:
+    case SEQWRITE:
+        if (grp->kind == RANDREAD || grp->kind == RANDWRITE) {
+            offset = (off_t) offsets_at(&load->where, load->requests);
+        } else {
+            // each thread walks its own slice, wrapping around at its end
+            i = (int) (load->requests % grp->pass);
+            offset = stream_offset(&grp->layout, load->start, grp->pass, grp->bs, i);
+            if (grp->kind == SEQREAD && stream_readahead_due(&grp->layout, grp->bs, i, &ra_offset, &ra_length)) {
+                readahead(grp->fd, offset + ra_offset > 0 ? offset + ra_offset : 0, ra_length);
+            }
+        }
+        // timed around the call only, like rr, rw, seqr and seqw: the fill,
+        // stamps, counters and readahead stay out unless the schedule slipped
+        if (grp->kind == RANDREAD || grp->kind == SEQREAD) {
+            ret = blockio_read(&load->io, &grp->io, offset, &begin, &end);
+            record_end(load, OP_READ, latency_start(scheduled, begin), end, ret < 0);
+        } else {
+            ret = blockio_write(&load->io, &grp->io, offset, &begin, &end);
+            record_end(load, OP_WRITE, latency_start(scheduled, begin), end, ret < 0);
+            if (grp->fsync_every > 0 && (load->requests + 1) % grp->fsync_every == 0) {
+                uint64_t sync_begin = stamp();
+                record(load, OP_SYNC, sync_begin, fsync(grp->fd) != 0);
+            }
+        }
+        if (ret > 0) {
+            load->bytes += ret;
+        }
+        break;
+    case METADATA:
+        begin = latency_start(scheduled, stamp());
+        snprintf(pathbuf, sizeof pathbuf, "%s/eng-%s-%d-%" PRIu64, grp->path, grp->name, load->index, load->requests);
+        record(load, OP_CREATE, begin, mknod(pathbuf, S_IFREG | ACCESS_PERMISSION, 0) != 0);
+        begin = stamp();
+        record(load, OP_STAT, begin, stat(pathbuf, &st) != 0);
+        begin = stamp();
+        record(load, OP_UNLINK, begin, unlink(pathbuf) != 0);
+        break;
+    case STAT_TREE:
+        snprintf(pathbuf, sizeof pathbuf, "%s/%d/%d", grp->path, rand_r(&load->seed) % grp->dirs,
+                rand_r(&load->seed) % grp->files);
+        begin = latency_start(scheduled, stamp());
+        record(load, OP_STAT, begin, stat(pathbuf, &st) != 0);
+        break;
+    case CPU:
+        begin = latency_start(scheduled, stamp());
+        for (int i = 0; i < CPU_OP_ITERATIONS; ++i) {
+            sink += tan(rand_r(&load->seed));
+        }
+        record(load, OP_CPU, begin, 0);
+        break;
+    }
+    load->requests++;
+    if ((iv = interval_at(load, load->last_end)) != NULL) {
+        __atomic_fetch_add(&iv->requests, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void* thread_init(void* args) {
+    thread_load* load = (thread_load*) args;
+    group *grp = load->grp;
+    uint64_t deadline, scheduled;
+    pacer pace;
+
+    // buffers and counters are set up before the run
+    if (is_block(grp)) {
+        blockio_begin(&load->io, &grp->io);
+    }
+    pthread_barrier_wait(start_barrier);
+    pacer_init(&pace, grp->rate, load->index, grp->threads, *start_ns, grp->delay_us * 1000);
+    deadline = runtime_ns ? *start_ns + runtime_ns : UINT64_MAX;
+
+    while ((grp->ops == 0 || load->requests < grp->ops) && pacer_wait(&pace, deadline, &scheduled)) {
+        issue_request(load, grp->rate > 0 ? scheduled : 0);
+    }
+    if (is_block(grp)) {
+        blockio_end(&load->io, &grp->io);
+    }
+    return NULL;
+}
+
+// totals of the threads of one group
+typedef struct group_totals {
+    uint64_t requests;
+    uint64_t bytes;
+    uint64_t errors;
+    hist latencies[NUM_OPS];
+    blockio_totals io;
+} group_totals;
+
+static void merge_group(group_totals *total, const thread_load *load, int num_threads, const group *grp) {
+    memset(total, 0, sizeof(*total));
+    for (int op = 0; op < NUM_OPS; ++op) {
+        hist_init(&total->latencies[op]);
+    }
+    blockio_totals_init(&total->io);
+    for (int thread = 0; thread < num_threads; ++thread) {
+        if (load[thread].grp != grp) {
+            continue;
+        }
+        total->requests += load[thread].requests;
+        total->bytes += load[thread].bytes;
+        total->errors += load[thread].errors;
+        for (int op = 0; op < NUM_OPS; ++op) {
+            hist_merge(&total->latencies[op], &load[thread].latencies[op]);
+        }
+        if (is_block(grp)) {
+            blockio_merge(&total->io, &load[thread].io);
+        }
+    }
+}
+
+/*
+ Prints every group:
+   group,<name>,<kind>,<threads>,<target_rate>,<requests>,<requests/s>,<MB/s>,<errors>
+   group-lat,<name>,<op>,<latency count,mean,p50,p90,p99,p99.9,max> for every operation the group issued
+   the buffer, vectored I/O, perf and verify lines of rr, rw, seqr and seqw for the block groups with those options
+ Rates are over the wall time of the whole run.
+*/
+void print_groups(thread_load *load, int num_threads, uint64_t wall) {
+    group_totals total;
+
+    for (int g = 0; g < num_groups; ++g) {
+        merge_group(&total, load, num_threads, &groups[g]);
+        printf("group,%s,%s,%d,%.1f,%" PRIu64 ",%.1f,%.1f,%" PRIu64 "\n", groups[g].name, kind_names[groups[g].kind],
+                groups[g].threads, groups[g].rate, total.requests, total.requests * (double) NSEC / wall,
+                total.bytes / 1e6 / (wall / (double) NSEC), total.errors);
+        for (int op = 0; op < NUM_OPS; ++op) {
+            if (total.latencies[op].count == 0) {
+                continue;
+            }
+            printf("group-lat,%s,%s,", groups[g].name, op_names[op]);
+            hist_print_csv(stdout, &total.latencies[op]);
+            printf("\n");
+        }
+        if (is_block(&groups[g])) {
+            blockio_print_summary(stdout, groups[g].name, &groups[g].io, groups[g].bs, total.bytes, total.requests, &total.io);
+            if (groups[g].io.verify) {
+                verify_print(stdout, &verified[groups[g].first_thread], groups[g].threads);
+            }
+        }
+    }
+}
+
+/*
+ Writes the JSON report of the run, the input of ./compare:
+   config: the job file, global settings and every group as parsed
+   environment: uname, CPUs, date and the filesystem (statfs type, mount
+     point, source and options) of every group path
+   results: wall time and, per group, requests, throughput, errors, a latency
+     histogram per operation and the interval series: requests/s and mean
+     latency per operation of every complete interval (null when none ended in it)
+
+ Params:
+  - job_file: job file of the run
+  - load: thread loads
+  - num_threads: number of threads
+  - wall: wall time of the run
+
+ Returns: none
+*/
+void write_report(const char *job_file, thread_load *load, int num_threads, uint64_t wall) {
+    const char *paths[MAX_GROUPS];
+    int num_paths = 0, complete = (int) (wall / interval_ns);
+    group_totals total;
+    report r;
+
+    if (complete > num_intervals) {
+        complete = num_intervals;
+    }
+    report_open(&r, report_path);
+    report_string(&r, "tool", "engine");
+    report_uint(&r, "format", 1);
+
+    report_begin_object(&r, "config");
+    report_string(&r, "job_file", job_file);
+    report_number(&r, "runtime_s", runtime_ns / (double) NSEC);
+    report_string(&r, "workers", pool.procs ? "procs" : "threads");
+    report_number(&r, "interval_ms", interval_ns / 1e6);
+    report_begin_array(&r, "groups", 0);
+    for (int g = 0; g < num_groups; ++g) {
+        report_begin_object(&r, NULL);
+        report_string(&r, "name", groups[g].name);
+        report_string(&r, "kind", kind_names[groups[g].kind]);
+        report_string(&r, "path", groups[g].path);
+        report_uint(&r, "size", groups[g].size);
+        report_uint(&r, "bs", groups[g].bs);
+        report_uint(&r, "threads", groups[g].threads);
+        report_number(&r, "rate", groups[g].rate);
+        report_uint(&r, "ops", groups[g].ops);
+        report_uint(&r, "dirs", groups[g].dirs);
+        report_uint(&r, "files", groups[g].files);
+        report_uint(&r, "fsync", groups[g].fsync_every);
+        report_uint(&r, "delay_us", groups[g].delay_us);
+        report_uint(&r, "seed", groups[g].seed);
+        if (groups[g].kind == RANDREAD || groups[g].kind == RANDWRITE) {
+            report_string(&r, "offsets", offsets_mode_name(groups[g].offset_mode));
+        }
+        report_string(&r, "options", groups[g].options);
+        report_end_object(&r);
+        if (groups[g].kind != CPU) {
+            paths[num_paths++] = groups[g].path;
+        }
+    }
+    report_end_array(&r);
+    report_end_object(&r);
+
+    report_environment(&r, paths, num_paths);
+
+    report_begin_object(&r, "results");
+    report_number(&r, "wall_s", wall / (double) NSEC);
+    report_begin_array(&r, "groups", 0);
+    for (int g = 0; g < num_groups; ++g) {
+        interval *series = &intervals[g * num_intervals];
+
+        merge_group(&total, load, num_threads, &groups[g]);
+        report_begin_object(&r, NULL);
+        report_string(&r, "name", groups[g].name);
+        report_string(&r, "kind", kind_names[groups[g].kind]);
+        report_uint(&r, "requests", total.requests);
+        report_number(&r, "requests_per_s", total.requests * (double) NSEC / wall);
+        report_number(&r, "mb_per_s", total.bytes / 1e6 / (wall / (double) NSEC));
+        report_uint(&r, "errors", total.errors);
+        report_begin_object(&r, "latency");
+        for (int op = 0; op < NUM_OPS; ++op) {
+            if (total.latencies[op].count > 0) {
+                report_hist(&r, op_names[op], &total.latencies[op]);
+            }
+        }
+        report_end_object(&r);
+
+        report_begin_object(&r, "intervals");
+        report_uint(&r, "complete", complete);
+        report_begin_array(&r, "requests_per_s", 1);
+        for (int i = 0; i < complete; ++i) {
+            report_number(&r, NULL, series[i].requests * (double) NSEC / interval_ns);
+        }
+        report_end_array(&r);
+        report_begin_object(&r, "mean_latency_ns");
+        for (int op = 0; op < NUM_OPS; ++op) {
+            if (total.latencies[op].count == 0) {
+                continue;
+            }
+            report_begin_array(&r, op_names[op], 1);
+            for (int i = 0; i < complete; ++i) {
+                report_number(&r, NULL, series[i].ops[op] ? series[i].latency_ns[op] / (double) series[i].ops[op] : NAN);
+            }
+            report_end_array(&r);
+        }
+        report_end_object(&r);
+        report_end_object(&r);
+        report_end_object(&r);
+    }
+    report_end_array(&r);
+    report_end_object(&r);
+    report_close(&r);
+}
+
+// To run, type: ./engine <job_file>
+int main(int argc, char* argv[]) {
+    int num_threads = 0, thread = 0, verifies = 0;
+    uint64_t wall, read_bytes = 0, write_bytes = 0;
+    const char *iostat_path = NULL;
+    io_stats iostats;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: ./engine <job_file>\n");
+        exit(EXIT_FAILURE);
+    }
+
+    slowlog_spec_init(&slow_spec);
+    parse_job_file(argv[1]);
+    if (num_groups == 0) {
+        fprintf(stderr, "The job file %s has no groups\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    for (int g = 0; g < num_groups; ++g) {
+        setup_group(&groups[g]);
+        groups[g].first_thread = num_threads;
+        num_threads += groups[g].threads;
+        verifies |= groups[g].io.verify;
+        if (iostat_path == NULL && groups[g].kind != CPU) {
+            iostat_path = groups[g].path;
+        }
+    }
+    if (iostat_interval_ms >= 0 && iostat_path == NULL) {
+        fprintf(stderr, "iostat needs a group with a path\n");
+        exit(EXIT_FAILURE);
+    }
+    if (verifies) {
+        verify_init();
+    }
+
+    srand(time(NULL));
+    workers_init(&pool, num_threads);
+    thread_load* load = (thread_load*) workers_calloc(&pool, num_threads, sizeof(thread_load));
+    start_barrier = (pthread_barrier_t*) workers_calloc(&pool, 1, sizeof(pthread_barrier_t));
+    start_ns = (uint64_t*) workers_calloc(&pool, 1, sizeof(uint64_t));
+    workers_barrier_init(&pool, start_barrier, num_threads + 1);
+    verified = (verify_stats*) workers_calloc(&pool, num_threads, sizeof(verify_stats));
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) workers_calloc(&pool, 1, slowlog_size(&slow_spec, num_threads));
+        slowlog_init(slow_log, &slow_spec, num_threads);
+    }
+    if (report_path[0] != '\0') {
+        if (interval_ns == 0) {
+            interval_ns = NSEC;
+        }
+        num_intervals = runtime_ns ? (int) (runtime_ns / interval_ns) + 1 : MAX_INTERVALS;
+        intervals = (interval*) workers_calloc(&pool, (size_t) num_groups * num_intervals, sizeof(interval));
+    }
+    for (int g = 0; g < num_groups; ++g) {
+        group *grp = &groups[g];
+
+        grp->io.slow_log = slow_log;
+        if (grp->seed == 0) {
+            grp->seed = rand();
+        }
+        for (int i = 0; i < grp->threads; ++i, ++thread) {
+            load[thread].thread_id = thread;
+            load[thread].index = i;
+            load[thread].grp = grp;
+            load[thread].seed = rand();
+            if (is_block(grp)) {
+                blockio_init(&load[thread].io, &grp->io, grp->fd, grp->bs, thread, &verified[thread], grp->seed + i);
+                // blocks were checked against the threads in setup_group()
+                offsets_init(&load[thread].where, grp->offset_mode, grp->size, grp->bs, grp->bs, i, grp->threads, grp->seed);
+                load[thread].start = (long) (grp->size / grp->bs / grp->threads * grp->bs * i);
+            }
+            for (int op = 0; op < NUM_OPS; ++op) {
+                hist_init(&load[thread].latencies[op]);
+            }
+        }
+    }
+
+    workers_start(&pool, thread_init, load, sizeof(thread_load));
+    if (iostat_interval_ms >= 0) {
+        io_stats_init(&iostats, iostat_path);
+        io_stats_start(&iostats, iostat_interval_ms);
+    }
+    // every thread reads the start once the barrier opens
+    *start_ns = stamp();
+    pthread_barrier_wait(start_barrier);
+    workers_join(&pool);
+    wall = stamp() - *start_ns;
+    if (iostat_interval_ms >= 0) {
+        for (thread = 0; thread < num_threads; ++thread) {
+            if (load[thread].grp->kind == RANDREAD || load[thread].grp->kind == SEQREAD) {
+                read_bytes += load[thread].bytes;
+            } else if (load[thread].grp->kind == RANDWRITE || load[thread].grp->kind == SEQWRITE) {
+                write_bytes += load[thread].bytes;
+            }
+        }
+        io_stats_stop(&iostats, read_bytes, write_bytes);
+    }
+
+    printf("engine,%s,%d,%d,%.3f\n", argv[1], num_groups, num_threads, wall / (double) NSEC);
+    print_groups(load, num_threads, wall);
+    slowlog_print(stdout, slow_log);
+    if (intervals != NULL) {
+        write_report(argv[1], load, num_threads, wall);
+    }
+
+    for (int g = 0; g < num_groups; ++g) {
+        if (groups[g].fd >= 0) {
+            close(groups[g].fd);
+        }
+    }
+    return EXIT_SUCCESS;
+}
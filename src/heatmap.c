@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "heatmap.h"
+
+/*
+ Sets the default heat map: disabled, 64 regions by 32 slices, CSV
+
+ Params:
+  - spec: heat map specification
+
+ Returns: none
+*/
+void heatmap_spec_init(heatmap_spec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->regions = 64;
+    spec->slices = 32;
+}
+
+/*
+ Parses the heat map option of the command line: heatmap[=<regions>x<slices>][,json]
+
+ Params:
+  - spec: heat map specification being built
+  - option: command line option
+
+ Errors: It fails and exits the program if the option value is invalid
+ Returns: 1 if the option was the heat map option, 0 otherwise
+*/
+int heatmap_parse_option(heatmap_spec *spec, const char *option) {
+    const char *value;
+
+    if (strncmp(option, "heatmap", 7) != 0) {
+        return 0;
+    }
+    value = option + 7;
+    if (*value == '=') {
+        value++;
+        if (strncmp(value, "json", 4) != 0) {
+            if (sscanf(value, "%dx%d", &spec->regions, &spec->slices) != 2 ||
+                    spec->regions < 1 || spec->slices < 1) {
+                fprintf(stderr, "Invalid heat map %s, must be heatmap[=<regions>x<slices>][,json]\n", option);
+                exit(EXIT_FAILURE);
+            }
+            value = strchr(value, ',') ? strchr(value, ',') + 1 : value + strlen(value);
+        }
+    } else if (*value == ',') {
+        value++;
+    } else if (*value != '\0') {
+        return 0;
+    }
+    if (strcmp(value, "json") == 0) {
+        spec->json = 1;
+    } else if (*value != '\0') {
+        fprintf(stderr, "Invalid heat map %s, must be heatmap[=<regions>x<slices>][,json]\n", option);
+        exit(EXIT_FAILURE);
+    }
+    spec->enabled = 1;
+    return 1;
+}
+
+static void cell_add(heatmap_cell *cell, uint64_t latency) {
+    cell->count++;
+    cell->sum += latency;
+    if (latency > cell->max) {
+        cell->max = latency;
+    }
+    cell->buckets[hist_bucket_bits(latency, HEATMAP_SUB_BITS)]++;
+}
+
+static uint64_t cell_mean(const heatmap_cell *cell) {
+    return cell->count ? cell->sum / cell->count : 0;
+}
+
+static uint64_t cell_p99(const heatmap_cell *cell) {
+    uint64_t rank = (cell->count * 99 + 99) / 100, seen = 0;
+
+    for (int i = 0; i < HEATMAP_BUCKETS && cell->count; i++) {
+        seen += cell->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = hist_bucket_value_bits(i, HEATMAP_SUB_BITS);
+            return value > cell->max ? cell->max : value;
+        }
+    }
+    return cell->max;
+}
+
+/*
+ Sizes the heat map for one run
+
+ Params:
+  - map: heat map
+  - spec: heat map specification
+  - file_size: largest file size, split in spec->regions regions
+  - t0, t1: first begin and last end of the run, split in spec->slices slices
+
+ Errors: It fails and exits the program if the cells can't be allocated
+ Returns: none
+*/
+void heatmap_init(heatmap *map, const heatmap_spec *spec, uint64_t file_size, uint64_t t0, uint64_t t1) {
+    map->spec = *spec;
+    map->region_bytes = (file_size + spec->regions - 1) / spec->regions;
+    if (map->region_bytes == 0) {
+        map->region_bytes = 1;
+    }
+    map->t0 = t0;
+    map->slice_ns = (t1 - t0 + spec->slices) / spec->slices;
+    map->cells = (heatmap_cell*) calloc((size_t) spec->regions * spec->slices, sizeof(heatmap_cell));
+    map->by_region = (heatmap_cell*) calloc(spec->regions, sizeof(heatmap_cell));
+    map->by_slice = (heatmap_cell*) calloc(spec->slices, sizeof(heatmap_cell));
+    if (map->cells == NULL || map->by_region == NULL || map->by_slice == NULL) {
+        perror("Error allocating heat map");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void heatmap_add(heatmap *map, uint64_t offset, uint64_t begin, uint64_t end) {
+    uint64_t region = offset / map->region_bytes;
+    uint64_t slice = begin > map->t0 ? (begin - map->t0) / map->slice_ns : 0;
+
+    if (region >= (uint64_t) map->spec.regions) {
+        region = map->spec.regions - 1;
+    }
+    if (slice >= (uint64_t) map->spec.slices) {
+        slice = map->spec.slices - 1;
+    }
+    cell_add(&map->cells[region * map->spec.slices + slice], end - begin);
+    cell_add(&map->by_region[region], end - begin);
+    cell_add(&map->by_slice[slice], end - begin);
+}
+
+static void print_json_matrix(FILE *out, const heatmap *map, const char *name, uint64_t (*value)(const heatmap_cell *)) {
+    fprintf(out, ",\"%s\":[", name);
+    for (int r = 0; r < map->spec.regions; r++) {
+        fprintf(out, "%s[", r ? "," : "");
+        for (int s = 0; s < map->spec.slices; s++) {
+            fprintf(out, "%s%lu", s ? "," : "", (unsigned long) value(&map->cells[r * map->spec.slices + s]));
+        }
+        fprintf(out, "]");
+    }
+    fprintf(out, "]");
+}
+
+static void print_json_vector(FILE *out, const char *name, const heatmap_cell *cells, int count) {
+    fprintf(out, ",\"%s\":{\"count\":[", name);
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%s%lu", i ? "," : "", (unsigned long) cells[i].count);
+    }
+    fprintf(out, "],\"mean_ns\":[");
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%s%lu", i ? "," : "", (unsigned long) cell_mean(&cells[i]));
+    }
+    fprintf(out, "],\"p99_ns\":[");
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%s%lu", i ? "," : "", (unsigned long) cell_p99(&cells[i]));
+    }
+    fprintf(out, "]}");
+}
+
+static uint64_t cell_count(const heatmap_cell *cell) {
+    return cell->count;
+}
+
+static uint64_t cell_max(const heatmap_cell *cell) {
+    return cell->max;
+}
+
+static void print_csv_cell(FILE *out, const char *kind, const heatmap_cell *cell) {
+    fprintf(out, "%s,%lu,%lu,%lu,%lu\n", kind, (unsigned long) cell->count, (unsigned long) cell_mean(cell),
+            (unsigned long) cell_p99(cell), (unsigned long) cell->max);
+}
+
+/*
+ Prints the heat map. As CSV, only the non-empty cells:
+   heatmap,<regions>,<slices>,<region_bytes>,<slice_ns>
+   heatmap-region,<region>,<offset>,<count>,<mean_ns>,<p99_ns>,<max_ns>
+   heatmap-slice,<slice>,<t_ms>,<count>,<mean_ns>,<p99_ns>,<max_ns>
+   heatmap-cell,<region>,<slice>,<count>,<mean_ns>,<p99_ns>,<max_ns>
+ As JSON, one line with region x slice matrices of count, mean_ns, p99_ns and
+ max_ns, and the region and slice marginals.
+
+ Params:
+  - out: output stream
+  - map: heat map
+
+ Returns: none
+*/
+void heatmap_print(FILE *out, const heatmap *map) {
+    char kind[64];
+
+    if (map->spec.json) {
+        fprintf(out, "{\"regions\":%d,\"slices\":%d,\"region_bytes\":%lu,\"slice_ns\":%lu",
+                map->spec.regions, map->spec.slices, (unsigned long) map->region_bytes, (unsigned long) map->slice_ns);
+        print_json_matrix(out, map, "count", cell_count);
+        print_json_matrix(out, map, "mean_ns", cell_mean);
+        print_json_matrix(out, map, "p99_ns", cell_p99);
+        print_json_matrix(out, map, "max_ns", cell_max);
+        print_json_vector(out, "by_region", map->by_region, map->spec.regions);
+        print_json_vector(out, "by_slice", map->by_slice, map->spec.slices);
+        fprintf(out, "}\n");
+        return;
+    }
+
+    fprintf(out, "heatmap,%d,%d,%lu,%lu\n", map->spec.regions, map->spec.slices,
+            (unsigned long) map->region_bytes, (unsigned long) map->slice_ns);
+    for (int r = 0; r < map->spec.regions; r++) {
+        if (map->by_region[r].count) {
+            snprintf(kind, sizeof kind, "heatmap-region,%d,%lu", r, (unsigned long) (r * map->region_bytes));
+            print_csv_cell(out, kind, &map->by_region[r]);
+        }
+    }
+    for (int s = 0; s < map->spec.slices; s++) {
+        if (map->by_slice[s].count) {
+            snprintf(kind, sizeof kind, "heatmap-slice,%d,%.3f", s, s * map->slice_ns / 1e6);
+            print_csv_cell(out, kind, &map->by_slice[s]);
+        }
+    }
+    for (int r = 0; r < map->spec.regions; r++) {
+        for (int s = 0; s < map->spec.slices; s++) {
+            if (map->cells[r * map->spec.slices + s].count) {
+                snprintf(kind, sizeof kind, "heatmap-cell,%d,%d", r, s);
+                print_csv_cell(out, kind, &map->cells[r * map->spec.slices + s]);
+            }
+        }
+    }
+}
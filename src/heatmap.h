@@ -0,0 +1,46 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stdio.h>
+#include <stdint.h> //uint64_t
+#include "hist.h"
+
+// Latency buckets of a cell: the hist scheme with 4 buckets per power of two
+// (~19% error), so that thousands of cells stay small
+#define HEATMAP_SUB_BITS 2
+#define HEATMAP_BUCKETS HIST_NUM_BUCKETS(HEATMAP_SUB_BITS)
+
+typedef struct heatmap_spec {
+    int enabled;
+    int regions;  // file offset regions
+    int slices;   // time slices
+    int json;     // JSON matrices instead of CSV cells
+} heatmap_spec;
+
+typedef struct heatmap_cell {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint32_t buckets[HEATMAP_BUCKETS];
+} heatmap_cell;
+
+// Latency of every request by file offset region and time slice, plus the
+// marginals of each region (over the whole run) and each slice (over the
+// whole file).
+typedef struct heatmap {
+    heatmap_spec spec;
+    uint64_t region_bytes;
+    uint64_t t0;
+    uint64_t slice_ns;
+    heatmap_cell *cells;      // regions * slices, region-major
+    heatmap_cell *by_region;
+    heatmap_cell *by_slice;
+} heatmap;
+
+void heatmap_spec_init(heatmap_spec *spec);
+int heatmap_parse_option(heatmap_spec *spec, const char *option);
+void heatmap_init(heatmap *map, const heatmap_spec *spec, uint64_t file_size, uint64_t t0, uint64_t t1);
+void heatmap_add(heatmap *map, uint64_t offset, uint64_t begin, uint64_t end);
+void heatmap_print(FILE *out, const heatmap *map);
+
+#endif
@@ -0,0 +1,177 @@
+#include <string.h>
+#include "hist.h"
+
+/*
+ Gets the bucket a value falls in, with 2^sub_bits buckets per power of two
+
+ Params:
+  - value: value to be bucketed
+  - sub_bits: log2 of the buckets per power of two
+
+ Returns: The bucket index, in [0, HIST_NUM_BUCKETS(sub_bits))
+*/
+int hist_bucket_bits(uint64_t value, int sub_bits) {
+    int msb, shift;
+
+    if (value < (1ULL << sub_bits)) {
+        return (int) value;
+    }
+    msb = 63 - __builtin_clzll(value);
+    shift = msb - sub_bits;
+    return ((shift + 1) << sub_bits) + (int) ((value >> shift) & ((1ULL << sub_bits) - 1));
+}
+
+/*
+ Gets the value a bucket of hist_bucket_bits() stands for (the middle of its range)
+
+ Params:
+  - bucket: bucket index
+  - sub_bits: log2 of the buckets per power of two
+
+ Returns: The representative value of the bucket
+*/
+uint64_t hist_bucket_value_bits(int bucket, int sub_bits) {
+    int shift;
+    uint64_t low, sub = 1ULL << sub_bits;
+
+    if ((uint64_t) bucket < sub) {
+        return (uint64_t) bucket;
+    }
+    shift = (bucket >> sub_bits) - 1;
+    low = (sub | (bucket & (sub - 1))) << shift;
+    return low + ((1ULL << shift) >> 1);
+}
+
+// bucket of a value in a hist
+int hist_bucket(uint64_t value) {
+    return hist_bucket_bits(value, HIST_SUB_BITS);
+}
+
+// representative value of a bucket of a hist
+uint64_t hist_bucket_value(int bucket) {
+    return hist_bucket_value_bits(bucket, HIST_SUB_BITS);
+}
+
+/*
+ Resets a histogram
+
+ Params:
+  - h: histogram
+
+ Returns: none
+*/
+void hist_init(hist *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+/*
+ Records one value
+
+ Params:
+  - h: histogram
+  - value: value to be recorded (e.g. a latency in nanoseconds)
+
+ Returns: none
+*/
+void hist_add(hist *h, uint64_t value) {
+    h->buckets[hist_bucket(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+/*
+ Adds every value recorded in a histogram to another one
+
+ Params:
+  - dst: histogram receiving the values
+  - src: histogram being merged
+
+ Returns: none
+*/
+void hist_merge(hist *dst, const hist *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+/*
+ Gets the mean of the recorded values
+
+ Params:
+  - h: histogram
+
+ Returns: The mean, or 0 when nothing was recorded
+*/
+uint64_t hist_mean(const hist *h) {
+    return h->count ? h->sum / h->count : 0;
+}
+
+/*
+ Gets a percentile of the recorded values
+
+ Params:
+  - h: histogram
+  - percentile: percentile in [0, 100]
+
+ Returns: The percentile (clamped to the observed min/max), or 0 when nothing was recorded
+*/
+uint64_t hist_percentile(const hist *h, double percentile) {
+    uint64_t rank, seen = 0, value;
+
+    if (h->count == 0) {
+        return 0;
+    }
+    rank = (uint64_t) (percentile / 100.0 * h->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > h->count) {
+        rank = h->count;
+    }
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            value = hist_bucket_value(i);
+            if (value < h->min) {
+                return h->min;
+            }
+            return value > h->max ? h->max : value;
+        }
+    }
+    return h->max;
+}
+
+/*
+ Prints the summary of a histogram as CSV: count, mean, p50, p90, p99, p99.9, max
+
+ Params:
+  - out: output stream
+  - h: histogram
+
+ Returns: none
+*/
+void hist_print_csv(FILE *out, const hist *h) {
+    fprintf(out, "%lu,%lu,%lu,%lu,%lu,%lu,%lu",
+            (unsigned long) h->count,
+            (unsigned long) hist_mean(h),
+            (unsigned long) hist_percentile(h, 50),
+            (unsigned long) hist_percentile(h, 90),
+            (unsigned long) hist_percentile(h, 99),
+            (unsigned long) hist_percentile(h, 99.9),
+            (unsigned long) (h->count ? h->max : 0));
+}
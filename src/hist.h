@@ -0,0 +1,35 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdio.h>
+#include <stdint.h> //uint64_t
+
+// Log-linear latency histogram: values below 2^HIST_SUB_BITS get their own
+// bucket, larger values are split in 2^HIST_SUB_BITS buckets per power of two
+// (relative error below 1/2^HIST_SUB_BITS, ~3%). Smaller tables (e.g. the
+// cells of a heat map) use the same scheme with fewer sub bits.
+#define HIST_NUM_BUCKETS(sub_bits) ((64 - (sub_bits) + 1) << (sub_bits))
+#define HIST_SUB_BITS 5
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS HIST_NUM_BUCKETS(HIST_SUB_BITS)
+
+typedef struct hist {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} hist;
+
+void hist_init(hist *h);
+void hist_add(hist *h, uint64_t value);
+void hist_merge(hist *dst, const hist *src);
+uint64_t hist_mean(const hist *h);
+uint64_t hist_percentile(const hist *h, double percentile);
+int hist_bucket(uint64_t value);
+uint64_t hist_bucket_value(int bucket);
+int hist_bucket_bits(uint64_t value, int sub_bits);
+uint64_t hist_bucket_value_bits(int bucket, int sub_bits);
+void hist_print_csv(FILE *out, const hist *h);
+
+#endif
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h> //major, minor
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "iostats.h"
+
+#define NSEC 1000000000ULL
+#define SECTOR_SIZE 512
+
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
+       perror("Error getting timestamp");
+       exit(EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+/*
+ Finds the block device backing a path (the device itself for block device
+ paths). Paths on filesystems without a block device (tmpfs, overlay, NFS)
+ are only accounted at the process level.
+
+ Params:
+  - stats: accounting state
+  - path: file or device the benchmark works on
+
+ Errors: It warns if the path has no block device
+ Returns: none
+*/
+void io_stats_init(io_stats *stats, const char *path) {
+    struct stat st;
+    dev_t dev;
+
+    memset(stats, 0, sizeof(*stats));
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Couldn't stat %s: %s\n", path, strerror(errno));
+        return;
+    }
+    dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+    stats->major = major(dev);
+    stats->minor = minor(dev);
+    stats->has_device = stats->major != 0;
+    if (!stats->has_device) {
+        fprintf(stderr, "No block device backs %s, device accounting disabled\n", path);
+    }
+}
+
+static void read_proc_io(io_sample *sample) {
+    FILE *in = fopen("/proc/self/io", "r");
+    char key[64];
+    uint64_t value;
+
+    if (in == NULL) {
+        return;
+    }
+    while (fscanf(in, "%63[^:]: %" SCNu64 "\n", key, &value) == 2) {
+        if (strcmp(key, "rchar") == 0) {
+            sample->rchar = value;
+        } else if (strcmp(key, "wchar") == 0) {
+            sample->wchar = value;
+        } else if (strcmp(key, "read_bytes") == 0) {
+            sample->read_bytes = value;
+        } else if (strcmp(key, "write_bytes") == 0) {
+            sample->write_bytes = value;
+        }
+    }
+    fclose(in);
+}
+
+static void read_diskstats(const io_stats *stats, io_sample *sample) {
+    FILE *in = fopen("/proc/diskstats", "r");
+    char line[512], name[64];
+    unsigned int major, minor;
+    uint64_t f[11];
+
+    if (in == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof line, in) != NULL) {
+        // major minor name reads merged sectors ms writes merged sectors ms in_flight io_ticks queue_ms
+        if (sscanf(line, "%u %u %63s %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                    " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64, &major, &minor, name,
+                    &f[0], &f[1], &f[2], &f[3], &f[4], &f[5], &f[6], &f[7], &f[8], &f[9], &f[10]) != 14) {
+            continue;
+        }
+        if (major == stats->major && minor == stats->minor) {
+            sample->dev_reads = f[0];
+            sample->dev_sectors_read = f[2];
+            sample->dev_writes = f[4];
+            sample->dev_sectors_written = f[6];
+            sample->dev_io_ticks_ms = f[9];
+            sample->dev_queue_ms = f[10];
+            break;
+        }
+    }
+    fclose(in);
+}
+
+static void read_vmstat(io_sample *sample) {
+    FILE *in = fopen("/proc/vmstat", "r");
+    uint64_t page_kb = sysconf(_SC_PAGESIZE) / 1024, value;
+    char key[64];
+
+    if (in == NULL) {
+        return;
+    }
+    while (fscanf(in, "%63s %" SCNu64, key, &value) == 2) {
+        if (strcmp(key, "nr_dirty") == 0) {
+            sample->dirty_kb = value * page_kb;
+        } else if (strcmp(key, "nr_writeback") == 0) {
+            sample->writeback_kb = value * page_kb;
+        }
+    }
+    fclose(in);
+}
+
+/*
+ Takes a reading of every source
+
+ Params:
+  - stats: accounting state
+  - sample: filled with the reading
+
+ Returns: none
+*/
+void io_stats_sample(const io_stats *stats, io_sample *sample) {
+    memset(sample, 0, sizeof(*sample));
+    sample->timestamp = stamp();
+    read_proc_io(sample);
+    if (stats->has_device) {
+        read_diskstats(stats, sample);
+    }
+    read_vmstat(sample);
+}
+
+/*
+ Prints the interval between two readings:
+   iostat-interval,<elapsed_ms>,<proc_read_MBps>,<proc_write_MBps>,<dev_read_MBps>,<dev_write_MBps>,
+                   <util_pct>,<avg_queue>,<dirty_kB>,<writeback_kB>
+*/
+static void print_interval(const io_sample *start, const io_sample *prev, const io_sample *now) {
+    double secs = (now->timestamp - prev->timestamp) / (double) NSEC;
+    double ms = secs * 1000;
+
+    printf("iostat-interval,%" PRIu64 ",%.2f,%.2f,%.2f,%.2f,%.1f,%.2f,%" PRIu64 ",%" PRIu64 "\n",
+            (now->timestamp - start->timestamp) / 1000000,
+            (now->rchar - prev->rchar) / secs / 1e6,
+            (now->wchar - prev->wchar) / secs / 1e6,
+            (now->dev_sectors_read - prev->dev_sectors_read) * SECTOR_SIZE / secs / 1e6,
+            (now->dev_sectors_written - prev->dev_sectors_written) * SECTOR_SIZE / secs / 1e6,
+            100.0 * (now->dev_io_ticks_ms - prev->dev_io_ticks_ms) / ms,
+            (now->dev_queue_ms - prev->dev_queue_ms) / ms,
+            now->dirty_kb, now->writeback_kb);
+    fflush(stdout);
+}
+
+static void *sampler(void *arg) {
+    io_stats *stats = (io_stats*) arg;
+    io_sample prev = stats->start, now;
+    struct timespec interval = { stats->interval_ms / 1000, (stats->interval_ms % 1000) * 1000000L };
+
+    while (!__atomic_load_n(&stats->stop, __ATOMIC_ACQUIRE)) {
+        nanosleep(&interval, NULL);
+        io_stats_sample(stats, &now);
+        print_interval(&stats->start, &prev, &now);
+        prev = now;
+    }
+    return NULL;
+}
+
+/*
+ Starts the measured phase
+
+ Params:
+  - stats: accounting state
+  - interval_ms: period of the interval reports, 0 for none
+
+ Returns: none
+*/
+void io_stats_start(io_stats *stats, int interval_ms) {
+    io_stats_sample(stats, &stats->start);
+    stats->interval_ms = interval_ms;
+    stats->stop = 0;
+    if (interval_ms > 0) {
+        pthread_create(&stats->sampler, NULL, sampler, stats);
+    }
+}
+
+/*
+ Ends the measured phase and prints what the kernel and the device did for
+ the bytes the application asked for:
+   iostat,<app_read>,<app_write>,<proc_read>,<proc_write>,<dev_read>,<dev_write>,
+          <read_amp>,<write_amp>,<util_pct>,<avg_queue>,<dirty_kB>,<writeback_kB>
+ proc_* are the storage bytes of /proc/self/io, dev_* the bytes of
+ /proc/diskstats (all processes), *_amp is device bytes over application
+ bytes and the dirty/writeback columns are the page cache at the end.
+ Device columns are "-" when no block device backs the path.
+
+ Params:
+  - stats: accounting state
+  - app_read_bytes: bytes the benchmark read
+  - app_write_bytes: bytes the benchmark wrote
+
+ Returns: none
+*/
+void io_stats_stop(io_stats *stats, uint64_t app_read_bytes, uint64_t app_write_bytes) {
+    io_sample end;
+    uint64_t dev_read, dev_write;
+    double ms;
+
+    if (stats->interval_ms > 0) {
+        __atomic_store_n(&stats->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(stats->sampler, NULL);
+    }
+    io_stats_sample(stats, &end);
+    ms = (end.timestamp - stats->start.timestamp) / 1e6;
+
+    printf("iostat,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64, app_read_bytes, app_write_bytes,
+            end.read_bytes - stats->start.read_bytes, end.write_bytes - stats->start.write_bytes);
+    if (stats->has_device) {
+        dev_read = (end.dev_sectors_read - stats->start.dev_sectors_read) * SECTOR_SIZE;
+        dev_write = (end.dev_sectors_written - stats->start.dev_sectors_written) * SECTOR_SIZE;
+        printf(",%" PRIu64 ",%" PRIu64 ",%.3f,%.3f,%.1f,%.2f", dev_read, dev_write,
+                app_read_bytes ? (double) dev_read / app_read_bytes : 0,
+                app_write_bytes ? (double) dev_write / app_write_bytes : 0,
+                100.0 * (end.dev_io_ticks_ms - stats->start.dev_io_ticks_ms) / ms,
+                (end.dev_queue_ms - stats->start.dev_queue_ms) / ms);
+    } else {
+        printf(",-,-,-,-,-,-");
+    }
+    printf(",%" PRIu64 ",%" PRIu64 "\n", end.dirty_kb, end.writeback_kb);
+}
@@ -0,0 +1,40 @@
+#ifndef IOSTATS_H
+#define IOSTATS_H
+
+#include <pthread.h>
+#include <stdint.h> //uint64_t
+
+// One reading of /proc/self/io, /proc/diskstats (for the device backing the
+// benchmark path) and /proc/vmstat.
+typedef struct io_sample {
+    uint64_t timestamp;
+    uint64_t rchar;
+    uint64_t wchar;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t dev_reads;
+    uint64_t dev_sectors_read;
+    uint64_t dev_writes;
+    uint64_t dev_sectors_written;
+    uint64_t dev_io_ticks_ms;
+    uint64_t dev_queue_ms;
+    uint64_t dirty_kb;
+    uint64_t writeback_kb;
+} io_sample;
+
+typedef struct io_stats {
+    unsigned int major;
+    unsigned int minor;
+    int has_device;
+    io_sample start;
+    int interval_ms;
+    int stop;
+    pthread_t sampler;
+} io_stats;
+
+void io_stats_init(io_stats *stats, const char *path);
+void io_stats_sample(const io_stats *stats, io_sample *sample);
+void io_stats_start(io_stats *stats, int interval_ms);
+void io_stats_stop(io_stats *stats, uint64_t app_read_bytes, uint64_t app_write_bytes);
+
+#endif
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include "json.h"
+
+// text being parsed, with the file name for errors
+typedef struct parser {
+    const char *path;
+    const char *text;
+    const char *pos;
+} parser;
+
+static void parse_value(parser *p, json *value);
+
+static void parse_error(const parser *p, const char *what) {
+    int line = 1;
+
+    for (const char *c = p->text; c < p->pos; c++) {
+        line += *c == '\n';
+    }
+    fprintf(stderr, "%s:%d: %s\n", p->path, line, what);
+    exit(EXIT_FAILURE);
+}
+
+static void skip_space(parser *p) {
+    while (isspace((unsigned char) *p->pos)) {
+        p->pos++;
+    }
+}
+
+static void expect(parser *p, char c) {
+    char what[32];
+
+    skip_space(p);
+    if (*p->pos != c) {
+        snprintf(what, sizeof what, "expected '%c'", c);
+        parse_error(p, what);
+    }
+    p->pos++;
+}
+
+// reads a string literal; \u escapes outside ASCII become '?', reports only need ASCII back
+static char *parse_string(parser *p) {
+    size_t len = 0, capacity = 16;
+    char *s = (char*) malloc(capacity);
+
+    expect(p, '"');
+    while (*p->pos != '"') {
+        char c = *p->pos++;
+
+        if (c == '\0') {
+            parse_error(p, "unterminated string");
+        }
+        if (c == '\\') {
+            c = *p->pos++;
+            switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'u': {
+                char hex[5] = { 0 };
+                long code;
+
+                strncpy(hex, p->pos, 4);
+                code = strtol(hex, NULL, 16);
+                if (strlen(hex) != 4) {
+                    parse_error(p, "invalid \\u escape");
+                }
+                p->pos += 4;
+                c = code < 0x80 ? (char) code : '?';
+                break;
+            }
+            case '"': case '\\': case '/':
+                break;
+            default:
+                parse_error(p, "invalid escape");
+            }
+        }
+        if (len + 1 == capacity) {
+            capacity *= 2;
+            s = (char*) realloc(s, capacity);
+        }
+        s[len++] = c;
+    }
+    p->pos++;
+    s[len] = '\0';
+    return s;
+}
+
+static void add_item(json *container, int *capacity, const json *item) {
+    if (container->length == *capacity) {
+        *capacity = *capacity ? 2 * *capacity : 8;
+        container->items = (json*) realloc(container->items, *capacity * sizeof(json));
+    }
+    container->items[container->length++] = *item;
+}
+
+// parses the elements of an array, or the members of an object, after its bracket
+static void parse_items(parser *p, json *container, char close) {
+    int capacity = 0;
+    json item;
+
+    skip_space(p);
+    if (*p->pos == close) {
+        p->pos++;
+        return;
+    }
+    while (1) {
+        memset(&item, 0, sizeof(item));
+        if (container->type == JSON_OBJECT) {
+            skip_space(p);
+            item.key = parse_string(p);
+            expect(p, ':');
+        }
+        parse_value(p, &item);
+        add_item(container, &capacity, &item);
+        skip_space(p);
+        if (*p->pos == ',') {
+            p->pos++;
+            continue;
+        }
+        expect(p, close);
+        return;
+    }
+}
+
+static void parse_value(parser *p, json *value) {
+    char *end;
+
+    skip_space(p);
+    switch (*p->pos) {
+    case '{':
+        p->pos++;
+        value->type = JSON_OBJECT;
+        parse_items(p, value, '}');
+        break;
+    case '[':
+        p->pos++;
+        value->type = JSON_ARRAY;
+        parse_items(p, value, ']');
+        break;
+    case '"':
+        value->type = JSON_STRING;
+        value->string = parse_string(p);
+        break;
+    default:
+        if (strncmp(p->pos, "null", 4) == 0) {
+            value->type = JSON_NULL;
+            p->pos += 4;
+        } else if (strncmp(p->pos, "true", 4) == 0) {
+            value->type = JSON_BOOL;
+            value->number = 1;
+            p->pos += 4;
+        } else if (strncmp(p->pos, "false", 5) == 0) {
+            value->type = JSON_BOOL;
+            p->pos += 5;
+        } else {
+            value->type = JSON_NUMBER;
+            value->number = strtod(p->pos, &end);
+            if (end == p->pos) {
+                parse_error(p, "expected a value");
+            }
+            p->pos = end;
+        }
+    }
+}
+
+/*
+ Reads and parses a JSON file
+
+ Params:
+  - path: file to read
+
+ Errors: It fails and exits the program if the file can't be read or isn't valid JSON
+ Returns: The top-level value, to be released with json_free()
+*/
+json *json_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    json *value = (json*) calloc(1, sizeof(json));
+    parser p;
+    char *text;
+    long size;
+
+    if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0) {
+        fprintf(stderr, "Couldn't read %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    rewind(f);
+    text = (char*) malloc(size + 1);
+    if (fread(text, 1, size, f) != (size_t) size) {
+        fprintf(stderr, "Couldn't read %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    text[size] = '\0';
+    fclose(f);
+
+    p.path = path;
+    p.text = text;
+    p.pos = text;
+    parse_value(&p, value);
+    skip_space(&p);
+    if (*p.pos != '\0') {
+        parse_error(&p, "trailing data after the top-level value");
+    }
+    free(text);
+    return value;
+}
+
+static void json_free_items(json *value) {
+    for (int i = 0; i < value->length; i++) {
+        json_free_items(&value->items[i]);
+    }
+    free(value->items);
+    free(value->string);
+    free(value->key);
+}
+
+void json_free(json *value) {
+    json_free_items(value);
+    free(value);
+}
+
+// gets a member of an object, NULL if missing or not an object
+const json *json_get(const json *object, const char *key) {
+    if (object == NULL || object->type != JSON_OBJECT) {
+        return NULL;
+    }
+    for (int i = 0; i < object->length; i++) {
+        if (strcmp(object->items[i].key, key) == 0) {
+            return &object->items[i];
+        }
+    }
+    return NULL;
+}
+
+const char *json_get_string(const json *object, const char *key, const char *fallback) {
+    const json *member = json_get(object, key);
+    return member != NULL && member->type == JSON_STRING ? member->string : fallback;
+}
+
+double json_get_number(const json *object, const char *key, double fallback) {
+    const json *member = json_get(object, key);
+    return member != NULL && (member->type == JSON_NUMBER || member->type == JSON_BOOL) ? member->number : fallback;
+}
@@ -0,0 +1,30 @@
+#ifndef JSON_H
+#define JSON_H
+
+enum json_types {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+// A parsed JSON value. Arrays and objects hold their elements or members in
+// items, members carrying their name in key.
+typedef struct json {
+    int type;
+    double number;      // numbers, and 0/1 for booleans
+    char *string;
+    char *key;
+    int length;
+    struct json *items;
+} json;
+
+json *json_load(const char *path);
+void json_free(json *value);
+const json *json_get(const json *object, const char *key);
+const char *json_get_string(const json *object, const char *key, const char *fallback);
+double json_get_number(const json *object, const char *key, double fallback);
+
+#endif
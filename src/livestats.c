@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "livestats.h"
+
+#define NSEC 1000000000ULL
+
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
+       perror("Error getting timestamp");
+       exit(EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+// Parses live=<ms>, returns 1 if the option was taken
+int live_stats_parse_option(int *interval_ms, const char *option) {
+    if (strncmp(option, "live=", 5) != 0) {
+        return 0;
+    }
+    *interval_ms = atoi(option + 5);
+    if (*interval_ms < 1) {
+        fprintf(stderr, "Invalid %s, must be a period in ms\n", option);
+        exit(EXIT_FAILURE);
+    }
+    return 1;
+}
+
+// bytes of the block live_stats_init() lays the stats out in
+size_t live_stats_size(int num_threads) {
+    return sizeof(live_stats) + (size_t) num_threads * sizeof(live_counters);
+}
+
+void live_stats_init(live_stats *live, int interval_ms, int num_threads) {
+    memset(live, 0, live_stats_size(num_threads));
+    live->interval_ms = interval_ms;
+    live->num_threads = num_threads;
+    live->threads = (live_counters*) (live + 1);
+}
+
+// accounts one operation of a worker that ran from begin to end, nothing when live is NULL
+void live_stats_add(live_stats *live, int thread, uint64_t begin, uint64_t end) {
+    live_counters *c;
+    uint64_t latency = end - begin, max;
+
+    if (live == NULL) {
+        return;
+    }
+    c = &live->threads[thread];
+    __atomic_fetch_add(&c->ops, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->latency_sum, latency, __ATOMIC_RELAXED);
+    max = __atomic_load_n(&c->latency_max, __ATOMIC_RELAXED);
+    while (latency > max && !__atomic_compare_exchange_n(&c->latency_max, &max, latency, 0,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/*
+ Prints what the workers completed since the previous line and clears it:
+   live,<now_ns>,<ops>,<latency_sum_ns>,<latency_max_ns>
+ now_ns is CLOCK_MONOTONIC, so that ./coord bins the line with the spans of
+ the debug output. An operation completing while the counters are drained
+ may have its latency in the next line.
+*/
+static void print_live(live_stats *live) {
+    uint64_t ops = 0, sum = 0, max = 0, m;
+
+    for (int t = 0; t < live->num_threads; t++) {
+        ops += __atomic_exchange_n(&live->threads[t].ops, 0, __ATOMIC_RELAXED);
+        sum += __atomic_exchange_n(&live->threads[t].latency_sum, 0, __ATOMIC_RELAXED);
+        m = __atomic_exchange_n(&live->threads[t].latency_max, 0, __ATOMIC_RELAXED);
+        max = m > max ? m : max;
+    }
+    printf("live,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", stamp(), ops, sum, max);
+    fflush(stdout);
+}
+
+static void *reporter(void *arg) {
+    live_stats *live = (live_stats*) arg;
+    uint64_t next = stamp();
+    struct timespec when;
+
+    while (1) {
+        next += live->interval_ms * 1000000ULL;
+        when.tv_sec = next / NSEC;
+        when.tv_nsec = next % NSEC;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, NULL) == EINTR);
+        if (__atomic_load_n(&live->stop, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        print_live(live);
+    }
+    return NULL;
+}
+
+// Starts printing a live line every interval, before the workers start
+void live_stats_start(live_stats *live) {
+    if (live != NULL) {
+        live->stop = 0;
+        pthread_create(&live->reporter, NULL, reporter, live);
+    }
+}
+
+// Stops the live lines once the workers are done, printing what is left
+void live_stats_stop(live_stats *live) {
+    if (live != NULL) {
+        __atomic_store_n(&live->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(live->reporter, NULL);
+        print_live(live);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef LIVESTATS_H
+#define LIVESTATS_H
+
+#include <stddef.h> //size_t
+#include <stdint.h> //uint64_t
+#include <pthread.h>
+
+// Operations one worker completed since the last live line
+typedef struct live_counters {
+    uint64_t ops;
+    uint64_t latency_sum;
+    uint64_t latency_max;
+} live_counters;
+
+// Lives in one block of live_stats_size() bytes (shared memory in process
+// mode): the header, then the counters of every worker, each added to by its
+// worker only and drained by the reporter thread of the parent.
+typedef struct live_stats {
+    int interval_ms;
+    int num_threads;
+    int stop;
+    pthread_t reporter;
+    live_counters *threads;
+} live_stats;
+
+int live_stats_parse_option(int *interval_ms, const char *option);
+size_t live_stats_size(int num_threads);
+void live_stats_init(live_stats *live, int interval_ms, int num_threads);
+void live_stats_add(live_stats *live, int thread, uint64_t begin, uint64_t end);
+void live_stats_start(live_stats *live);
+void live_stats_stop(live_stats *live);
+
+#endif
@@ -0,0 +1,287 @@
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <stdint.h> //uint64_t
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "hist.h"
+#include "workers.h"
+#include "slowlog.h"
+
+#define ACCESS_PERMISSION 0777
+#define NSEC 1000000000ULL
+
+/*
+ File-lock contention: every worker opens each of <num_files> files
+ <path>.<n> itself and repeatedly locks a random one, holds the lock for
+ <hold_us> (busy wait, the critical section) and unlocks it.
+
+ Locks are taken with flock(LOCK_EX) (whole file), fcntl(F_SETLKW) or
+ fcntl(F_OFD_SETLKW) on a write byte range of <range_size> bytes. Worker w
+ locks [w * range_size * (100 - overlap) / 100, + range_size), so overlap 100
+ makes every worker contend for the same range and overlap 0 gives disjoint
+ ranges. flock ignores the range.
+
+ POSIX fcntl locks belong to the process, threads of one process never
+ block each other, so fcntl needs procs.
+*/
+
+enum lock_modes {
+    FLOCK,
+    POSIX,
+    OFD
+};
+
+typedef struct thread_load {
+    int thread_id;
+    int num_ops;
+    off_t range_start;
+    uint64_t handoffs;
+    hist acquire_latencies;
+} thread_load;
+
+int mode;
+int num_files;
+int num_workers;
+off_t range_size;
+int overlap;
+uint64_t hold_ns;
+char *path;
+// per file and worker, the last worker that acquired a lock overlapping the
+// range of that worker (num_files x num_workers), shared between the workers
+int *owners;
+pthread_barrier_t *start_barrier;
+// pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+// slow acquires with the context switches and faults of their thread, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
+       perror("Error getting timestamp");
+       exit(EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * 1000000000ULL) + tspec.tv_nsec;
+}
+
+/*
+ Takes or drops the lock of one file
+
+ Params:
+  - fd: descriptor of the file
+  - start: first byte of the range
+  - lock: 1 to lock, 0 to unlock
+
+ Errors: none
+ Returns: 0 on success, -1 with errno set on failure
+*/
+int set_lock(int fd, off_t start, int lock) {
+    struct flock fl;
+
+    if (mode == FLOCK) {
+        return flock(fd, lock ? LOCK_EX : LOCK_UN);
+    }
+    memset(&fl, 0, sizeof fl);
+    fl.l_type = lock ? F_WRLCK : F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = range_size;
+    return fcntl(fd, mode == OFD ? F_OFD_SETLKW : F_SETLKW, &fl);
+}
+
+// first byte of the range of a worker
+static off_t range_start_of(int worker) {
+    return worker * range_size * (100 - overlap) / 100;
+}
+
+// whether the locks of two workers exclude each other: always for flock, else when their ranges overlap
+static int ranges_overlap(int a, int b) {
+    off_t distance = range_start_of(a) - range_start_of(b);
+
+    return mode == FLOCK || (distance < 0 ? -distance : distance) < range_size;
+}
+
+static void* thread_init(void* args) {
+    thread_load* load = (thread_load*) args;
+    unsigned int seed = rand();
+    char filepath[256];
+    uint64_t begin, end;
+    slowlog_probe probe;
+    int *fds = malloc(num_files * sizeof(int));
+
+    for (int file = 0; file < num_files; ++file) {
+        snprintf(filepath, sizeof filepath, "%s.%d", path, file);
+        fds[file] = open(filepath, O_RDWR);
+        if (fds[file] < 0) {
+            fprintf(stderr, "Couldn't open %s: %s\n", filepath, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_barrier_wait(start_barrier);
+    for (int i = 0; i < load->num_ops; ++i) {
+        int file = rand_r(&seed) % num_files;
+
+        slowlog_begin(slow_log, &probe);
+        begin = stamp();
+        if (set_lock(fds[file], load->range_start, 1) != 0) {
+            fprintf(stderr, "Couldn't lock file %d in worker %d: %s\n", file, load->thread_id, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        end = stamp();
+        if (slow_log) {
+            snprintf(filepath, sizeof filepath, "%s.%d", path, file);
+            slowlog_end(slow_log, &probe, load->thread_id, "lock", filepath, load->range_start);
+        }
+        hist_add(&load->acquire_latencies, end - begin);
+
+        int *file_owners = &owners[file * num_workers];
+        int previous = __atomic_load_n(&file_owners[load->thread_id], __ATOMIC_RELAXED);
+        if (previous >= 0 && previous != load->thread_id) {
+            load->handoffs++;
+        }
+        for (int worker = 0; worker < num_workers; ++worker) {
+            if (ranges_overlap(worker, load->thread_id)) {
+                __atomic_store_n(&file_owners[worker], load->thread_id, __ATOMIC_RELAXED);
+            }
+        }
+        while (stamp() - end < hold_ns);
+
+        if (set_lock(fds[file], load->range_start, 0) != 0) {
+            fprintf(stderr, "Couldn't unlock file %d in worker %d: %s\n", file, load->thread_id, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int file = 0; file < num_files; ++file) {
+        close(fds[file]);
+    }
+    free(fds);
+    return NULL;
+}
+
+// To run, type: ./locks <path> <num_workers> <num_files> <ops_per_worker> flock|posix|ofd
+//                       <range_size> <overlap_pct> <hold_us> [threads|procs]
+//                       [slow=<us>] [slowtop=<K>] [slowcap=<N>]
+int main(int argc, char* argv[]) {
+    static const char *mode_names[] = { "flock", "posix", "ofd" };
+    char filepath[256];
+    uint64_t begin, wall, handoffs = 0;
+    hist total;
+
+    if (argc < 9) {
+        fprintf(stderr, "Usage: ./locks <path> <num_workers> <num_files> <ops_per_worker> flock|posix|ofd "
+                "<range_size> <overlap_pct> <hold_us> [threads|procs] [slow=<us>] [slowtop=<K>] [slowcap=<N>]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    path = argv[1];
+    num_workers = atoi(argv[2]);
+    num_files = atoi(argv[3]);
+    int ops_per_worker = atoi(argv[4]);
+
+    if (strcmp(argv[5], "flock") == 0) {
+        mode = FLOCK;
+    } else if (strcmp(argv[5], "posix") == 0) {
+        mode = POSIX;
+    } else if (strcmp(argv[5], "ofd") == 0) {
+        mode = OFD;
+    } else {
+        fprintf(stderr, "Invalid parameter %s, must be one of: flock, posix or ofd.\n", argv[5]);
+        exit(EXIT_FAILURE);
+    }
+
+    range_size = atol(argv[6]);
+    overlap = atoi(argv[7]);
+    hold_ns = strtoull(argv[8], NULL, 10) * 1000ULL;
+
+    slowlog_spec_init(&slow_spec);
+    for (int i = 9; i < argc; ++i) {
+        if (!workers_parse_option(&pool, argv[i]) && !slowlog_parse_option(&slow_spec, argv[i])) {
+            fprintf(stderr, "Invalid option %s, must be one of: threads, procs, slow=<us>, slowtop=<K> or slowcap=<N>.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (num_workers <= 0 || num_files <= 0 || ops_per_worker <= 0 || range_size <= 0 || overlap < 0 || overlap > 100) {
+        fprintf(stderr, "Need at least one worker, file, op and byte of range, and an overlap of 0 to 100.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (mode == POSIX && !pool.procs && num_workers > 1) {
+        fprintf(stderr, "POSIX fcntl locks don't exclude threads of one process, use procs.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int file = 0; file < num_files; ++file) {
+        snprintf(filepath, sizeof filepath, "%s.%d", path, file);
+        int fd = open(filepath, O_RDWR | O_CREAT, ACCESS_PERMISSION);
+        if (fd < 0) {
+            fprintf(stderr, "Couldn't create %s: %s\n", filepath, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+
+    srand(time(NULL));
+    workers_init(&pool, num_workers);
+    thread_load* load = (thread_load*) workers_calloc(&pool, num_workers, sizeof(thread_load));
+    owners = (int*) workers_calloc(&pool, (size_t) num_files * num_workers, sizeof(int));
+    start_barrier = (pthread_barrier_t*) workers_calloc(&pool, 1, sizeof(pthread_barrier_t));
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) workers_calloc(&pool, 1, slowlog_size(&slow_spec, num_workers));
+        slowlog_init(slow_log, &slow_spec, num_workers);
+    }
+    workers_barrier_init(&pool, start_barrier, num_workers + 1);
+    for (int i = 0; i < num_files * num_workers; ++i) {
+        owners[i] = -1;
+    }
+    for (int worker = 0; worker < num_workers; ++worker) {
+        load[worker].thread_id = worker;
+        load[worker].num_ops = ops_per_worker;
+        load[worker].range_start = range_start_of(worker);
+        hist_init(&load[worker].acquire_latencies);
+    }
+
+    workers_start(&pool, thread_init, load, sizeof(thread_load));
+    pthread_barrier_wait(start_barrier);
+    begin = stamp();
+    workers_join(&pool);
+    wall = stamp() - begin;
+
+    hist_init(&total);
+    for (int worker = 0; worker < num_workers; ++worker) {
+        hist_merge(&total, &load[worker].acquire_latencies);
+        handoffs += load[worker].handoffs;
+    }
+
+    // locks,<mode>,<workers>,<files>,<overlap>,<hold_us>,<ops>,<wall_ns>,<locks/s>,<handoffs>,<handoffs/s>,
+    // <acquire latency count,mean,p50,p90,p99,p99.9,max>
+    // A handoff is an acquire of a range whose previous acquirer, among the
+    // workers whose locks exclude it, was another worker.
+    printf("locks,%s,%d,%d,%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.1f,%" PRIu64 ",%.1f,", mode_names[mode],
+            num_workers, num_files, overlap, hold_ns / 1000, total.count, wall, total.count * (double) NSEC / wall,
+            handoffs, handoffs * (double) NSEC / wall);
+    hist_print_csv(stdout, &total);
+    printf("\n");
+    slowlog_print(stdout, slow_log);
+
+    for (int file = 0; file < num_files; ++file) {
+        snprintf(filepath, sizeof filepath, "%s.%d", path, file);
+        unlink(filepath);
+    }
+    return EXIT_SUCCESS;
+}
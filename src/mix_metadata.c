@@ -15,6 +15,12 @@
 #define __STDC_FORMAT_MACRO
 #include <inttypes.h>
 
+#include "perfctr.h"
+#include "workers.h"
+#include "slowlog.h"
+#include "report.h"
+#include "livestats.h"
+
 #define ACCESS_PERMISSION 0777
 #define NSEC 1000000000ULL
 
@@ -24,24 +30,42 @@ typedef struct latencies {
     uint64_t* unlink;
 } latencies;
 
+enum ops{
+    CREATE, 
+    STAT, 
+    UNLINK,
+    NUM_OPS
+};
+
 typedef struct thread_load {
     int thread_id;
     char *root_path;
     int mix_load;
     int offset;
+    uint64_t num_mixes;
+    // one counter set per operation class, NULL unless counting events
+    perf_counters *counters;
+    // latencies of each operation class, for the JSON report
+    report_thread results[NUM_OPS];
 } thread_load;
 
-enum ops{
-    CREATE, 
-    STAT, 
-    UNLINK
-};
-
 latencies op_based_latencies;
 latencies time_based_latencies;
 
 int detailed_latency;
 int time_based;
+int count_events;
+// pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+// slow operations with the context switches and faults of their thread, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+// JSON report of the run, NULL when disabled
+const char *json_path;
+// operations completed every live=<ms>, printed during the run for ./coord, NULL when disabled
+live_stats *live;
+
+static const char *op_names[NUM_OPS] = { "create", "stat", "unlink" };
 
 /*
  Gets the mean of an array
@@ -83,12 +107,16 @@ static uint64_t stamp (void) {
  Params:
   - root_path: Path where the operations will occur
   - filename: identification of the file in which the operations will occur
+  - thread_id: Thread identification
+  - counters: perf counters of each operation class, or NULL
+  - results: results of each operation class
 
  Errors: It fails and exits the program if one of the operations can't be made
  Returns: Array containing each latency measured [create, stat, unlink]
 */
-uint64_t * issue_mix(char *root_path, char * filename) {
+uint64_t * issue_mix(char *root_path, char * filename, int thread_id, perf_counters *counters, report_thread *results) {
     uint64_t begin, end;
+    slowlog_probe probe;
     uint64_t * latencies = (uint64_t*) calloc(3, sizeof(uint64_t));
     
     struct stat st;
@@ -97,6 +125,11 @@ uint64_t * issue_mix(char *root_path, char * filename) {
 
     sprintf(dst_path, "%s/%s", root_path, filename);
 
+    if (counters) {
+        perf_counters_enable(&counters[CREATE]);
+    }
+
+    slowlog_begin(slow_log, &probe);
     begin = stamp();
 
     if (0 != mknod(dst_path, S_IFREG | ACCESS_PERMISSION, 0)) {
@@ -105,8 +138,20 @@ uint64_t * issue_mix(char *root_path, char * filename) {
     } else {
         end = stamp();
         latencies[CREATE] = (end - begin);
+        report_thread_add(&results[CREATE], begin, end, 0);
+        live_stats_add(live, thread_id, begin, end);
+    }
+    slowlog_end(slow_log, &probe, thread_id, "create", dst_path, -1);
+
+    if (counters) {
+        perf_counters_disable(&counters[CREATE]);
+    }
+
+    if (counters) {
+        perf_counters_enable(&counters[STAT]);
     }
 
+    slowlog_begin(slow_log, &probe);
     begin = stamp();
 
     if (stat(dst_path, &st) != 0) {
@@ -115,8 +160,20 @@ uint64_t * issue_mix(char *root_path, char * filename) {
     } else {
         end = stamp();
         latencies[STAT] = (end - begin);
+        report_thread_add(&results[STAT], begin, end, 0);
+        live_stats_add(live, thread_id, begin, end);
+    }
+    slowlog_end(slow_log, &probe, thread_id, "stat", dst_path, -1);
+
+    if (counters) {
+        perf_counters_disable(&counters[STAT]);
+    }
+
+    if (counters) {
+        perf_counters_enable(&counters[UNLINK]);
     }
 
+    slowlog_begin(slow_log, &probe);
     begin = stamp();
 
     if (unlink(dst_path) != 0) {
@@ -125,6 +182,13 @@ uint64_t * issue_mix(char *root_path, char * filename) {
     } else {
         end = stamp();
         latencies[UNLINK] = (end - begin);
+        report_thread_add(&results[UNLINK], begin, end, 0);
+        live_stats_add(live, thread_id, begin, end);
+    }
+    slowlog_end(slow_log, &probe, thread_id, "unlink", dst_path, -1);
+
+    if (counters) {
+        perf_counters_disable(&counters[UNLINK]);
     }
     
     return latencies;
@@ -138,11 +202,14 @@ uint64_t * issue_mix(char *root_path, char * filename) {
   - num_mixes: Number of mixes to be issued
   - offset: It determines where the thread should write in the array of latencies
   - thread_id: Thread identification
+  - counters: perf counters of each operation class, or NULL
+  - results: results of each operation class
 
  Errors: It fails and exits the program if one of the operations can't be made
  Returns: none
 */
-void issue_operation_based_mixes(char *root_path, int num_mixes, int offset, int thread_id) {
+void issue_operation_based_mixes(char *root_path, int num_mixes, int offset, int thread_id, perf_counters *counters,
+        report_thread *results) {
     int mix;
     char * filename = (char*) calloc(256, sizeof(char));
     uint64_t * latencies;
@@ -150,7 +217,7 @@ void issue_operation_based_mixes(char *root_path, int num_mixes, int offset, int
     for (mix = 0; mix < num_mixes; ++mix) {
         snprintf(filename, sizeof filename, "mix-%d-%d", thread_id, mix);
 
-        latencies = issue_mix(root_path, filename);
+        latencies = issue_mix(root_path, filename, thread_id, counters, results);
         op_based_latencies.create[mix+offset] = latencies[CREATE];
         op_based_latencies.stat[mix+offset] = latencies[STAT];
         op_based_latencies.unlink[mix+offset] = latencies[UNLINK];
@@ -164,11 +231,14 @@ void issue_operation_based_mixes(char *root_path, int num_mixes, int offset, int
   - root_path: Path where the operation will occur
   - user_defined_runtime: Time in which the mixes will be issued
   - thread_id: Thread identification
+  - counters: perf counters of each operation class, or NULL
+  - results: results of each operation class
 
  Errors: none
- Returns: none
+ Returns: Number of mixes issued
 */
-void issue_time_based_mixes(char *root_path, uint64_t user_defined_runtime, int thread_id) {
+uint64_t issue_time_based_mixes(char *root_path, uint64_t user_defined_runtime, int thread_id, perf_counters *counters,
+        report_thread *results) {
     uint64_t curr_runtime = 0;
     uint64_t user_defined_runtime_ns = user_defined_runtime * NSEC;
 
@@ -182,7 +252,7 @@ void issue_time_based_mixes(char *root_path, uint64_t user_defined_runtime, int
     while(curr_runtime < user_defined_runtime_ns) {
         snprintf(filename, sizeof filename, "mix-%d-%ld", thread_id, creates);
 
-        latencies = issue_mix(root_path, filename);
+        latencies = issue_mix(root_path, filename, thread_id, counters, results);
 
         create_latencies += latencies[CREATE];
         stat_latencies += latencies[STAT];
@@ -198,6 +268,8 @@ void issue_time_based_mixes(char *root_path, uint64_t user_defined_runtime, int
     time_based_latencies.create[thread_id] = create_latencies/creates;
     time_based_latencies.stat[thread_id] = stat_latencies/stats;
     time_based_latencies.unlink[thread_id] = unlink_latencies/unlinks;
+
+    return creates;
 }
 
 /*
@@ -212,10 +284,27 @@ void issue_time_based_mixes(char *root_path, uint64_t user_defined_runtime, int
 static void* thread_init(void* args) {
     thread_load* load = (thread_load*) args;
 
+    if (load->counters) {
+        for (int op = 0; op < NUM_OPS; ++op) {
+            if (perf_counters_open(&load->counters[op]) < 0) {
+                perror("No perf events available");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
     if (time_based) {
-        issue_time_based_mixes(load->root_path, load->mix_load, load->thread_id);
+        load->num_mixes = issue_time_based_mixes(load->root_path, load->mix_load, load->thread_id, load->counters, load->results);
     } else {
-        issue_operation_based_mixes(load->root_path, load->mix_load, load->offset, load->thread_id);
+        issue_operation_based_mixes(load->root_path, load->mix_load, load->offset, load->thread_id, load->counters, load->results);
+        load->num_mixes = load->mix_load;
+    }
+
+    if (load->counters) {
+        for (int op = 0; op < NUM_OPS; ++op) {
+            perf_counters_read(&load->counters[op]);
+            perf_counters_close(&load->counters[op]);
+        }
     }
 
     return NULL;
@@ -252,6 +341,79 @@ void print_latencies(struct latencies latencies_out, int size) {
     }
 }
 
+/*
+ Prints the perf counters per operation, one line per operation class:
+   perf,<create|stat|unlink>,ops,cycles,instructions,llc-misses,cs,faults,migrations
+
+ Params:
+  - load: thread loads
+  - num_threads: number of threads
+
+ Errors: none
+ Returns: none
+*/
+void print_counters(thread_load *load, int num_threads) {
+    perf_counters total;
+    uint64_t total_mixes = 0;
+
+    for (int thread = 0; thread < num_threads; ++thread) {
+        total_mixes += load[thread].num_mixes;
+    }
+    for (int op = 0; op < NUM_OPS; ++op) {
+        memset(&total, 0, sizeof(total));
+        for (int thread = 0; thread < num_threads; ++thread) {
+            perf_counters_merge(&total, &load[thread].counters[op]);
+        }
+        printf("perf,%s,%" PRIu64 ",", op_names[op], total_mixes);
+        perf_counters_print_csv(stdout, &total, total_mixes);
+        printf("\n");
+    }
+}
+
+/*
+ Writes the JSON report of the run: the arguments, the environment and one
+ group of results per operation class
+
+ Params:
+  - json: report file, - for stdout
+  - path: directory of the mixes
+  - mix_load: seconds (time-based) or mixes per thread (no-time)
+  - num_threads: number of threads
+  - load: thread loads
+  - argc, argv: command line
+
+ Errors: It fails and exits the program if the report can't be created
+ Returns: none
+*/
+void write_report(const char *json, const char *path, int mix_load, int num_threads, thread_load *load, int argc, char **argv) {
+    report_thread* threads = (report_thread*) calloc(num_threads, sizeof(report_thread));
+    report r;
+
+    report_open(&r, json);
+    report_string(&r, "tool", "mix_metadata");
+    report_uint(&r, "format", 1);
+    report_begin_object(&r, "config");
+    report_args(&r, argc, argv);
+    report_string(&r, "path", path);
+    report_uint(&r, time_based ? "runtime_s" : "mixes", mix_load);
+    report_uint(&r, "threads", num_threads);
+    report_string(&r, "workers", pool.procs ? "procs" : "threads");
+    report_end_object(&r);
+    report_environment(&r, &path, 1);
+    report_begin_object(&r, "results");
+    report_begin_array(&r, "groups", 0);
+    for (int op = 0; op < NUM_OPS; ++op) {
+        for (int thread = 0; thread < num_threads; ++thread) {
+            threads[thread] = load[thread].results[op];
+        }
+        report_op_group(&r, op_names[op], threads, num_threads, NULL);
+    }
+    report_end_array(&r);
+    report_end_object(&r);
+    report_close(&r);
+    free(threads);
+}
+
 /*
  Evaluates whether the input is one of the two options given in the params
  
@@ -277,7 +439,7 @@ int parse_bool_flag(char * input, char * first_op, char * second_op) {
 
 int main(int argc, char* argv[]) {
     if (argc < 6) {
-        fprintf(stderr, "Usage: ./mix_metadata <path> <load_per_thread> <num_threads> full-lat|res-lat time-based|no-time\n");
+        fprintf(stderr, "Usage: ./mix_metadata <path> <load_per_thread> <num_threads> full-lat|res-lat time-based|no-time [perf] [threads|procs] [slow=<us>] [slowtop=<K>] [slowcap=<N>] [json=<file>] [live=<ms>]\n");
         exit(EXIT_FAILURE);
     }
 
@@ -291,17 +453,46 @@ int main(int argc, char* argv[]) {
     detailed_latency = parse_bool_flag(argv[4], "full-lat", "res-lat");
     // Whether the operations will take place in a time defined by the user
     time_based = parse_bool_flag(argv[5], "time-based", "no-time");
+    // Optional: perf, to count events of each operation class, threads|procs, slow=<us>, slowtop=<K>, slowcap=<N>,
+    // json=<file> for a report ./compare reads, and live=<ms> for the interval lines ./coord streams
+    int live_interval_ms = 0;
+    count_events = 0;
+    json_path = NULL;
+    slowlog_spec_init(&slow_spec);
+    for (int i = 6; i < argc; ++i) {
+        if (strcmp(argv[i], "perf") == 0) {
+            count_events = 1;
+        } else if (strncmp(argv[i], "json=", 5) == 0) {
+            json_path = argv[i] + 5;
+        } else if (slowlog_parse_option(&slow_spec, argv[i])) {
+            continue;
+        } else if (live_stats_parse_option(&live_interval_ms, argv[i])) {
+            continue;
+        } else if (!workers_parse_option(&pool, argv[i])) {
+            fprintf(stderr, "Invalid option %s, must be one of: perf, threads, procs, slow=<us>, slowtop=<K>, slowcap=<N>, json=<file> or live=<ms>.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    thread_load* load = (thread_load*) malloc(num_threads * sizeof(struct thread_load));
+    workers_init(&pool, num_threads);
+    thread_load* load = (thread_load*) workers_calloc(&pool, num_threads, sizeof(struct thread_load));
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) workers_calloc(&pool, 1, slowlog_size(&slow_spec, num_threads));
+        slowlog_init(slow_log, &slow_spec, num_threads);
+    }
+    if (live_interval_ms > 0) {
+        live = (live_stats*) workers_calloc(&pool, 1, live_stats_size(num_threads));
+        live_stats_init(live, live_interval_ms, num_threads);
+    }
 
     if (time_based) {
-        time_based_latencies.create = (uint64_t*) calloc(num_threads, sizeof(uint64_t));
-        time_based_latencies.stat = (uint64_t*) calloc(num_threads, sizeof(uint64_t));
-        time_based_latencies.unlink = (uint64_t*) calloc(num_threads, sizeof(uint64_t));
+        time_based_latencies.create = (uint64_t*) workers_calloc(&pool, num_threads, sizeof(uint64_t));
+        time_based_latencies.stat = (uint64_t*) workers_calloc(&pool, num_threads, sizeof(uint64_t));
+        time_based_latencies.unlink = (uint64_t*) workers_calloc(&pool, num_threads, sizeof(uint64_t));
     } else {
-        op_based_latencies.create = (uint64_t*) calloc(mix_load * num_threads, sizeof(uint64_t));
-        op_based_latencies.stat = (uint64_t*) calloc(mix_load * num_threads, sizeof(uint64_t));
-        op_based_latencies.unlink = (uint64_t*) calloc(mix_load * num_threads, sizeof(uint64_t));
+        op_based_latencies.create = (uint64_t*) workers_calloc(&pool, mix_load * num_threads, sizeof(uint64_t));
+        op_based_latencies.stat = (uint64_t*) workers_calloc(&pool, mix_load * num_threads, sizeof(uint64_t));
+        op_based_latencies.unlink = (uint64_t*) workers_calloc(&pool, mix_load * num_threads, sizeof(uint64_t));
     }
 
     for (int thread = 0; thread < num_threads; ++thread) {
@@ -309,16 +500,16 @@ int main(int argc, char* argv[]) {
         load[thread].root_path = path;
         load[thread].mix_load = mix_load;
         load[thread].offset = (thread * mix_load);
+        load[thread].counters = count_events ? (perf_counters*) workers_calloc(&pool, NUM_OPS, sizeof(perf_counters)) : NULL;
+        for (int op = 0; op < NUM_OPS; ++op) {
+            report_thread_init(&load[thread].results[op]);
+        }
     }
 
-    pthread_t* requesters = (pthread_t*) malloc (num_threads * sizeof (pthread_t));
-    for (int thread = 0; thread < num_threads; ++thread) {
-        pthread_create(&requesters[thread], NULL, thread_init, (void *) &load[thread]);
-    }
-
-    for (int thread = 0; thread < num_threads; ++thread) {
-        pthread_join(requesters[thread], NULL);
-    }
+    live_stats_start(live);
+    workers_start(&pool, thread_init, load, sizeof(thread_load));
+    workers_join(&pool);
+    live_stats_stop(live);
 
     if (time_based) {
         print_latencies(time_based_latencies, num_threads);
@@ -326,5 +517,13 @@ int main(int argc, char* argv[]) {
         print_latencies(op_based_latencies, mix_load * num_threads);
     }
 
+    if (count_events) {
+        print_counters(load, num_threads);
+    }
+    slowlog_print(stdout, slow_log);
+    if (json_path != NULL) {
+        write_report(json_path, path, mix_load, num_threads, load, argc, argv);
+    }
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
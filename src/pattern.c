@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pattern.h"
+
+static uint64_t xorshift64(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+ Sets the default pattern: uninitialised buffers, as the benchmarks always did
+
+ Params:
+  - spec: pattern specification
+
+ Returns: none
+*/
+void pattern_spec_init(pattern_spec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->kind = PATTERN_UNINIT;
+    spec->compress = 1;
+    spec->dedupe = 1;
+    spec->pool_blocks = 16;
+}
+
+/*
+ Parses one pattern option of the command line
+
+ Accepted options:
+  - pattern=uninit|zero|random
+  - compress=<ratio> (e.g. 2 for data that compresses to half its size)
+  - dedupe=<ratio> (e.g. 4 for every block written four times)
+  - pool=<blocks> (pregenerated blocks per thread, default 16)
+  - unique (same as dedupe=1, every write gets content never written before)
+ Any of compress, dedupe and unique turns on random content.
+
+ Params:
+  - spec: pattern specification being built
+  - option: command line option
+
+ Errors: It fails and exits the program if the option value is invalid
+ Returns: 1 if the option was a pattern option, 0 otherwise
+*/
+int pattern_parse_option(pattern_spec *spec, const char *option) {
+    if (strcmp(option, "pattern=uninit") == 0) {
+        spec->kind = PATTERN_UNINIT;
+    } else if (strcmp(option, "pattern=zero") == 0) {
+        spec->kind = PATTERN_ZERO;
+    } else if (strcmp(option, "pattern=random") == 0) {
+        spec->kind = PATTERN_RANDOM;
+    } else if (strncmp(option, "compress=", 9) == 0) {
+        spec->compress = atof(option + 9);
+        spec->kind = PATTERN_RANDOM;
+    } else if (strncmp(option, "dedupe=", 7) == 0) {
+        spec->dedupe = atof(option + 7);
+        spec->kind = PATTERN_RANDOM;
+    } else if (strncmp(option, "pool=", 5) == 0) {
+        spec->pool_blocks = atoi(option + 5);
+    } else if (strcmp(option, "unique") == 0) {
+        spec->dedupe = 1;
+        spec->kind = PATTERN_RANDOM;
+    } else {
+        return 0;
+    }
+
+    if (spec->compress < 1 || spec->dedupe < 1 || spec->pool_blocks < 1) {
+        fprintf(stderr, "Invalid pattern option %s\n", option);
+        exit(EXIT_FAILURE);
+    }
+    return 1;
+}
+
+/*
+ Pregenerates the blocks of a pool. Each PATTERN_SEGMENT of a random block
+ starts with 1/compress random bytes followed by zeros, so block compressors
+ get close to the target ratio.
+
+ Params:
+  - pool: pool to be filled
+  - spec: pattern specification
+  - block_size: size of each write
+  - seed: random seed, different for each thread
+
+ Errors: It fails and exits the program if there is no memory left
+ Returns: none
+*/
+void pattern_init(pattern_pool *pool, const pattern_spec *spec, size_t block_size, uint64_t seed) {
+    size_t total, segment, random_bytes;
+    uint64_t state = seed * 2 + 1, value;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->spec = *spec;
+    pool->block_size = block_size;
+    pool->id = seed;
+
+    total = block_size * (size_t) spec->pool_blocks;
+    pool->blocks = (char*) aligned_alloc(PATTERN_SEGMENT, (total + PATTERN_SEGMENT - 1) / PATTERN_SEGMENT * PATTERN_SEGMENT);
+    if (pool->blocks == NULL) {
+        perror("Couldn't allocate pattern pool");
+        exit(EXIT_FAILURE);
+    }
+    memset(pool->blocks, 0, total);
+    if (spec->kind != PATTERN_RANDOM) {
+        return;
+    }
+
+    for (size_t block = 0; block < (size_t) spec->pool_blocks; block++) {
+        char *data = pool->blocks + block * block_size;
+        for (size_t start = 0; start < block_size; start += PATTERN_SEGMENT) {
+            segment = block_size - start < PATTERN_SEGMENT ? block_size - start : PATTERN_SEGMENT;
+            random_bytes = (size_t) (segment / spec->compress);
+            for (size_t i = 0; i < random_bytes; i += sizeof(value)) {
+                value = xorshift64(&state);
+                memcpy(data + start + i, &value, random_bytes - i < sizeof(value) ? random_bytes - i : sizeof(value));
+            }
+        }
+    }
+}
+
+/*
+ Gets the buffer of the next write. Every dedupe consecutive writes share
+ the same content. Random blocks have the content sequence number and the
+ pool id in the first 16 bytes of each segment, so no other content (of any
+ thread) is the same: the pool only saves generating the data, the dedupe
+ ratio comes from dedupe alone.
+
+ Params:
+  - pool: pool of the calling thread
+
+ Returns: The buffer to be written (block_size bytes)
+*/
+char *pattern_next(pattern_pool *pool) {
+    uint64_t content = (uint64_t) (pool->next++ / pool->spec.dedupe);
+    char *block = pool->blocks + (content % pool->spec.pool_blocks) * pool->block_size;
+    uint64_t stamp[2];
+
+    if (pool->spec.kind == PATTERN_RANDOM) {
+        for (size_t start = 0; start + sizeof(stamp) <= pool->block_size; start += PATTERN_SEGMENT) {
+            stamp[0] = content;
+            stamp[1] = (pool->id << 32) ^ (start / PATTERN_SEGMENT);
+            memcpy(block + start, stamp, sizeof(stamp));
+        }
+    }
+    return block;
+}
+
+/*
+ Copies the content of the next write into a buffer of the caller (e.g. one
+ of its buffer pool), before the write is timed
+
+ Params:
+  - pool: pool of the calling thread
+  - buf: buffer of block_size bytes
+
+ Returns: none
+*/
+void pattern_fill(pattern_pool *pool, char *buf) {
+    memcpy(buf, pattern_next(pool), pool->block_size);
+}
@@ -0,0 +1,39 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <stddef.h>
+#include <stdint.h> //uint64_t
+
+#define PATTERN_SEGMENT 4096
+
+enum pattern_kinds {
+    PATTERN_UNINIT,   // whatever malloc returned, the same buffer for every write
+    PATTERN_ZERO,
+    PATTERN_RANDOM
+};
+
+typedef struct pattern_spec {
+    int kind;
+    double compress;  // target compression ratio, 1 for incompressible data
+    double dedupe;    // target dedupe ratio, 1 for no duplicate blocks
+    int pool_blocks;  // pregenerated blocks rotated over the writes
+} pattern_spec;
+
+// Per-thread pool of pregenerated write buffers: the blocks are filled before
+// the measured phase and each write only picks the next one (and stamps a few
+// bytes of random content), so content generation never bounds the write rate.
+typedef struct pattern_pool {
+    pattern_spec spec;
+    char *blocks;
+    size_t block_size;
+    uint64_t id;
+    uint64_t next;
+} pattern_pool;
+
+void pattern_spec_init(pattern_spec *spec);
+int pattern_parse_option(pattern_spec *spec, const char *option);
+void pattern_init(pattern_pool *pool, const pattern_spec *spec, size_t block_size, uint64_t seed);
+char *pattern_next(pattern_pool *pool);
+void pattern_fill(pattern_pool *pool, char *buf);
+
+#endif
@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfctr.h"
+
+static const uint32_t event_types[PERF_NUM_EVENTS] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+    PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE, PERF_TYPE_SOFTWARE
+};
+
+static const uint64_t event_configs[PERF_NUM_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_COUNT_SW_PAGE_FAULTS, PERF_COUNT_SW_CPU_MIGRATIONS
+};
+
+/*
+ Opens one counter for the calling thread
+
+ Params:
+  - event: index of the event
+  - group_fd: leader of the group, -1 to open a new group
+
+ Returns: The counter descriptor, or -1 if the event is not available
+*/
+static int open_event(int event, int group_fd) {
+    struct perf_event_attr attr;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event_types[event];
+    attr.config = event_configs[event];
+    attr.disabled = (group_fd == -1);
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+    if (fd < 0) {
+        // unprivileged users may only count user space (perf_event_paranoid)
+        attr.exclude_kernel = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+    }
+    return fd;
+}
+
+/*
+ Opens the counter groups of one event range, skipping the events that fail
+
+ Returns: The group leader, or -1 if no event of the range could be opened
+*/
+static int open_group(perf_counters *pc, int first, int last, int *fds) {
+    int leader = -1;
+
+    for (int event = first; event <= last; event++) {
+        fds[event - first] = open_event(event, leader);
+        if (fds[event - first] >= 0) {
+            pc->available[event] = 1;
+            if (leader < 0) {
+                leader = fds[event - first];
+            }
+        }
+    }
+    return leader;
+}
+
+/*
+ Opens the counters of the calling thread, disabled
+
+ Params:
+  - pc: counters
+
+ Returns: 0 if at least one event is available, -1 otherwise
+*/
+int perf_counters_open(perf_counters *pc) {
+    memset(pc, 0, sizeof(*pc));
+    pc->hw_fd = open_group(pc, PERF_CYCLES, PERF_LLC_MISSES, pc->hw_fds);
+    pc->sw_fd = open_group(pc, PERF_CONTEXT_SWITCHES, PERF_CPU_MIGRATIONS, pc->sw_fds);
+    return (pc->hw_fd < 0 && pc->sw_fd < 0) ? -1 : 0;
+}
+
+void perf_counters_enable(perf_counters *pc) {
+    if (pc->hw_fd >= 0) {
+        ioctl(pc->hw_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    if (pc->sw_fd >= 0) {
+        ioctl(pc->sw_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+void perf_counters_disable(perf_counters *pc) {
+    if (pc->sw_fd >= 0) {
+        ioctl(pc->sw_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+    if (pc->hw_fd >= 0) {
+        ioctl(pc->hw_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+/*
+ Reads one group, scaling the values if the group was multiplexed
+*/
+static void read_group(perf_counters *pc, int leader, int first, int last, const int *fds) {
+    uint64_t data[3 + PERF_NUM_EVENTS];
+    int slot = 0;
+
+    if (leader < 0 || read(leader, data, sizeof(data)) <= 0) {
+        return;
+    }
+    // layout: nr, time_enabled, time_running, value of each opened event
+    for (int event = first; event <= last && slot < (int) data[0]; event++) {
+        if (fds[event - first] < 0) {
+            continue;
+        }
+        pc->values[event] = data[3 + slot++];
+        if (data[2] > 0 && data[2] < data[1]) {
+            pc->values[event] = (uint64_t) ((double) pc->values[event] * data[1] / data[2]);
+        }
+    }
+}
+
+/*
+ Reads the totals counted while the counters were enabled
+
+ Params:
+  - pc: counters
+
+ Returns: none
+*/
+void perf_counters_read(perf_counters *pc) {
+    read_group(pc, pc->hw_fd, PERF_CYCLES, PERF_LLC_MISSES, pc->hw_fds);
+    read_group(pc, pc->sw_fd, PERF_CONTEXT_SWITCHES, PERF_CPU_MIGRATIONS, pc->sw_fds);
+}
+
+void perf_counters_close(perf_counters *pc) {
+    for (int i = 0; i < 3; i++) {
+        if (pc->hw_fds[i] >= 0) {
+            close(pc->hw_fds[i]);
+        }
+        if (pc->sw_fds[i] >= 0) {
+            close(pc->sw_fds[i]);
+        }
+    }
+    pc->hw_fd = pc->sw_fd = -1;
+}
+
+/*
+ Adds the values of one thread's counters to another set
+
+ Params:
+  - dst: counters receiving the values
+  - src: counters being merged
+
+ Returns: none
+*/
+void perf_counters_merge(perf_counters *dst, const perf_counters *src) {
+    for (int event = 0; event < PERF_NUM_EVENTS; event++) {
+        dst->values[event] += src->values[event];
+        dst->available[event] |= src->available[event];
+    }
+}
+
+/*
+ Prints the counters per operation as CSV: cycles, instructions, LLC misses,
+ context switches, page faults and CPU migrations ("-" when not available)
+
+ Params:
+  - out: output stream
+  - pc: counters
+  - ops: number of operations counted
+
+ Returns: none
+*/
+void perf_counters_print_csv(FILE *out, const perf_counters *pc, uint64_t ops) {
+    for (int event = 0; event < PERF_NUM_EVENTS; event++) {
+        if (!pc->available[event] || ops == 0) {
+            fprintf(out, "%s-", event ? "," : "");
+        } else {
+            fprintf(out, "%s%.3f", event ? "," : "", (double) pc->values[event] / ops);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+#include <stdio.h>
+#include <stdint.h> //uint64_t
+
+enum perf_events {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_PAGE_FAULTS,
+    PERF_CPU_MIGRATIONS,
+    PERF_NUM_EVENTS
+};
+
+// Per-thread perf_event_open counters: a hardware group (cycles, instructions,
+// LLC misses) and a software group (context switches, page faults, CPU
+// migrations). The hardware group is optional, so VMs without a PMU still get
+// the software events.
+typedef struct perf_counters {
+    int hw_fd;
+    int sw_fd;
+    int hw_fds[3];
+    int sw_fds[3];
+    uint64_t values[PERF_NUM_EVENTS];
+    int available[PERF_NUM_EVENTS];
+} perf_counters;
+
+int perf_counters_open(perf_counters *pc);
+void perf_counters_enable(perf_counters *pc);
+void perf_counters_disable(perf_counters *pc);
+void perf_counters_read(perf_counters *pc);
+void perf_counters_close(perf_counters *pc);
+void perf_counters_merge(perf_counters *dst, const perf_counters *src);
+void perf_counters_print_csv(FILE *out, const perf_counters *pc, uint64_t ops);
+
+#endif
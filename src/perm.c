@@ -0,0 +1,63 @@
+#include "perm.h"
+
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ Sets up a permutation
+
+ Params:
+  - p: permutation
+  - size: number of elements to permute (e.g. blocks of a file)
+  - seed: key of the permutation, the same seed always gives the same order
+
+ Returns: none
+*/
+void perm_init(perm *p, uint64_t size, uint64_t seed) {
+    p->size = size;
+    p->half_bits = 1;
+    while (p->half_bits < 32 && (size - 1) >> (2 * p->half_bits) != 0) {
+        p->half_bits++;
+    }
+    p->half_mask = (p->half_bits == 32) ? 0xFFFFFFFFULL : (1ULL << p->half_bits) - 1;
+    for (int round = 0; round < PERM_ROUNDS; round++) {
+        p->keys[round] = splitmix64(&seed);
+    }
+}
+
+static uint64_t feistel(const perm *p, uint64_t value) {
+    uint64_t left = (value >> p->half_bits) & p->half_mask;
+    uint64_t right = value & p->half_mask;
+    uint64_t next, state;
+
+    for (int round = 0; round < PERM_ROUNDS; round++) {
+        state = right ^ p->keys[round];
+        next = left ^ (splitmix64(&state) & p->half_mask);
+        left = right;
+        right = next;
+    }
+    return (left << p->half_bits) | right;
+}
+
+/*
+ Gets the element at a position of the permutation
+
+ Params:
+  - p: permutation
+  - index: position, in [0, size)
+
+ Returns: The permuted element, in [0, size); every index maps to a different element
+*/
+uint64_t perm_at(const perm *p, uint64_t index) {
+    uint64_t value = feistel(p, index);
+
+    // the network permutes [0, 4^half_bits), walk the cycle back into [0, size)
+    while (value >= p->size) {
+        value = feistel(p, value);
+    }
+    return value;
+}
@@ -0,0 +1,21 @@
+#ifndef PERM_H
+#define PERM_H
+
+#include <stdint.h> //uint64_t
+
+#define PERM_ROUNDS 4
+
+// Pseudo-random permutation of [0, size) in constant memory: a balanced
+// Feistel network over the next even power of two, cycle-walking the values
+// that fall outside the range.
+typedef struct perm {
+    uint64_t size;
+    int half_bits;
+    uint64_t half_mask;
+    uint64_t keys[PERM_ROUNDS];
+} perm;
+
+void perm_init(perm *p, uint64_t size, uint64_t seed);
+uint64_t perm_at(const perm *p, uint64_t index);
+
+#endif
@@ -0,0 +1,261 @@
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <stdint.h> //uint64_t
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "hist.h"
+#include "workers.h"
+#include "profile.h"
+#include "slowlog.h"
+#include "blockio.h"
+
+#define ACCESS_PERMISSION 0777
+#define IDLE_POLL_NS 1000000ULL
+
+/*
+ Random reads and writes of <blksize> on one existing file, following a load
+ profile of phases (see profile.c) without restarting the workers: the
+ largest thread count of the profile is started once, and the workers
+ beyond the thread count of the current phase wait for the next one.
+
+ In a paced phase every active worker issues requests on a fixed schedule
+ (open loop) and latency is measured from the scheduled start, so time
+ spent behind schedule shows up as latency instead of a lower request rate.
+ A new phase starts a new schedule, the backlog of the previous one is dropped.
+*/
+
+// what the workers did in one phase
+typedef struct phase_stats {
+    uint64_t bytes;
+    uint64_t errors;
+    hist read_latencies;
+    hist write_latencies;
+} phase_stats;
+
+typedef struct thread_load {
+    int thread_id;
+    int fd;
+    unsigned int seed;
+    char *buf;
+    offsets where;
+    // one per phase
+    phase_stats *stats;
+} thread_load;
+
+// shared with the workers, written by the controller only
+typedef struct control {
+    int phase;              // -1 before the first phase, num_phases once done
+    uint64_t *phase_begin;  // num_phases + 1, each written once before its phase is published
+} control;
+
+profile prof;
+int blksize;
+long nblocks;
+control *ctl;
+// pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+// slow requests with the context switches and faults of their thread, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+
+// the phase being run and its begin, which the acquire of the phase makes visible
+static int current_phase(uint64_t *begin) {
+    int current = __atomic_load_n(&ctl->phase, __ATOMIC_ACQUIRE);
+
+    *begin = current >= 0 ? ctl->phase_begin[current] : 0;
+    return current;
+}
+
+/*
+ Issues one random read or write of the phase
+
+ Params:
+  - load: thread load
+  - ph: current phase
+  - stats: statistics of the current phase
+  - scheduled: when the request should start, 0 when not paced
+
+ Errors: none, failed requests are counted
+ Returns: none
+*/
+void issue_request(thread_load *load, const phase *ph, phase_stats *stats, uint64_t scheduled) {
+    off_t offset = (off_t) offsets_at(&load->where, 0);
+    int is_read = (int) (rand_r(&load->seed) % 100) < ph->read_pct;
+    uint64_t begin, end;
+    ssize_t ret;
+    slowlog_probe probe;
+
+    slowlog_begin(slow_log, &probe);
+    begin = stamp();
+    if (is_read) {
+        ret = pread(load->fd, load->buf, blksize, offset);
+    } else {
+        ret = pwrite(load->fd, load->buf, blksize, offset);
+    }
+    end = stamp();
+    slowlog_end(slow_log, &probe, load->thread_id, is_read ? "read" : "write", NULL, offset);
+
+    if (scheduled && scheduled < begin) {
+        begin = scheduled;
+    }
+    if (ret < 0) {
+        stats->errors++;
+        return;
+    }
+    stats->bytes += ret;
+    hist_add(is_read ? &stats->read_latencies : &stats->write_latencies, end - begin);
+}
+
+static void* thread_init(void* args) {
+    thread_load* load = (thread_load*) args;
+    uint64_t phase_begin, scheduled;
+    int current, last = -1;
+    pacer pace;
+
+    while ((current = current_phase(&phase_begin)) < prof.num_phases) {
+        const phase *ph;
+
+        if (current < 0 || load->thread_id >= prof.phases[current].threads) {
+            sleep_until(stamp() + IDLE_POLL_NS);
+            continue;
+        }
+        ph = &prof.phases[current];
+        if (current != last) {
+            pacer_init(&pace, ph->rate, load->thread_id, ph->threads, phase_begin, 0);
+            last = current;
+        }
+        // requests past the end of the phase wait for the next one
+        if (pacer_wait(&pace, phase_begin + ph->duration_ns, &scheduled)) {
+            issue_request(load, ph, &load->stats[current], ph->rate > 0 ? scheduled : 0);
+        }
+    }
+    return NULL;
+}
+
+/*
+ Prints every phase as it was run:
+   phase,<phase>,<seconds>,<target_rate>,<threads>,<read_pct>,<requests>,<requests/s>,<MB/s>,<errors>
+   phase-read,<phase>,<latency count,mean,p50,p90,p99,p99.9,max>
+   phase-write,<phase>,<latency count,mean,p50,p90,p99,p99.9,max>
+*/
+void print_phases(thread_load *load, uint64_t *phase_ns) {
+    for (int p = 0; p < prof.num_phases; ++p) {
+        const phase *ph = &prof.phases[p];
+        phase_stats total;
+        double seconds = phase_ns[p] / (double) NSEC;
+
+        memset(&total, 0, sizeof(total));
+        hist_init(&total.read_latencies);
+        hist_init(&total.write_latencies);
+        for (int thread = 0; thread < prof.max_threads; ++thread) {
+            total.bytes += load[thread].stats[p].bytes;
+            total.errors += load[thread].stats[p].errors;
+            hist_merge(&total.read_latencies, &load[thread].stats[p].read_latencies);
+            hist_merge(&total.write_latencies, &load[thread].stats[p].write_latencies);
+        }
+        uint64_t requests = total.read_latencies.count + total.write_latencies.count;
+
+        printf("phase,%d,%.3f,%.1f,%d,%d,%" PRIu64 ",%.1f,%.1f,%" PRIu64 "\n", p, seconds, ph->rate, ph->threads,
+                ph->read_pct, requests, requests / seconds, total.bytes / 1e6 / seconds, total.errors);
+        printf("phase-read,%d,", p);
+        hist_print_csv(stdout, &total.read_latencies);
+        printf("\nphase-write,%d,", p);
+        hist_print_csv(stdout, &total.write_latencies);
+        printf("\n");
+    }
+}
+
+// To run, type: ./phased <path> <blksize> <seconds>:<rate>:<threads>:<read_pct>[*<steps>][,...]|@<profile_file> [threads|procs]
+//                        [slow=<us>] [slowtop=<K>] [slowcap=<N>]
+int main(int argc, char* argv[]) {
+    struct stat st;
+    uint64_t begin;
+
+    if (argc < 4) {
+        fprintf(stderr, "Usage: ./phased <path> <blksize> <seconds>:<rate>:<threads>:<read_pct>[*<steps>][,...]|@<profile_file> "
+                "[threads|procs] [slow=<us>] [slowtop=<K>] [slowcap=<N>]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *path = argv[1];
+    blksize = atoi(argv[2]);
+    profile_parse(&prof, argv[3]);
+
+    slowlog_spec_init(&slow_spec);
+    for (int i = 4; i < argc; ++i) {
+        if (!workers_parse_option(&pool, argv[i]) && !slowlog_parse_option(&slow_spec, argv[i])) {
+            fprintf(stderr, "Invalid option %s, must be one of: threads, procs, slow=<us>, slowtop=<K> or slowcap=<N>.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int fd = open(path, O_RDWR | O_LARGEFILE, ACCESS_PERMISSION);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (blksize <= 0 || st.st_size < blksize) {
+        fprintf(stderr, "Need a block size and a file of at least one block.\n");
+        exit(EXIT_FAILURE);
+    }
+    nblocks = st.st_size / blksize;
+
+    srand(time(NULL));
+    workers_init(&pool, prof.max_threads);
+    thread_load* load = (thread_load*) workers_calloc(&pool, prof.max_threads, sizeof(thread_load));
+    ctl = (control*) workers_calloc(&pool, 1, sizeof(control));
+    ctl->phase_begin = (uint64_t*) workers_calloc(&pool, prof.num_phases + 1, sizeof(uint64_t));
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) workers_calloc(&pool, 1, slowlog_size(&slow_spec, prof.max_threads));
+        slowlog_init(slow_log, &slow_spec, prof.max_threads);
+    }
+    ctl->phase = -1;
+    for (int thread = 0; thread < prof.max_threads; ++thread) {
+        load[thread].thread_id = thread;
+        load[thread].fd = fd;
+        load[thread].seed = rand();
+        offsets_init(&load[thread].where, RANDOM_OFFSETS, nblocks * blksize, blksize, blksize, thread, prof.max_threads, rand());
+        load[thread].buf = (char*) malloc(blksize);
+        memset(load[thread].buf, 'x', blksize);
+        load[thread].stats = (phase_stats*) workers_calloc(&pool, prof.num_phases, sizeof(phase_stats));
+        for (int p = 0; p < prof.num_phases; ++p) {
+            hist_init(&load[thread].stats[p].read_latencies);
+            hist_init(&load[thread].stats[p].write_latencies);
+        }
+    }
+    profile_print(stdout, &prof);
+
+    uint64_t *phase_ns = (uint64_t*) calloc(prof.num_phases, sizeof(uint64_t));
+    workers_start(&pool, thread_init, load, sizeof(thread_load));
+
+    // the controller moves the workers through the phases
+    for (int p = 0; p <= prof.num_phases; ++p) {
+        begin = stamp();
+        if (p > 0) {
+            phase_ns[p - 1] = begin - ctl->phase_begin[p - 1];
+        }
+        ctl->phase_begin[p] = begin;
+        __atomic_store_n(&ctl->phase, p, __ATOMIC_RELEASE);
+        if (p < prof.num_phases) {
+            sleep_until(begin + prof.phases[p].duration_ns);
+        }
+    }
+    workers_join(&pool);
+
+    print_phases(load, phase_ns);
+    slowlog_print(stdout, slow_log);
+    close(fd);
+    return EXIT_SUCCESS;
+}
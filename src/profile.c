@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "profile.h"
+
+#define NSEC 1000000000ULL
+#define MAX_SPEC (64 * 1024)
+
+// one field of a phase: a number, or a range <from>-<to> spread over the steps
+typedef struct field {
+    double from;
+    double to;
+} field;
+
+static void parse_field(field *f, const char *text, const char *entry) {
+    char *end;
+
+    f->from = strtod(text, &end);
+    f->to = f->from;
+    if (*end == '-') {
+        f->to = strtod(end + 1, &end);
+    }
+    if (end == text || *end != '\0' || f->from < 0 || f->to < 0) {
+        fprintf(stderr, "Invalid field %s in phase %s\n", text, entry);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static double field_at(const field *f, int step, int steps) {
+    return steps > 1 ? f->from + (f->to - f->from) * step / (steps - 1) : f->from;
+}
+
+static void add_phase(profile *prof, int *capacity, phase ph) {
+    if (prof->num_phases == *capacity) {
+        *capacity = *capacity ? 2 * *capacity : 16;
+        prof->phases = (phase*) realloc(prof->phases, *capacity * sizeof(phase));
+    }
+    prof->phases[prof->num_phases++] = ph;
+    if (ph.threads > prof->max_threads) {
+        prof->max_threads = ph.threads;
+    }
+}
+
+/*
+ Expands one entry of the profile: <seconds>:<rate>:<threads>:<read_pct>[*<steps>]
+ With *<steps> the entry becomes <steps> phases of <seconds> each, and the
+ rate, threads or read_pct given as <from>-<to> move linearly between them.
+
+ Params:
+  - prof: profile being built
+  - capacity: allocated phases
+  - entry: entry text, modified
+
+ Errors: It fails and exits the program if the entry is invalid
+ Returns: none
+*/
+static void parse_entry(profile *prof, int *capacity, char *entry) {
+    char copy[256], *fields[4], *star, *save = NULL;
+    field seconds, rate, threads, read_pct;
+    int steps = 1, n = 0;
+
+    snprintf(copy, sizeof copy, "%s", entry);
+    if ((star = strchr(entry, '*')) != NULL) {
+        *star = '\0';
+        steps = atoi(star + 1);
+    }
+    for (char *tok = strtok_r(entry, ":", &save); tok != NULL && n < 4; tok = strtok_r(NULL, ":", &save)) {
+        fields[n++] = tok;
+    }
+    if (n != 4 || steps < 1 || strtok_r(NULL, ":", &save) != NULL) {
+        fprintf(stderr, "Invalid phase %s, must be <seconds>:<rate>:<threads>:<read_pct>[*<steps>]\n", copy);
+        exit(EXIT_FAILURE);
+    }
+    parse_field(&seconds, fields[0], copy);
+    parse_field(&rate, fields[1], copy);
+    parse_field(&threads, fields[2], copy);
+    parse_field(&read_pct, fields[3], copy);
+
+    for (int step = 0; step < steps; step++) {
+        phase ph;
+
+        ph.duration_ns = (uint64_t) (field_at(&seconds, step, steps) * NSEC);
+        ph.rate = field_at(&rate, step, steps);
+        ph.threads = (int) (field_at(&threads, step, steps) + 0.5);
+        ph.read_pct = (int) (field_at(&read_pct, step, steps) + 0.5);
+        if (ph.duration_ns == 0 || ph.threads < 1 || ph.read_pct > 100) {
+            fprintf(stderr, "Invalid phase %s, needs a duration, a thread and a read_pct up to 100\n", copy);
+            exit(EXIT_FAILURE);
+        }
+        add_phase(prof, capacity, ph);
+    }
+}
+
+/*
+ Parses a load profile: phases separated by commas, run in order without
+ restarting the workers. A spec starting with @ names a file with the
+ phases, separated by commas or newlines, # starting a comment.
+
+ Examples:
+  - 60:0:8:70 (one minute as fast as 8 threads can, 70% reads)
+  - 10:1000-10000:8:70*10 (rate ramp from 1000 to 10000 requests/s in 10 steps)
+  - 30:2000:4:100,5:0:32:0,60:2000:4:100 (write burst, then watch the recovery)
+
+ Params:
+  - prof: profile to fill
+  - spec: profile spec or @<file>
+
+ Errors: It fails and exits the program if the spec or its file is invalid
+ Returns: none
+*/
+void profile_parse(profile *prof, const char *spec) {
+    char *text, *save = NULL;
+    int capacity = 0;
+
+    memset(prof, 0, sizeof(*prof));
+    if (spec[0] == '@') {
+        FILE *f = fopen(spec + 1, "r");
+        size_t len, out = 0;
+        int comment = 0;
+
+        if (f == NULL) {
+            fprintf(stderr, "Couldn't open profile %s: %s\n", spec + 1, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        text = (char*) malloc(MAX_SPEC);
+        len = fread(text, 1, MAX_SPEC - 1, f);
+        fclose(f);
+        // drop comments and blanks, newlines separate phases as commas do
+        for (size_t i = 0; i < len; i++) {
+            if (text[i] == '#') {
+                comment = 1;
+            } else if (text[i] == '\n') {
+                comment = 0;
+                text[out++] = ',';
+            } else if (!comment && text[i] != ' ' && text[i] != '\t' && text[i] != '\r') {
+                text[out++] = text[i];
+            }
+        }
+        text[out] = '\0';
+    } else {
+        text = strdup(spec);
+    }
+
+    for (char *entry = strtok_r(text, ",", &save); entry != NULL; entry = strtok_r(NULL, ",", &save)) {
+        parse_entry(prof, &capacity, entry);
+    }
+    free(text);
+    if (prof->num_phases == 0) {
+        fprintf(stderr, "The profile %s has no phases\n", spec);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// duration of the whole profile
+uint64_t profile_duration(const profile *prof) {
+    uint64_t total = 0;
+
+    for (int i = 0; i < prof->num_phases; i++) {
+        total += prof->phases[i].duration_ns;
+    }
+    return total;
+}
+
+// profile-phase,<phase>,<start_s>,<seconds>,<rate>,<threads>,<read_pct> for every phase
+void profile_print(FILE *out, const profile *prof) {
+    uint64_t start = 0;
+
+    for (int i = 0; i < prof->num_phases; i++) {
+        const phase *ph = &prof->phases[i];
+
+        fprintf(out, "profile-phase,%d,%.3f,%.3f,%.1f,%d,%d\n", i, start / (double) NSEC,
+                ph->duration_ns / (double) NSEC, ph->rate, ph->threads, ph->read_pct);
+        start += ph->duration_ns;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h> //uint64_t
+
+// One phase of a load profile: <threads> workers issue requests for
+// <duration_ns>, paced to <rate> requests/s in total (0 for as fast as they
+// can), <read_pct>% of them reads.
+typedef struct phase {
+    uint64_t duration_ns;
+    double rate;
+    int threads;
+    int read_pct;
+} phase;
+
+typedef struct profile {
+    int num_phases;
+    int max_threads;
+    phase *phases;
+} profile;
+
+void profile_parse(profile *prof, const char *spec);
+uint64_t profile_duration(const profile *prof);
+void profile_print(FILE *out, const profile *prof);
+
+#endif
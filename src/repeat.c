@@ -0,0 +1,353 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h> //sqrt
+#include <sys/types.h>
+#include <stdint.h> //uint64_t
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "hist.h"
+#include "workload.h"
+
+#define NSEC 1000000000ULL
+#define MAX_METRICS 32
+#define MAX_RUNS 10000
+
+/*
+ Runs any workload of this repository several times and reports the mean,
+ standard deviation and 95% confidence interval of its metrics.
+
+ The metrics are taken from the standard output of the workload:
+  - last: every number of the last line with numbers (e.g. res-lat output of
+          stat, mix_metadata or smallfile)
+  - lat:<col>: every line has a latency in nanoseconds at column <col>
+          (0-based, e.g. full-lat output of stat); gives ops/s over the run
+          wall time and latency percentiles
+  - span:<begin_col>:<end_col>: every line has begin and end timestamps in
+          nanoseconds (e.g. debug output of rr, rw, seqr and seqw, columns 2
+          and 3); gives ops/s over the first begin to last end and latency
+          percentiles
+ The wall time of each run is always reported.
+*/
+
+typedef struct run_metrics {
+    int count;
+    char names[MAX_METRICS][32];
+    double values[MAX_METRICS];
+} run_metrics;
+
+metric_spec metrics_spec;
+
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
+       perror("Error getting timestamp");
+       exit(EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+/*
+ Gets the two-sided 95% critical value of Student's t distribution
+
+ Params:
+  - df: degrees of freedom
+
+ Returns: The critical value
+*/
+double t_critical(int df) {
+    static const double table[] = {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+
+    if (df <= 30) {
+        return table[df < 1 ? 1 : df];
+    } else if (df <= 40) {
+        return 2.021;
+    } else if (df <= 60) {
+        return 2.000;
+    } else if (df <= 120) {
+        return 1.980;
+    }
+    return 1.960;
+}
+
+/*
+ Drops the page, dentry and inode caches (needs root)
+
+ Params: none
+
+ Errors: It warns if the caches can't be dropped
+ Returns: none
+*/
+void drop_caches(void) {
+    int fd;
+
+    sync();
+    fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if (fd < 0 || write(fd, "3", 1) != 1) {
+        fprintf(stderr, "Couldn't drop caches: %s\n", strerror(errno));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void add_metric(run_metrics *metrics, const char *name, double value) {
+    if (metrics->count < MAX_METRICS) {
+        snprintf(metrics->names[metrics->count], sizeof metrics->names[0], "%s", name);
+        metrics->values[metrics->count++] = value;
+    }
+}
+
+/*
+ Runs the workload once and extracts its metrics
+
+ Params:
+  - workload: argv of the workload
+  - metrics: filled with the metrics of the run
+
+ Errors: It fails and exits the program if the workload can't be run or fails
+ Returns: none
+*/
+void run_workload(char **workload, run_metrics *metrics) {
+    static hist latencies;
+    double numbers[MAX_METRICS], last[MAX_METRICS];
+    int out_fd, num_last = 0, count;
+    int begin_col = metrics_spec.columns[0], end_col = metrics_spec.columns[1];
+    uint64_t begin, end, first_begin = UINT64_MAX, last_end = 0;
+    char *line = NULL, *copy;
+    size_t line_size = 0;
+    FILE *out;
+    pid_t pid;
+
+    hist_init(&latencies);
+    memset(metrics, 0, sizeof(*metrics));
+
+    begin = stamp();
+    pid = workload_spawn(workload, &out_fd);
+
+    out = fdopen(out_fd, "r");
+    while (getline(&line, &line_size, out) >= 0) {
+        copy = strdup(line);
+        count = parse_numbers(copy, numbers, MAX_METRICS);
+        free(copy);
+        if (count == 0) {
+            continue;
+        }
+        if (metrics_spec.source == METRIC_LAST) {
+            memcpy(last, numbers, count * sizeof(double));
+            num_last = count;
+        } else if (metrics_spec.source == METRIC_LATENCY && count > begin_col) {
+            hist_add(&latencies, (uint64_t) numbers[begin_col]);
+        } else if (metrics_spec.source == METRIC_SPAN && count > begin_col && count > end_col
+                && numbers[end_col] >= numbers[begin_col]) {
+            hist_add(&latencies, (uint64_t) (numbers[end_col] - numbers[begin_col]));
+            if ((uint64_t) numbers[begin_col] < first_begin) {
+                first_begin = (uint64_t) numbers[begin_col];
+            }
+            if ((uint64_t) numbers[end_col] > last_end) {
+                last_end = (uint64_t) numbers[end_col];
+            }
+        }
+    }
+    free(line);
+    fclose(out);
+
+    if (workload_wait(pid) != 0) {
+        fprintf(stderr, "Workload %s failed\n", workload[0]);
+        exit(EXIT_FAILURE);
+    }
+    end = stamp();
+
+    add_metric(metrics, "wall_s", (end - begin) / (double) NSEC);
+    if (metrics_spec.source == METRIC_LAST) {
+        for (int i = 0; i < num_last; i++) {
+            char name[16];
+            snprintf(name, sizeof name, "f%d", i);
+            add_metric(metrics, name, last[i]);
+        }
+    } else {
+        double span_s = (metrics_spec.source == METRIC_SPAN && last_end > first_begin)
+            ? (last_end - first_begin) / (double) NSEC : (end - begin) / (double) NSEC;
+        add_metric(metrics, "ops_s", latencies.count / span_s);
+        add_metric(metrics, "mean_ns", hist_mean(&latencies));
+        add_metric(metrics, "p50_ns", hist_percentile(&latencies, 50));
+        add_metric(metrics, "p99_ns", hist_percentile(&latencies, 99));
+        add_metric(metrics, "p999_ns", hist_percentile(&latencies, 99.9));
+    }
+}
+
+/*
+ Computes the mean and the 95% confidence interval half-width of a metric
+
+ Params:
+  - runs: metrics of every run
+  - num_runs: number of runs
+  - metric: index of the metric
+  - mean, stddev, half_width: filled with the statistics
+
+ Returns: none
+*/
+void metric_stats(run_metrics *runs, int num_runs, int metric, double *mean, double *stddev, double *half_width) {
+    double sum = 0, squares = 0;
+
+    for (int run = 0; run < num_runs; run++) {
+        sum += runs[run].values[metric];
+    }
+    *mean = sum / num_runs;
+    for (int run = 0; run < num_runs; run++) {
+        squares += (runs[run].values[metric] - *mean) * (runs[run].values[metric] - *mean);
+    }
+    *stddev = num_runs > 1 ? sqrt(squares / (num_runs - 1)) : 0;
+    *half_width = num_runs > 1 ? t_critical(num_runs - 1) * *stddev / sqrt(num_runs) : 0;
+}
+
+/*
+ Checks whether every metric's confidence interval is narrow enough
+
+ Params:
+  - runs: metrics of every run
+  - num_runs: number of runs
+  - target_pct: maximum half-width, in percent of the mean
+
+ Returns: 1 if every interval is within the target, 0 otherwise
+*/
+int converged(run_metrics *runs, int num_runs, double target_pct) {
+    double mean, stddev, half_width;
+
+    if (num_runs < 2) {
+        return 0;
+    }
+    for (int metric = 0; metric < runs[0].count; metric++) {
+        metric_stats(runs, num_runs, metric, &mean, &stddev, &half_width);
+        if (mean != 0 && 100.0 * half_width / fabs(mean) > target_pct) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ Prints the metrics of every run, followed by their statistics:
+   run,<i>,<metric>,...
+   <metric>,<runs>,<mean>,<stddev>,<ci95_low>,<ci95_high>,<ci95_half_width_pct>
+
+ Params:
+  - runs: metrics of every run
+  - num_runs: number of runs
+
+ Returns: none
+*/
+void print_stats(run_metrics *runs, int num_runs) {
+    double mean, stddev, half_width;
+
+    printf("run");
+    for (int metric = 0; metric < runs[0].count; metric++) {
+        printf(",%s", runs[0].names[metric]);
+    }
+    printf("\n");
+    for (int run = 0; run < num_runs; run++) {
+        printf("%d", run);
+        for (int metric = 0; metric < runs[0].count; metric++) {
+            printf(",%g", runs[run].values[metric]);
+        }
+        printf("\n");
+    }
+
+    printf("metric,runs,mean,stddev,ci95_low,ci95_high,ci95_pct\n");
+    for (int metric = 0; metric < runs[0].count; metric++) {
+        metric_stats(runs, num_runs, metric, &mean, &stddev, &half_width);
+        printf("%s,%d,%g,%g,%g,%g,%.2f\n", runs[0].names[metric], num_runs, mean, stddev,
+                mean - half_width, mean + half_width, mean != 0 ? 100.0 * half_width / fabs(mean) : 0);
+    }
+}
+
+// To run, type: ./repeat <runs> <max_runs> <ci_target_pct> <time_budget_s> last|lat:<col>|span:<begin>:<end>
+//                        drop-caches|no-drop <prepare_cmd>|- -- <workload> [args...]
+int main(int argc, char* argv[]) {
+    if (argc < 10 || strcmp(argv[8], "--") != 0) {
+        fprintf(stderr, "Usage: ./repeat <runs> <max_runs> <ci_target_pct> <time_budget_s> "
+                "last|lat:<col>|span:<begin>:<end> drop-caches|no-drop <prepare_cmd>|- -- <workload> [args...]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Minimum number of runs
+    int min_runs = atoi(argv[1]);
+    // Runs keep going past min_runs until the CI target is met, up to max_runs
+    int max_runs = atoi(argv[2]);
+    // Target 95% CI half-width, in percent of the mean (0 to disable)
+    double ci_target = atof(argv[3]);
+    // No new run is started once this many seconds passed (0 to disable)
+    uint64_t time_budget_ns = (uint64_t) (atof(argv[4]) * NSEC);
+    char *prepare = strcmp(argv[7], "-") == 0 ? NULL : argv[7];
+    int reset_caches;
+    uint64_t start;
+
+    if (!metric_spec_parse(&metrics_spec, argv[5])
+            || (metrics_spec.source == METRIC_LATENCY && metrics_spec.num_columns != 1)) {
+        fprintf(stderr, "Invalid metrics %s, must be one of: last, lat:<col> or span:<begin>:<end>.\n", argv[5]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (strcmp(argv[6], "drop-caches") == 0) {
+        reset_caches = 1;
+    } else if (strcmp(argv[6], "no-drop") == 0) {
+        reset_caches = 0;
+    } else {
+        fprintf(stderr, "Invalid parameter %s, must be one of: drop-caches or no-drop.\n", argv[6]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (min_runs < 1 || max_runs > MAX_RUNS) {
+        fprintf(stderr, "The number of runs must be between 1 and %d.\n", MAX_RUNS);
+        exit(EXIT_FAILURE);
+    }
+    if (max_runs < min_runs) {
+        max_runs = min_runs;
+    }
+
+    run_metrics *runs = (run_metrics*) calloc(max_runs, sizeof(run_metrics));
+    int num_runs = 0;
+
+    start = stamp();
+    while (num_runs < max_runs) {
+        if (num_runs >= min_runs) {
+            if (ci_target <= 0 || converged(runs, num_runs, ci_target)) {
+                break;
+            }
+            if (time_budget_ns > 0 && stamp() - start >= time_budget_ns) {
+                fprintf(stderr, "Time budget exhausted after %d runs\n", num_runs);
+                break;
+            }
+        }
+
+        if (prepare != NULL && system(prepare) != 0) {
+            fprintf(stderr, "Prepare command failed: %s\n", prepare);
+            exit(EXIT_FAILURE);
+        }
+        if (reset_caches) {
+            drop_caches();
+        }
+
+        run_workload(&argv[9], &runs[num_runs]);
+        if (num_runs > 0 && runs[num_runs].count != runs[0].count) {
+            fprintf(stderr, "Run %d reported %d metrics instead of %d\n", num_runs, runs[num_runs].count, runs[0].count);
+            exit(EXIT_FAILURE);
+        }
+        num_runs++;
+    }
+
+    print_stats(runs, num_runs);
+
+    return EXIT_SUCCESS;
+}
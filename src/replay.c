@@ -0,0 +1,1020 @@
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <ctype.h>
+#include <limits.h> //PATH_MAX
+#include <sys/types.h>
+#include <stdint.h> //uint64_t
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "hist.h"
+#include "slowlog.h"
+
+#define ACCESS_PERMISSION 0777
+#define NSEC 1000000000ULL
+#define MAX_TRACE_THREADS 4096
+#define MAX_SYSCALL_ARGS 8
+
+/*
+ Replays I/O traces with one replay thread per traced thread, keeping the
+ order between operations that touch the same file or directory (the
+ resource-oriented ordering of "Root: Replaying multithreaded traces with
+ resource-oriented ordering").
+
+ Trace format: one operation per line, fields separated by spaces, tabs or
+ commas, lines starting with '#' are ignored:
+
+   <thread> <op> <path> <offset> <size> <timestamp_ns> [<recorded_latency_ns>]
+
+  - thread: any integer identifying the traced thread
+  - op: open, create, close, read, write, fsync, fdatasync, stat, unlink, mkdir or rmdir
+  - path: file or directory the operation works on (no whitespace or commas);
+          file descriptors are resolved by path, so read/write/fsync/close use
+          the descriptor opened for that path
+  - offset: -1 to use the file position (read/write), otherwise pread/pwrite offset
+  - size: bytes read or written
+  - timestamp_ns: issue time of the operation, in nanoseconds on any clock
+  - recorded_latency_ns: optional latency observed when the trace was taken
+
+ Traces can be captured with strace and converted with the capture mode:
+
+   strace -f -ttt -T -o trace.strace -e trace=%file,%desc <program>
+   ./replay capture trace.strace > trace.txt
+*/
+
+enum op_types {
+    OP_OPEN,
+    OP_CREATE,
+    OP_CLOSE,
+    OP_READ,
+    OP_WRITE,
+    OP_FSYNC,
+    OP_FDATASYNC,
+    OP_STAT,
+    OP_UNLINK,
+    OP_MKDIR,
+    OP_RMDIR,
+    NUM_OP_TYPES
+};
+
+static const char *op_names[NUM_OP_TYPES] = {
+    "open", "create", "close", "read", "write", "fsync", "fdatasync", "stat", "unlink", "mkdir", "rmdir"
+};
+
+typedef struct resource {
+    char *name;
+    // last operation that changed the resource and the reads issued since then
+    long last_write;
+    long *reads;
+    long num_reads;
+    long cap_reads;
+    // descriptors opened on the resource during the replay (a stack)
+    int *fds;
+    long num_fds;
+    long cap_fds;
+} resource;
+
+typedef struct trace_op {
+    long seq;
+    int thread;
+    int type;
+    char *path;
+    int64_t offset;
+    size_t size;
+    uint64_t timestamp;
+    uint64_t recorded_ns;
+    int has_recorded;
+    resource *res;
+    long *deps;
+    int num_deps;
+    int done;
+    uint64_t replayed_ns;
+    int failed;
+} trace_op;
+
+typedef struct thread_load {
+    int thread_id;
+    long *ops;
+    long num_ops;
+    long cap_ops;
+    char *buf;
+    size_t buf_size;
+    uint64_t implicit_opens;
+} thread_load;
+
+trace_op *ops;
+long num_ops;
+
+resource *resources;
+size_t resources_size;
+
+pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+int waiting_threads;
+
+pthread_mutex_t fd_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int timed_replay;
+uint64_t replay_start;
+uint64_t trace_start;
+
+// slowest replayed operations, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+
+/*
+ Gets the current timestamp in nanoseconds
+
+ Params: none
+
+ Errors: It fails and exits the program if it's not possible to get the timestamp
+ Returns: The current timestamp in nanoseconds
+*/
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
+       perror("Error getting timestamp");
+       exit(EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+/*
+ Grows an array so that it can hold one more element
+
+ Params:
+  - array: pointer to the array
+  - count: number of elements in the array
+  - capacity: pointer to the array capacity
+  - elem_size: size of each element
+
+ Errors: It fails and exits the program if there is no memory left
+ Returns: none
+*/
+void grow(void **array, long count, long *capacity, size_t elem_size) {
+    if (count < *capacity) {
+        return;
+    }
+    *capacity = *capacity ? *capacity * 2 : 16;
+    *array = realloc(*array, *capacity * elem_size);
+    if (*array == NULL) {
+        perror("Couldn't grow array");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ Finds (or adds) a resource by name
+
+ Params:
+  - name: file or directory path
+
+ Returns: The resource
+*/
+resource *lookup_resource(const char *name) {
+    uint64_t hash = 1469598103934665603ULL;
+    size_t slot;
+
+    for (const char *c = name; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char) *c) * 1099511628211ULL;
+    }
+    slot = hash & (resources_size - 1);
+    while (resources[slot].name != NULL) {
+        if (strcmp(resources[slot].name, name) == 0) {
+            return &resources[slot];
+        }
+        slot = (slot + 1) & (resources_size - 1);
+    }
+    resources[slot].name = strdup(name);
+    resources[slot].last_write = -1;
+    return &resources[slot];
+}
+
+/*
+ Adds a dependency to an operation, unless it's on the same thread (the
+ thread already issues its operations in order)
+
+ Params:
+  - op: operation that has to wait
+  - dep: index of the operation it waits for
+
+ Returns: none
+*/
+void add_dep(trace_op *op, long dep) {
+    int cap = op->num_deps;
+
+    if (dep < 0 || ops[dep].thread == op->thread) {
+        return;
+    }
+    for (int i = 0; i < op->num_deps; i++) {
+        if (op->deps[i] == dep) {
+            return;
+        }
+    }
+    // capacity is always the next power of two of num_deps
+    if (cap == 0 || (cap & (cap - 1)) == 0) {
+        op->deps = (long*) realloc(op->deps, (cap ? cap * 2 : 1) * sizeof(long));
+    }
+    op->deps[op->num_deps++] = dep;
+}
+
+/*
+ Orders an operation after the conflicting operations previously issued on a
+ resource: reads wait for the last write, writes wait for the last write and
+ for every read issued since
+
+ Params:
+  - res: resource
+  - idx: index of the operation
+  - mutating: whether the operation changes the resource
+
+ Returns: none
+*/
+void order_on_resource(resource *res, long idx, int mutating) {
+    trace_op *op = &ops[idx];
+
+    add_dep(op, res->last_write);
+    if (mutating) {
+        for (long i = 0; i < res->num_reads; i++) {
+            add_dep(op, res->reads[i]);
+        }
+        res->last_write = idx;
+        res->num_reads = 0;
+    } else {
+        grow((void**) &res->reads, res->num_reads, &res->cap_reads, sizeof(long));
+        res->reads[res->num_reads++] = idx;
+    }
+}
+
+/*
+ Computes the dependencies of every operation of the trace (which must be
+ sorted by timestamp)
+
+ Params: none
+
+ Returns: none
+*/
+void compute_dependencies(void) {
+    char parent[PATH_MAX];
+    char *slash;
+
+    resources_size = 16;
+    while (resources_size < (size_t) num_ops * 4) {
+        resources_size *= 2;
+    }
+    resources = (resource*) calloc(resources_size, sizeof(resource));
+
+    for (long i = 0; i < num_ops; i++) {
+        trace_op *op = &ops[i];
+        int mutating = !(op->type == OP_READ || op->type == OP_STAT);
+
+        op->res = lookup_resource(op->path);
+        order_on_resource(op->res, i, mutating);
+
+        // namespace operations also change the parent directory
+        if (op->type == OP_CREATE || op->type == OP_UNLINK || op->type == OP_MKDIR || op->type == OP_RMDIR) {
+            snprintf(parent, sizeof parent, "%s", op->path);
+            slash = strrchr(parent, '/');
+            if (slash != NULL) {
+                slash[slash == parent ? 1 : 0] = '\0';
+                order_on_resource(lookup_resource(parent), i, 1);
+            }
+        }
+    }
+}
+
+int compare_ops(const void *a, const void *b) {
+    const trace_op *x = a, *y = b;
+
+    if (x->timestamp != y->timestamp) {
+        return x->timestamp < y->timestamp ? -1 : 1;
+    }
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+/*
+ Loads a trace, sorts it by timestamp and assigns its operations to threads
+
+ Params:
+  - trace_path: trace file
+  - root: prefix prepended to every path of the trace, "-" to use them as they are
+  - loads: filled with one thread load per traced thread
+  - num_threads: filled with the number of traced threads
+
+ Errors: It fails and exits the program if the trace can't be read or parsed
+ Returns: none
+*/
+void load_trace(char *trace_path, char *root, thread_load **loads, int *num_threads) {
+    FILE *trace = fopen(trace_path, "r");
+    char *line = NULL, *fields[8], *saveptr;
+    size_t line_size = 0;
+    long line_no = 0, cap_ops = 0;
+    int thread_ids[MAX_TRACE_THREADS];
+    char pathbuf[PATH_MAX];
+
+    if (trace == NULL) {
+        fprintf(stderr, "Couldn't open trace %s: %s\n", trace_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    *num_threads = 0;
+    while (getline(&line, &line_size, trace) >= 0) {
+        int nfields = 0, type;
+        trace_op *op;
+
+        line_no++;
+        for (char *tok = strtok_r(line, " \t,\r\n", &saveptr); tok != NULL && nfields < 8;
+                tok = strtok_r(NULL, " \t,\r\n", &saveptr)) {
+            fields[nfields++] = tok;
+        }
+        if (nfields == 0 || fields[0][0] == '#') {
+            continue;
+        }
+        if (nfields < 6) {
+            fprintf(stderr, "Malformed trace line %ld\n", line_no);
+            exit(EXIT_FAILURE);
+        }
+        for (type = 0; type < NUM_OP_TYPES && strcmp(fields[1], op_names[type]) != 0; type++);
+        if (type == NUM_OP_TYPES) {
+            fprintf(stderr, "Unknown operation %s at trace line %ld\n", fields[1], line_no);
+            exit(EXIT_FAILURE);
+        }
+
+        grow((void**) &ops, num_ops, &cap_ops, sizeof(trace_op));
+        op = &ops[num_ops];
+        memset(op, 0, sizeof(*op));
+        op->seq = num_ops++;
+        op->type = type;
+        op->offset = strtoll(fields[3], NULL, 10);
+        op->size = strtoull(fields[4], NULL, 10);
+        op->timestamp = strtoull(fields[5], NULL, 10);
+        if (nfields > 6 && isdigit((unsigned char) fields[6][0])) {
+            op->recorded_ns = strtoull(fields[6], NULL, 10);
+            op->has_recorded = 1;
+        }
+        if (strcmp(root, "-") == 0) {
+            snprintf(pathbuf, sizeof pathbuf, "%s", fields[2]);
+        } else {
+            snprintf(pathbuf, sizeof pathbuf, "%s/%s", root, fields[2][0] == '/' ? fields[2] + 1 : fields[2]);
+        }
+        op->path = strdup(pathbuf);
+
+        int id = atoi(fields[0]), thread;
+        for (thread = 0; thread < *num_threads && thread_ids[thread] != id; thread++);
+        if (thread == *num_threads) {
+            if (*num_threads == MAX_TRACE_THREADS) {
+                fprintf(stderr, "Too many threads in the trace (max %d)\n", MAX_TRACE_THREADS);
+                exit(EXIT_FAILURE);
+            }
+            thread_ids[(*num_threads)++] = id;
+        }
+        op->thread = thread;
+    }
+    free(line);
+    fclose(trace);
+
+    if (num_ops == 0) {
+        fprintf(stderr, "Empty trace %s\n", trace_path);
+        exit(EXIT_FAILURE);
+    }
+
+    qsort(ops, num_ops, sizeof(trace_op), compare_ops);
+    trace_start = ops[0].timestamp;
+
+    *loads = (thread_load*) calloc(*num_threads, sizeof(thread_load));
+    for (long i = 0; i < num_ops; i++) {
+        thread_load *load = &(*loads)[ops[i].thread];
+        grow((void**) &load->ops, load->num_ops, &load->cap_ops, sizeof(long));
+        load->ops[load->num_ops++] = i;
+        if ((ops[i].type == OP_READ || ops[i].type == OP_WRITE) && ops[i].size > load->buf_size) {
+            load->buf_size = ops[i].size;
+        }
+    }
+    for (int thread = 0; thread < *num_threads; thread++) {
+        (*loads)[thread].thread_id = thread;
+        (*loads)[thread].buf = (char*) calloc((*loads)[thread].buf_size + 1, 1);
+    }
+}
+
+/*
+ Blocks until every dependency of an operation completed
+
+ Params:
+  - op: operation about to be issued
+
+ Returns: none
+*/
+void wait_dependencies(trace_op *op) {
+    for (int i = 0; i < op->num_deps; i++) {
+        trace_op *dep = &ops[op->deps[i]];
+
+        if (__atomic_load_n(&dep->done, __ATOMIC_SEQ_CST)) {
+            continue;
+        }
+        pthread_mutex_lock(&done_lock);
+        __atomic_add_fetch(&waiting_threads, 1, __ATOMIC_SEQ_CST);
+        while (!__atomic_load_n(&dep->done, __ATOMIC_SEQ_CST)) {
+            pthread_cond_wait(&done_cond, &done_lock);
+        }
+        __atomic_sub_fetch(&waiting_threads, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&done_lock);
+    }
+}
+
+/*
+ Marks an operation as completed and wakes up the threads waiting for it
+
+ Params:
+  - op: completed operation
+
+ Returns: none
+*/
+void mark_done(trace_op *op) {
+    __atomic_store_n(&op->done, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&waiting_threads, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&done_lock);
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&done_lock);
+    }
+}
+
+/*
+ Opens a file for reading and writing, falling back to read-only
+
+ Params:
+  - path: file path
+  - flags: extra open flags
+
+ Returns: The descriptor, or -1 on error
+*/
+int open_rw(const char *path, int flags) {
+    int fd = open(path, O_RDWR | O_LARGEFILE | flags, ACCESS_PERMISSION);
+    if (fd < 0 && (errno == EISDIR || errno == EACCES || errno == EROFS)) {
+        fd = open(path, O_RDONLY | O_LARGEFILE);
+    }
+    return fd;
+}
+
+/*
+ Gets the descriptor currently open for a resource, opening one if the trace
+ didn't (e.g. the file was opened before the capture started)
+
+ Params:
+  - load: thread load, used to account implicit opens
+  - res: resource
+
+ Returns: The descriptor, or -1 if the file can't be opened
+*/
+int resource_fd(thread_load *load, resource *res) {
+    int fd;
+
+    pthread_mutex_lock(&fd_lock);
+    if (res->num_fds == 0) {
+        fd = open_rw(res->name, 0);
+        if (fd >= 0) {
+            grow((void**) &res->fds, res->num_fds, &res->cap_fds, sizeof(int));
+            res->fds[res->num_fds++] = fd;
+            load->implicit_opens++;
+        }
+    } else {
+        fd = res->fds[res->num_fds - 1];
+    }
+    pthread_mutex_unlock(&fd_lock);
+    return fd;
+}
+
+void push_fd(resource *res, int fd) {
+    pthread_mutex_lock(&fd_lock);
+    grow((void**) &res->fds, res->num_fds, &res->cap_fds, sizeof(int));
+    res->fds[res->num_fds++] = fd;
+    pthread_mutex_unlock(&fd_lock);
+}
+
+int pop_fd(resource *res) {
+    int fd = -1;
+
+    pthread_mutex_lock(&fd_lock);
+    if (res->num_fds > 0) {
+        fd = res->fds[--res->num_fds];
+    }
+    pthread_mutex_unlock(&fd_lock);
+    return fd;
+}
+
+/*
+ Issues one operation, timing only the system call
+
+ Params:
+  - load: thread load
+  - op: operation
+
+ Returns: none
+*/
+void issue_op(thread_load *load, trace_op *op) {
+    uint64_t begin = 0, end = 0;
+    struct stat st;
+    long ret = 0;
+    int fd = -1;
+    slowlog_probe probe;
+
+    if (op->type != OP_OPEN && op->type != OP_CREATE && op->type != OP_CLOSE && op->type != OP_STAT
+            && op->type != OP_UNLINK && op->type != OP_MKDIR && op->type != OP_RMDIR) {
+        fd = resource_fd(load, op->res);
+        if (fd < 0) {
+            op->failed = 1;
+            return;
+        }
+    } else if (op->type == OP_CLOSE) {
+        fd = pop_fd(op->res);
+        if (fd < 0) {
+            op->failed = 1;
+            return;
+        }
+    }
+
+    slowlog_begin(slow_log, &probe);
+    begin = stamp();
+    switch (op->type) {
+    case OP_OPEN:
+        ret = fd = open_rw(op->path, 0);
+        break;
+    case OP_CREATE:
+        ret = fd = open(op->path, O_CREAT | O_RDWR | O_LARGEFILE, ACCESS_PERMISSION);
+        break;
+    case OP_CLOSE:
+        ret = close(fd);
+        break;
+    case OP_READ:
+        ret = op->offset < 0 ? read(fd, load->buf, op->size) : pread(fd, load->buf, op->size, op->offset);
+        break;
+    case OP_WRITE:
+        ret = op->offset < 0 ? write(fd, load->buf, op->size) : pwrite(fd, load->buf, op->size, op->offset);
+        break;
+    case OP_FSYNC:
+        ret = fsync(fd);
+        break;
+    case OP_FDATASYNC:
+        ret = fdatasync(fd);
+        break;
+    case OP_STAT:
+        ret = stat(op->path, &st);
+        break;
+    case OP_UNLINK:
+        ret = unlink(op->path);
+        break;
+    case OP_MKDIR:
+        ret = mkdir(op->path, ACCESS_PERMISSION);
+        break;
+    case OP_RMDIR:
+        ret = rmdir(op->path);
+        break;
+    }
+    end = stamp();
+    slowlog_end(slow_log, &probe, load->thread_id, op_names[op->type], op->path, (long) op->offset);
+
+    op->replayed_ns = end - begin;
+    op->failed = ret < 0;
+    if ((op->type == OP_OPEN || op->type == OP_CREATE) && fd >= 0) {
+        push_fd(op->res, fd);
+    }
+}
+
+/*
+ Replays the operations of one traced thread
+
+ Params:
+  - args: struct of thread load
+
+ Errors: none
+ Returns: NULL
+*/
+static void* thread_init(void* args) {
+    thread_load *load = (thread_load*) args;
+    struct timespec due;
+    uint64_t due_ns;
+
+    for (long i = 0; i < load->num_ops; i++) {
+        trace_op *op = &ops[load->ops[i]];
+
+        if (timed_replay) {
+            due_ns = replay_start + (op->timestamp - trace_start);
+            due.tv_sec = due_ns / NSEC;
+            due.tv_nsec = due_ns % NSEC;
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR);
+        }
+        wait_dependencies(op);
+        issue_op(load, op);
+        mark_done(op);
+    }
+
+    return NULL;
+}
+
+/*
+ Prints the recorded and the replayed latency distributions in nanoseconds
+
+ One line per operation type and source, plus the totals:
+   <op>,recorded|replayed,count,mean,p50,p90,p99,p99.9,max
+ The last line is: trace span, replay wall time (both in ns), failed
+ operations and files opened implicitly.
+
+ Params:
+  - loads: thread loads
+  - num_threads: number of replay threads
+  - wall_ns: replay wall time
+
+ Errors: none
+ Returns: none
+*/
+void print_latencies(thread_load *loads, int num_threads, uint64_t wall_ns) {
+    static hist recorded[NUM_OP_TYPES + 1], replayed[NUM_OP_TYPES + 1];
+    uint64_t failed = 0, implicit_opens = 0;
+
+    for (int type = 0; type <= NUM_OP_TYPES; type++) {
+        hist_init(&recorded[type]);
+        hist_init(&replayed[type]);
+    }
+    for (long i = 0; i < num_ops; i++) {
+        if (ops[i].has_recorded) {
+            hist_add(&recorded[ops[i].type], ops[i].recorded_ns);
+            hist_add(&recorded[NUM_OP_TYPES], ops[i].recorded_ns);
+        }
+        if (ops[i].failed) {
+            failed++;
+        } else {
+            hist_add(&replayed[ops[i].type], ops[i].replayed_ns);
+            hist_add(&replayed[NUM_OP_TYPES], ops[i].replayed_ns);
+        }
+    }
+
+    for (int type = 0; type <= NUM_OP_TYPES; type++) {
+        const char *name = type == NUM_OP_TYPES ? "all" : op_names[type];
+        if (recorded[type].count == 0 && replayed[type].count == 0) {
+            continue;
+        }
+        printf("%s,recorded,", name);
+        hist_print_csv(stdout, &recorded[type]);
+        printf("\n%s,replayed,", name);
+        hist_print_csv(stdout, &replayed[type]);
+        printf("\n");
+    }
+
+    for (int thread = 0; thread < num_threads; thread++) {
+        implicit_opens += loads[thread].implicit_opens;
+    }
+    printf("%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+            ops[num_ops - 1].timestamp - trace_start, wall_ns, failed, implicit_opens);
+}
+
+/*
+ Converts "seconds.fraction" into nanoseconds
+
+ Params:
+  - text: time as printed by strace -ttt or -T
+
+ Returns: The time in nanoseconds
+*/
+uint64_t parse_seconds(const char *text) {
+    uint64_t ns = strtoull(text, NULL, 10) * NSEC, scale = NSEC / 10;
+    const char *dot = strchr(text, '.');
+
+    if (dot != NULL) {
+        for (const char *c = dot + 1; isdigit((unsigned char) *c) && scale > 0; c++, scale /= 10) {
+            ns += (*c - '0') * scale;
+        }
+    }
+    return ns;
+}
+
+/*
+ Splits the argument list of a system call printed by strace, honoring
+ quotes, arrays and structures; strings are unquoted in place
+
+ Params:
+  - args: argument list (modified)
+  - argv: filled with the arguments
+
+ Returns: The number of arguments
+*/
+int split_args(char *args, char **argv) {
+    int argc = 0, depth = 0, quoted = 0;
+    char *start = args;
+
+    for (char *c = args; ; c++) {
+        if (quoted) {
+            if (*c == '\\' && c[1] != '\0') {
+                c++;
+            } else if (*c == '"') {
+                quoted = 0;
+            } else if (*c == '\0') {
+                break;
+            }
+            continue;
+        }
+        if (*c == '"') {
+            quoted = 1;
+        } else if (*c == '{' || *c == '[') {
+            depth++;
+        } else if (*c == '}' || *c == ']') {
+            depth--;
+        } else if ((*c == ',' && depth == 0) || *c == '\0') {
+            int end = (*c == '\0');
+            *c = '\0';
+            while (*start == ' ') {
+                start++;
+            }
+            if (argc < MAX_SYSCALL_ARGS) {
+                argv[argc++] = start;
+            }
+            start = c + 1;
+            if (end) {
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < argc; i++) {
+        char *src, *dst;
+        if (argv[i][0] != '"') {
+            continue;
+        }
+        for (src = argv[i] + 1, dst = argv[i]; *src != '\0' && *src != '"'; src++) {
+            if (*src == '\\' && src[1] != '\0') {
+                src++;
+            }
+            *dst++ = *src;
+        }
+        *dst = '\0';
+    }
+    return argc;
+}
+
+/*
+ Resolves a path relative to a directory descriptor
+
+ Params:
+  - fd_paths: descriptor to path table
+  - max_fd: size of the table
+  - dirfd: directory descriptor argument ("AT_FDCWD" or a number)
+  - path: path argument
+  - out: resolved path
+
+ Returns: none
+*/
+void resolve_path(char **fd_paths, int max_fd, const char *dirfd, const char *path, char *out, size_t size) {
+    int fd = atoi(dirfd);
+
+    if (path[0] != '/' && strcmp(dirfd, "AT_FDCWD") != 0 && fd >= 0 && fd < max_fd && fd_paths[fd] != NULL) {
+        snprintf(out, size, "%s/%s", fd_paths[fd], path);
+    } else {
+        snprintf(out, size, "%s", path);
+    }
+}
+
+/*
+ Converts the output of strace -f -ttt -T into a replay trace (stdout)
+
+ Descriptors are tracked in a single table, so the traced program should be a
+ single (possibly multithreaded) process. Failed system calls and paths with
+ whitespace or commas are skipped.
+
+ Params:
+  - strace_path: strace output file
+
+ Errors: It fails and exits the program if the file can't be read
+ Returns: none
+*/
+void capture(char *strace_path) {
+    FILE *in = fopen(strace_path, "r");
+    char *line = NULL, *joined = NULL, *argv[MAX_SYSCALL_ARGS], call[64], path[PATH_MAX];
+    char *pending[MAX_TRACE_THREADS] = { NULL };
+    uint64_t pending_ts[MAX_TRACE_THREADS] = { 0 };
+    int pids[MAX_TRACE_THREADS], num_pids = 0;
+    size_t line_size = 0;
+    int max_fd = 1 << 16;
+    char **fd_paths = (char**) calloc(max_fd, sizeof(char*));
+    uint64_t skipped = 0;
+
+    if (in == NULL) {
+        fprintf(stderr, "Couldn't open %s: %s\n", strace_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    printf("# thread op path offset size timestamp_ns recorded_latency_ns\n");
+    while (getline(&line, &line_size, in) >= 0) {
+        char *cursor = line, *text, *ret_text, *dur_text, *open_paren, *close_paren;
+        int pid = 0, thread, argc, fd;
+        uint64_t ts;
+        long ret;
+        const char *op = NULL;
+        int64_t offset = -1;
+        size_t size = 0;
+
+        free(joined);
+        joined = NULL;
+        line[strcspn(line, "\n")] = '\0';
+        // with -f every line starts with the pid, followed by the -ttt timestamp
+        pid = (int) strtol(line, &cursor, 10);
+        if (*cursor != ' ') {
+            pid = 0;
+            cursor = line;
+        }
+        cursor += strspn(cursor, " ");
+        ts = parse_seconds(cursor);
+        cursor = strchr(cursor, ' ');
+        if (cursor == NULL) {
+            continue;
+        }
+        text = cursor + 1;
+
+        for (thread = 0; thread < num_pids && pids[thread] != pid; thread++);
+        if (thread == num_pids) {
+            if (num_pids == MAX_TRACE_THREADS) {
+                continue;
+            }
+            pids[num_pids++] = pid;
+        }
+
+        // join "<unfinished ...>" with the matching "<... resumed>" line
+        if ((cursor = strstr(text, " <unfinished ...>")) != NULL) {
+            *cursor = '\0';
+            free(pending[thread]);
+            pending[thread] = strdup(text);
+            pending_ts[thread] = ts;
+            continue;
+        }
+        if (strncmp(text, "<... ", 5) == 0) {
+            if (pending[thread] == NULL || (cursor = strstr(text, "resumed>")) == NULL) {
+                continue;
+            }
+            joined = (char*) malloc(strlen(pending[thread]) + strlen(cursor) + 1);
+            sprintf(joined, "%s%s", pending[thread], cursor + strlen("resumed>"));
+            free(pending[thread]);
+            pending[thread] = NULL;
+            text = joined;
+            ts = pending_ts[thread];
+        }
+
+        open_paren = strchr(text, '(');
+        ret_text = strstr(text, ") = ");
+        if (open_paren == NULL || ret_text == NULL || (size_t) (open_paren - text) >= sizeof call) {
+            continue;
+        }
+        close_paren = ret_text;
+        while ((cursor = strstr(ret_text + 1, ") = ")) != NULL) {
+            close_paren = ret_text = cursor;
+        }
+        memcpy(call, text, open_paren - text);
+        call[open_paren - text] = '\0';
+        ret = strtol(ret_text + 4, NULL, 10);
+        dur_text = strrchr(ret_text, '<');
+        *close_paren = '\0';
+        argc = split_args(open_paren + 1, argv);
+        if (ret < 0 || argc == 0) {
+            continue;
+        }
+
+        path[0] = '\0';
+        fd = atoi(argv[0]);
+        if ((strcmp(call, "openat") == 0 && argc >= 3) || ((strcmp(call, "open") == 0 || strcmp(call, "creat") == 0) && argc >= 2)) {
+            int at = strcmp(call, "openat") == 0;
+            resolve_path(fd_paths, max_fd, at ? argv[0] : "AT_FDCWD", argv[at], path, sizeof path);
+            op = (strcmp(call, "creat") == 0 || strstr(argv[at + 1], "O_CREAT")) ? "create" : "open";
+            if (ret < max_fd) {
+                free(fd_paths[ret]);
+                fd_paths[ret] = strdup(path);
+            }
+        } else if ((strcmp(call, "close") == 0 || strcmp(call, "fsync") == 0 || strcmp(call, "fdatasync") == 0)
+                && fd >= 0 && fd < max_fd && fd_paths[fd] != NULL) {
+            snprintf(path, sizeof path, "%s", fd_paths[fd]);
+            op = call;
+            if (strcmp(call, "close") == 0) {
+                free(fd_paths[fd]);
+                fd_paths[fd] = NULL;
+            }
+        } else if ((strcmp(call, "read") == 0 || strcmp(call, "pread64") == 0 || strcmp(call, "write") == 0
+                    || strcmp(call, "pwrite64") == 0) && argc >= 3 && fd >= 0 && fd < max_fd && fd_paths[fd] != NULL) {
+            snprintf(path, sizeof path, "%s", fd_paths[fd]);
+            op = strstr(call, "read") ? "read" : "write";
+            size = strtoull(argv[2], NULL, 10);
+            if (call[0] == 'p' && argc >= 4) {
+                offset = strtoll(argv[3], NULL, 10);
+            }
+        } else if ((strcmp(call, "stat") == 0 || strcmp(call, "lstat") == 0) && argc >= 1) {
+            resolve_path(fd_paths, max_fd, "AT_FDCWD", argv[0], path, sizeof path);
+            op = "stat";
+        } else if ((strcmp(call, "newfstatat") == 0 || strcmp(call, "statx") == 0) && argc >= 2 && argv[1][0] != '\0') {
+            resolve_path(fd_paths, max_fd, argv[0], argv[1], path, sizeof path);
+            op = "stat";
+        } else if (strcmp(call, "unlink") == 0 || strcmp(call, "rmdir") == 0 || strcmp(call, "mkdir") == 0) {
+            resolve_path(fd_paths, max_fd, "AT_FDCWD", argv[0], path, sizeof path);
+            op = call;
+        } else if ((strcmp(call, "unlinkat") == 0 || strcmp(call, "mkdirat") == 0) && argc >= 3) {
+            resolve_path(fd_paths, max_fd, argv[0], argv[1], path, sizeof path);
+            op = strcmp(call, "mkdirat") == 0 ? "mkdir" : (strstr(argv[2], "AT_REMOVEDIR") ? "rmdir" : "unlink");
+        }
+
+        if (op == NULL) {
+            continue;
+        }
+        if (path[0] == '\0' || strpbrk(path, " \t,") != NULL) {
+            skipped++;
+            continue;
+        }
+        printf("%d %s %s %" PRId64 " %zu %" PRIu64, thread, op, path, offset, size, ts);
+        if (dur_text != NULL) {
+            printf(" %" PRIu64, parse_seconds(dur_text + 1));
+        }
+        printf("\n");
+    }
+
+    if (skipped > 0) {
+        fprintf(stderr, "Skipped %" PRIu64 " operations on paths with whitespace or commas\n", skipped);
+    }
+    free(joined);
+    free(line);
+    fclose(in);
+}
+
+/*
+ Evaluates whether the input is one of the two options given in the params
+
+ Params:
+  - input: user inputed value
+  - first_op: First option to the value
+  - second_op: Second option to the value
+
+ Error: It fails and exits the program if the input doesn't corresponds to any option
+ Returns: 1 in case the input it is equal to the first option
+          0 otherwise
+*/
+int parse_bool_flag(char * input, char * first_op, char * second_op) {
+    if (strcmp(input, first_op) == 0) {
+        return 1;
+    } else if (strcmp(input, second_op) == 0) {
+        return 0;
+    } else {
+        fprintf(stderr, "Invalid parameter %s, must be one of: %s or %s.\n", input, first_op, second_op);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// To run, type: ./replay <trace> <root>|- timed|afap [slow=<us>] [slowtop=<K>] [slowcap=<N>]
+//          or: ./replay capture <strace_output>
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "capture") == 0) {
+        capture(argv[2]);
+        return EXIT_SUCCESS;
+    }
+    if (argc < 4) {
+        fprintf(stderr, "Usage: ./replay <trace> <root>|- timed|afap [slow=<us>] [slowtop=<K>] [slowcap=<N>]\n"
+                "       ./replay capture <strace -f -ttt -T output>\n");
+        exit(EXIT_FAILURE);
+    }
+
+    thread_load *loads;
+    int num_threads;
+
+    // Whether operations are issued at their original time or as fast as possible
+    timed_replay = parse_bool_flag(argv[3], "timed", "afap");
+
+    slowlog_spec_init(&slow_spec);
+    for (int i = 4; i < argc; ++i) {
+        if (!slowlog_parse_option(&slow_spec, argv[i])) {
+            fprintf(stderr, "Invalid option %s, must be one of: slow=<us>, slowtop=<K> or slowcap=<N>.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    load_trace(argv[1], argv[2], &loads, &num_threads);
+    compute_dependencies();
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) calloc(1, slowlog_size(&slow_spec, num_threads));
+        slowlog_init(slow_log, &slow_spec, num_threads);
+    }
+
+    pthread_t* requesters = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
+    replay_start = stamp();
+    for (int thread = 0; thread < num_threads; ++thread) {
+        pthread_create(&requesters[thread], NULL, thread_init, (void *) &loads[thread]);
+    }
+
+    for (int thread = 0; thread < num_threads; ++thread) {
+        pthread_join(requesters[thread], NULL);
+    }
+
+    print_latencies(loads, num_threads, stamp() - replay_start);
+    slowlog_print(stdout, slow_log);
+
+    return EXIT_SUCCESS;
+}
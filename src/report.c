@@ -0,0 +1,442 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <limits.h> //PATH_MAX
+#include <unistd.h> //sysconf
+#include <mntent.h>
+#include <sys/vfs.h> //statfs
+#include <sys/utsname.h>
+#include "report.h"
+
+static const struct {
+    long magic;
+    const char *name;
+} fs_names[] = {
+    { 0xEF53, "ext4" },         // ext2/3/4 share it
+    { 0x58465342, "xfs" },
+    { 0x9123683E, "btrfs" },
+    { 0xF2F52010, "f2fs" },
+    { 0x2FC12FC1, "zfs" },
+    { 0x01021994, "tmpfs" },
+    { 0x794C7630, "overlay" },
+    { 0x6969, "nfs" },
+    { 0xFF534D42, "cifs" },
+    { 0x65735546, "fuse" },
+    { 0x858458F6, "ramfs" },
+    { 0x5346544E, "ntfs" },
+    { 0x4D44, "vfat" }
+};
+
+#define NUM_FS_NAMES (sizeof(fs_names) / sizeof(fs_names[0]))
+
+/*
+ Creates the report file and opens its top-level object
+
+ Params:
+  - r: report
+  - path: file to write, - for stdout
+
+ Errors: It fails and exits the program if the file can't be created
+ Returns: none
+*/
+void report_open(report *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    r->out = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (r->out == NULL) {
+        fprintf(stderr, "Couldn't create report %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    report_begin_object(r, NULL);
+}
+
+// closes the top-level object and the file
+void report_close(report *r) {
+    report_end_object(r);
+    fputc('\n', r->out);
+    if (r->out != stdout) {
+        fclose(r->out);
+    }
+}
+
+static void report_escape(report *r, const char *s) {
+    fputc('"', r->out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char) *s;
+        if (c == '"' || c == '\\') {
+            fprintf(r->out, "\\%c", c);
+        } else if (c == '\n') {
+            fputs("\\n", r->out);
+        } else if (c < 0x20) {
+            fprintf(r->out, "\\u%04x", c);
+        } else {
+            fputc(c, r->out);
+        }
+    }
+    fputc('"', r->out);
+}
+
+static int report_inline(const report *r) {
+    return r->inline_depth > 0 && r->depth >= r->inline_depth;
+}
+
+// separates the new member or element from the previous one and writes its key
+static void report_key(report *r, const char *key) {
+    if (r->written[r->depth]++) {
+        fputc(',', r->out);
+        if (report_inline(r)) {
+            fputc(' ', r->out);
+        }
+    }
+    if (r->depth > 0 && !report_inline(r)) {
+        fprintf(r->out, "\n%*s", 2 * r->depth, "");
+    }
+    if (key != NULL) {
+        report_escape(r, key);
+        fputs(": ", r->out);
+    }
+}
+
+static void report_open_level(report *r, const char *key, char bracket) {
+    if (r->depth + 1 == REPORT_MAX_DEPTH) {
+        fprintf(stderr, "Report nested deeper than %d levels\n", REPORT_MAX_DEPTH);
+        exit(EXIT_FAILURE);
+    }
+    if (r->depth > 0 || r->written[0] > 0) {
+        report_key(r, key);
+    }
+    fputc(bracket, r->out);
+    r->written[++r->depth] = 0;
+}
+
+static void report_close_level(report *r, char bracket) {
+    int was_inline = report_inline(r), written = r->written[r->depth];
+
+    if (r->inline_depth == r->depth) {
+        r->inline_depth = 0;
+    }
+    r->depth--;
+    if (written > 0 && !was_inline) {
+        fprintf(r->out, "\n%*s", 2 * r->depth, "");
+    }
+    fputc(bracket, r->out);
+}
+
+void report_begin_object(report *r, const char *key) {
+    report_open_level(r, key, '{');
+}
+
+void report_end_object(report *r) {
+    report_close_level(r, '}');
+}
+
+/*
+ Opens an array
+
+ Params:
+  - r: report
+  - key: member name, NULL inside an array
+  - inline_elements: 1 to keep the whole array (e.g. a series of numbers) on one line
+
+ Returns: none
+*/
+void report_begin_array(report *r, const char *key, int inline_elements) {
+    report_open_level(r, key, '[');
+    if (inline_elements && r->inline_depth == 0) {
+        r->inline_depth = r->depth;
+    }
+}
+
+void report_end_array(report *r) {
+    report_close_level(r, ']');
+}
+
+void report_string(report *r, const char *key, const char *value) {
+    report_key(r, key);
+    report_escape(r, value);
+}
+
+// NaN and infinities have no JSON form and become null
+void report_number(report *r, const char *key, double value) {
+    report_key(r, key);
+    if (isfinite(value)) {
+        fprintf(r->out, "%.10g", value);
+    } else {
+        fputs("null", r->out);
+    }
+}
+
+void report_uint(report *r, const char *key, uint64_t value) {
+    report_key(r, key);
+    fprintf(r->out, "%lu", (unsigned long) value);
+}
+
+/*
+ Writes a latency histogram: its summary and every non-empty bucket as
+ [<value>, <count>], value being the middle of the bucket
+
+ Params:
+  - r: report
+  - key: member name
+  - h: histogram
+
+ Returns: none
+*/
+void report_hist(report *r, const char *key, const hist *h) {
+    report_begin_object(r, key);
+    report_uint(r, "count", h->count);
+    report_uint(r, "mean_ns", hist_mean(h));
+    report_uint(r, "min_ns", h->count ? h->min : 0);
+    report_uint(r, "p50_ns", hist_percentile(h, 50));
+    report_uint(r, "p90_ns", hist_percentile(h, 90));
+    report_uint(r, "p99_ns", hist_percentile(h, 99));
+    report_uint(r, "p99_9_ns", hist_percentile(h, 99.9));
+    report_uint(r, "max_ns", h->count ? h->max : 0);
+    report_begin_array(r, "buckets", 1);
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        if (h->buckets[b] == 0) {
+            continue;
+        }
+        report_begin_array(r, NULL, 1);
+        report_uint(r, NULL, hist_bucket_value(b));
+        report_uint(r, NULL, h->buckets[b]);
+        report_end_array(r);
+    }
+    report_end_array(r);
+    report_end_object(r);
+}
+
+// writes the filesystem a path lives on: statfs() type and the /proc/self/mounts entry covering it
+static void report_filesystem(report *r, const char *path) {
+    char real[PATH_MAX], best_dir[PATH_MAX] = "", best_source[PATH_MAX] = "", best_type[64] = "", best_opts[1024] = "";
+    const char *fs_type = NULL;
+    struct statfs sfs;
+    struct mntent *ent;
+    size_t best_len = 0;
+    FILE *mounts;
+
+    if (realpath(path, real) == NULL) {
+        snprintf(real, sizeof real, "%s", path);
+    }
+    report_begin_object(r, NULL);
+    report_string(r, "path", path);
+    if (statfs(real, &sfs) == 0) {
+        char magic[32];
+
+        snprintf(magic, sizeof magic, "0x%lx", (unsigned long) sfs.f_type);
+        report_string(r, "fs_magic", magic);
+        report_uint(r, "block_size", sfs.f_bsize);
+        for (size_t i = 0; i < NUM_FS_NAMES; i++) {
+            if ((unsigned long) sfs.f_type == (unsigned long) fs_names[i].magic) {
+                fs_type = fs_names[i].name;
+            }
+        }
+    }
+
+    // the longest mount point covering the path, the last one mounted on equal ones
+    if ((mounts = setmntent("/proc/self/mounts", "r")) != NULL) {
+        while ((ent = getmntent(mounts)) != NULL) {
+            size_t len = strlen(ent->mnt_dir);
+            int covers = strncmp(real, ent->mnt_dir, len) == 0
+                         && (real[len] == '/' || real[len] == '\0' || strcmp(ent->mnt_dir, "/") == 0);
+            if (covers && len >= best_len) {
+                best_len = len;
+                snprintf(best_dir, sizeof best_dir, "%s", ent->mnt_dir);
+                snprintf(best_source, sizeof best_source, "%s", ent->mnt_fsname);
+                snprintf(best_type, sizeof best_type, "%s", ent->mnt_type);
+                snprintf(best_opts, sizeof best_opts, "%s", ent->mnt_opts);
+            }
+        }
+        endmntent(mounts);
+    }
+    report_string(r, "fs_type", fs_type ? fs_type : (best_type[0] ? best_type : "unknown"));
+    report_string(r, "mount_point", best_dir);
+    report_string(r, "mount_source", best_source);
+    report_string(r, "mount_type", best_type);
+    report_string(r, "mount_options", best_opts);
+    report_end_object(r);
+}
+
+/*
+ Writes the environment of the run: kernel (uname), CPUs, date and the
+ filesystem under each path
+
+ Params:
+  - r: report
+  - paths: paths of the run (files, directories)
+  - num_paths: number of paths
+
+ Returns: none
+*/
+void report_environment(report *r, const char **paths, int num_paths) {
+    struct utsname uts;
+    char date[64];
+    time_t now = time(NULL);
+
+    report_begin_object(r, "environment");
+    if (uname(&uts) == 0) {
+        report_string(r, "sysname", uts.sysname);
+        report_string(r, "nodename", uts.nodename);
+        report_string(r, "release", uts.release);
+        report_string(r, "version", uts.version);
+        report_string(r, "machine", uts.machine);
+    }
+    report_uint(r, "cpus_online", sysconf(_SC_NPROCESSORS_ONLN));
+    report_uint(r, "cpus_configured", sysconf(_SC_NPROCESSORS_CONF));
+    strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    report_string(r, "date", date);
+    report_begin_array(r, "filesystems", 0);
+    for (int i = 0; i < num_paths; i++) {
+        report_filesystem(r, paths[i]);
+    }
+    report_end_array(r);
+    report_end_object(r);
+}
+
+// writes the command line as one "args" string, so that ./compare lists any
+// option that differs; json=<file> is left out, it differs on every run
+void report_args(report *r, int argc, char **argv) {
+    size_t len = 1;
+    char *args;
+
+    for (int i = 1; i < argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    args = (char*) calloc(len, 1);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "json=", 5) == 0) {
+            continue;
+        }
+        if (args[0] != '\0') {
+            strcat(args, " ");
+        }
+        strcat(args, argv[i]);
+    }
+    report_string(r, "args", args);
+    free(args);
+}
+
+void report_thread_init(report_thread *t) {
+    memset(t, 0, sizeof(*t));
+    hist_init(&t->latencies);
+    t->first_ns = UINT64_MAX;
+}
+
+// accounts one request issued at begin and completed at end: its latency, or an error if result < 0
+void report_thread_add(report_thread *t, uint64_t begin, uint64_t end, long result) {
+    if (result < 0) {
+        t->errors++;
+    } else {
+        hist_add(&t->latencies, end - begin);
+        t->bytes += result;
+    }
+    t->first_ns = begin < t->first_ns ? begin : t->first_ns;
+    t->last_ns = end > t->last_ns ? end : t->last_ns;
+}
+
+// splits the span of the requests of the threads, first issued to last completed, into REPORT_INTERVALS intervals
+void report_series_init(report_series *s, const report_thread *threads, int num_threads) {
+    uint64_t last = 0;
+
+    memset(s, 0, sizeof(*s));
+    s->first_ns = UINT64_MAX;
+    for (int t = 0; t < num_threads; t++) {
+        s->first_ns = threads[t].first_ns < s->first_ns ? threads[t].first_ns : s->first_ns;
+        last = threads[t].last_ns > last ? threads[t].last_ns : last;
+    }
+    s->interval_ns = last > s->first_ns ? (last - s->first_ns + REPORT_INTERVALS - 1) / REPORT_INTERVALS : 1;
+}
+
+// accounts one request into the interval it completed in, as report_thread_add()
+void report_series_add(report_series *s, uint64_t begin, uint64_t end, long result) {
+    uint64_t i = end > s->first_ns ? (end - s->first_ns) / s->interval_ns : 0;
+
+    if (i >= REPORT_INTERVALS) {
+        i = REPORT_INTERVALS - 1;
+    }
+    s->requests[i]++;
+    if (result >= 0) {
+        s->ops[i]++;
+        s->latency_ns[i] += end - begin;
+    }
+}
+
+/*
+ Writes the results of one operation class as an element of results.groups,
+ laid out like the groups of ./engine, with the interval series when there
+ is one and one sample per thread ("threads") in any case
+
+ Params:
+  - r: report
+  - op: operation class, also the name of the group
+  - threads: results of every thread
+  - num_threads: number of threads
+  - series: interval series of the requests of all threads, NULL for none
+
+ Returns: none
+*/
+void report_op_group(report *r, const char *op, const report_thread *threads, int num_threads, const report_series *series) {
+    uint64_t bytes = 0, errors = 0, first = UINT64_MAX, last = 0;
+    double wall_s;
+    hist total;
+
+    hist_init(&total);
+    for (int t = 0; t < num_threads; t++) {
+        hist_merge(&total, &threads[t].latencies);
+        bytes += threads[t].bytes;
+        errors += threads[t].errors;
+        first = threads[t].first_ns < first ? threads[t].first_ns : first;
+        last = threads[t].last_ns > last ? threads[t].last_ns : last;
+    }
+    wall_s = last > first ? (last - first) / 1e9 : 0;
+
+    report_begin_object(r, NULL);
+    report_string(r, "name", op);
+    report_string(r, "kind", op);
+    report_uint(r, "requests", total.count);
+    report_number(r, "requests_per_s", wall_s > 0 ? total.count / wall_s : NAN);
+    report_number(r, "mb_per_s", wall_s > 0 ? bytes / 1e6 / wall_s : NAN);
+    report_uint(r, "errors", errors);
+    report_begin_object(r, "latency");
+    report_hist(r, op, &total);
+    report_end_object(r);
+
+    if (series != NULL) {
+        report_begin_object(r, "intervals");
+        report_uint(r, "complete", REPORT_INTERVALS);
+        report_number(r, "interval_ms", series->interval_ns / 1e6);
+        report_begin_array(r, "requests_per_s", 1);
+        for (int i = 0; i < REPORT_INTERVALS; i++) {
+            report_number(r, NULL, series->requests[i] * 1e9 / series->interval_ns);
+        }
+        report_end_array(r);
+        report_begin_object(r, "mean_latency_ns");
+        report_begin_array(r, op, 1);
+        for (int i = 0; i < REPORT_INTERVALS; i++) {
+            report_number(r, NULL, series->ops[i] ? series->latency_ns[i] / (double) series->ops[i] : NAN);
+        }
+        report_end_array(r);
+        report_end_object(r);
+        report_end_object(r);
+    }
+
+    report_begin_object(r, "threads");
+    report_begin_array(r, "requests_per_s", 1);
+    for (int t = 0; t < num_threads; t++) {
+        const report_thread *th = &threads[t];
+        report_number(r, NULL, th->last_ns > th->first_ns ? th->latencies.count * 1e9 / (th->last_ns - th->first_ns) : NAN);
+    }
+    report_end_array(r);
+    report_begin_object(r, "mean_latency_ns");
+    report_begin_array(r, op, 1);
+    for (int t = 0; t < num_threads; t++) {
+        report_number(r, NULL, threads[t].latencies.count ? (double) hist_mean(&threads[t].latencies) : NAN);
+    }
+    report_end_array(r);
+    report_end_object(r);
+    report_end_object(r);
+    report_end_object(r);
+}
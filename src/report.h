@@ -0,0 +1,59 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdio.h>
+#include <stdint.h> //uint64_t
+#include "hist.h"
+
+#define REPORT_MAX_DEPTH 16
+#define REPORT_INTERVALS 20
+
+// JSON report being written: nested objects and arrays, one member or
+// element per line. Members take a key, elements of arrays a NULL key.
+typedef struct report {
+    FILE *out;
+    int depth;
+    int inline_depth;                   // depth below which arrays stay on one line, 0 for none
+    int written[REPORT_MAX_DEPTH];      // members/elements written at each level
+} report;
+
+// Results of one thread for one operation class, the per-thread samples of
+// ./compare when a group has no interval series
+typedef struct report_thread {
+    hist latencies;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t first_ns;      // first request issued
+    uint64_t last_ns;       // last request completed
+} report_thread;
+
+// Requests of one operation class of all threads, binned by completion time
+// into REPORT_INTERVALS intervals of the run, for the benchmarks that keep
+// the timestamps of every request
+typedef struct report_series {
+    uint64_t first_ns;
+    uint64_t interval_ns;
+    uint64_t requests[REPORT_INTERVALS];    // completed, failed ones included
+    uint64_t ops[REPORT_INTERVALS];         // completed without error
+    uint64_t latency_ns[REPORT_INTERVALS];  // sum over ops
+} report_series;
+
+void report_open(report *r, const char *path);
+void report_close(report *r);
+void report_begin_object(report *r, const char *key);
+void report_end_object(report *r);
+void report_begin_array(report *r, const char *key, int inline_elements);
+void report_end_array(report *r);
+void report_string(report *r, const char *key, const char *value);
+void report_number(report *r, const char *key, double value);
+void report_uint(report *r, const char *key, uint64_t value);
+void report_hist(report *r, const char *key, const hist *h);
+void report_environment(report *r, const char **paths, int num_paths);
+void report_args(report *r, int argc, char **argv);
+void report_thread_init(report_thread *t);
+void report_thread_add(report_thread *t, uint64_t begin, uint64_t end, long result);
+void report_series_init(report_series *s, const report_thread *threads, int num_threads);
+void report_series_add(report_series *s, uint64_t begin, uint64_t end, long result);
+void report_op_group(report *r, const char *op, const report_thread *threads, int num_threads, const report_series *series);
+
+#endif
@@ -3,7 +3,7 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
-#include <unistd.h> //usleep
+#include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -11,17 +11,49 @@
 #include <sys/types.h>
 #include <stdint.h> //uint64_t
 #include <stdlib.h> //rand
+#include <ctype.h> //isdigit
 
 #define __STDC_FORMAT_MACRO
 #include <inttypes.h>
 
+#include "blockio.h"
+#include "iostats.h"
+#include "workers.h"
+#include "heatmap.h"
+#include "report.h"
+
 #define ACCESS_PERMISSION 0777
 
 //FIXME: add header and explain the parts we used from zev code
-//FIXME: refactor workload code they share a lot
 
 int debug;
 
+//request timestamps, kept for debug, the heat map and the JSON report
+int timed;
+
+//JSON report of the run for ./compare, NULL when disabled
+const char *json_path;
+
+//random offsets (not aligned but in verify mode), or a permutation of the blocks, see blockio.h
+int offset_mode;
+
+//kernel and device accounting of the measured phase, -1 when disabled
+int iostat_interval_ms;
+
+//pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+
+//buffers, counters, vectored calls, content of the written blocks and the verify mode stamps
+//(offset, generation and CRC32C of every block)
+blockio_spec requests;
+
+//slow requests with the context switches and faults of their thread, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+
+//latency by offset region and time slice, needs the request timestamps
+heatmap_spec offset_heatmap;
+
 typedef struct thread_load {
     int thread_id;
     int fd;
@@ -29,55 +61,121 @@ typedef struct thread_load {
     long * offset;
     ssize_t * rt_count;
     int nreq;
-    useconds_t delay;
-    char * buf;
     int blksize;
     uint64_t * begin;
     uint64_t * end;
+    offsets where;
+    pacer pace;
+    blockio io;
 } thread_load;
 
-long random_offset (long file_length, int blksize) {
-    return (long) ((rand() / (double) RAND_MAX) * (file_length - blksize));
-}
-
-static uint64_t stamp (void) {
-   struct timespec tspec;
-   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
-       fprintf (stderr, "Error getting timestamp: %s\n", strerror(errno));
-       exit (EXIT_FAILURE);
-   }
-   return (tspec.tv_sec * 1000000000ULL) + tspec.tv_nsec;
-}
-
 static void *request (void *arg) {
 
     int i;
     thread_load* load = arg;
 
+    blockio_begin (&load->io, &requests);
     for (i = 0; i < load->nreq; i++) {
-        if (load->delay > 0) {
-	    usleep (load->delay);
-	}
+        pacer_wait (&load->pace, UINT64_MAX, NULL);
 
-	if (debug) {
-	    load->begin[i] = stamp ();
-	}
-
-	load->offset[i] = random_offset (load->file_size, load->blksize);
-        load->rt_count[i] = pwrite (load->fd, load->buf, load->blksize, load->offset[i]);
-	if (debug) {
-	    load->end[i] = stamp ();
-	}
+	load->offset[i] = (long) offsets_at (&load->where, i);
+	load->rt_count[i] = blockio_write (&load->io, &requests, load->offset[i],
+			timed ? &load->begin[i] : NULL, timed ? &load->end[i] : NULL);
     }
+    blockio_end (&load->io, &requests);
 
     return NULL;
 }
 
+//latency heat map of every request by file offset and time since the first request
+static void print_heatmap (thread_load *load, int num_threads) {
+
+    int i, j;
+    heatmap map;
+    uint64_t first_begin = UINT64_MAX, last_end = 0, file_size = 0;
+
+    for (i = 0; i < num_threads; i++) {
+        if ((uint64_t) load[i].file_size > file_size) {
+            file_size = load[i].file_size;
+        }
+        for (j = 0; j < load[i].nreq; j++) {
+            if (load[i].begin[j] < first_begin) {
+                first_begin = load[i].begin[j];
+            }
+            if (load[i].end[j] > last_end) {
+                last_end = load[i].end[j];
+            }
+        }
+    }
+
+    heatmap_init (&map, &offset_heatmap, file_size, first_begin, last_end);
+    for (i = 0; i < num_threads; i++) {
+        for (j = 0; j < load[i].nreq; j++) {
+            if (load[i].rt_count[j] >= 0) {
+                heatmap_add (&map, load[i].offset[j], load[i].begin[j], load[i].end[j]);
+            }
+        }
+    }
+    heatmap_print (stdout, &map);
+}
+
+//JSON report of the run for ./compare: the arguments, the environment and the write results
+static void write_report (thread_load *load, int num_threads, const char *path, int delay, int argc, char **argv) {
+
+    int i, j;
+    report r;
+    report_series series;
+    char pathbuf[256];
+    const char *file = pathbuf;
+    report_thread *threads = (report_thread*) calloc (num_threads, sizeof (report_thread));
+
+    for (i = 0; i < num_threads; i++) {
+        report_thread_init (&threads[i]);
+        for (j = 0; j < load[i].nreq; j++) {
+            report_thread_add (&threads[i], load[i].begin[j], load[i].end[j], load[i].rt_count[j]);
+        }
+    }
+    report_series_init (&series, threads, num_threads);
+    for (i = 0; i < num_threads; i++) {
+        for (j = 0; j < load[i].nreq; j++) {
+            report_series_add (&series, load[i].begin[j], load[i].end[j], load[i].rt_count[j]);
+        }
+    }
+
+    snprintf (pathbuf, sizeof pathbuf, "%s0", path);
+    report_open (&r, json_path);
+    report_string (&r, "tool", "rw");
+    report_uint (&r, "format", 1);
+    report_begin_object (&r, "config");
+    report_args (&r, argc, argv);
+    report_string (&r, "path", path);
+    report_uint (&r, "threads", num_threads);
+    report_uint (&r, "ops", load[0].nreq);
+    report_uint (&r, "bs", load[0].blksize);
+    report_uint (&r, "delay_us", delay);
+    report_string (&r, "offsets", offsets_mode_name (offset_mode));
+    report_string (&r, "workers", pool.procs ? "procs" : "threads");
+    report_end_object (&r);
+    report_environment (&r, &file, 1);
+    report_begin_object (&r, "results");
+    report_begin_array (&r, "groups", 0);
+    report_op_group (&r, "write", threads, num_threads, &series);
+    report_end_array (&r);
+    report_end_object (&r);
+    report_close (&r);
+    free (threads);
+}
+
+// To run, type: ./rw <num_threads> <delay> <num_ops_per_thread> <path> <blksize> debug|no-debug [rand|perm|perm-slice] [seed] [perf] [iostat[=<interval_ms>]] [verify] [gen=<generation>] [threads|procs] [heatmap[=<regions>x<slices>][,json]] [pattern options] [json=<file>]
+//                    [bufs=<M>] [huge=none|thp|hugetlb] [mlock] [prefault]
+//                    [slow=<us>] [slowtop=<K>] [slowcap=<N>]
+//                    [iov=<N>] [seg=<bytes>] [rwf=nowait|hipri|dsync[,...]|none]
 int main (int argc, char* argv[]) {
 
     int i, j, fd;
     char pathbuf[256];
     struct stat st;
+    uint64_t seed;
 
     int num_threads = atoi (argv[1]);
     int delay = atoi (argv[2]);
@@ -96,12 +194,65 @@ int main (int argc, char* argv[]) {
 
     printf ("debug args=%s flag=%d\n", argv[6], debug);
 
-    srand(time(NULL));
+    //optional, in any order: rand|perm|perm-slice (every thread on <path>0), <seed>, perf, iostat[=<interval_ms>], verify, gen=<generation>, threads|procs, json=<file>,
+    //heatmap[=<regions>x<slices>][,json],
+    //pattern=uninit|zero|random, compress=<ratio>, dedupe=<ratio>, pool=<blocks>, unique,
+    //bufs=<M>, huge=none|thp|hugetlb, mlock, prefault, slow=<us>, slowtop=<K>, slowcap=<N>,
+    //iov=<N>, seg=<bytes>, rwf=nowait|hipri|dsync[,...]
+    offset_mode = RANDOM_OFFSETS;
+    seed = (uint64_t) time (NULL);
+    json_path = NULL;
+    iostat_interval_ms = -1;
+    heatmap_spec_init (&offset_heatmap);
+    blockio_spec_init (&requests, 1);
+    slowlog_spec_init (&slow_spec);
+    for (i = 7; i < argc; i++) {
+        if (offsets_parse_mode (&offset_mode, argv[i])) {
+            continue;
+        } else if (strcmp (argv[i], "iostat") == 0) {
+            iostat_interval_ms = 0;
+        } else if (strncmp (argv[i], "iostat=", 7) == 0) {
+            iostat_interval_ms = atoi (argv[i] + 7);
+        } else if (isdigit ((unsigned char) argv[i][0])) {
+            seed = strtoull (argv[i], NULL, 10);
+        } else if (strncmp (argv[i], "json=", 5) == 0) {
+            json_path = argv[i] + 5;
+        } else if (workers_parse_option (&pool, argv[i])) {
+            continue;
+        } else if (blockio_parse_option (&requests, argv[i], 1)) {
+            continue;
+        } else if (slowlog_parse_option (&slow_spec, argv[i])) {
+            continue;
+        } else if (heatmap_parse_option (&offset_heatmap, argv[i])) {
+            continue;
+        } else {
+            fprintf (stderr, "Invalid option %s, must be one of: rand, perm, perm-slice, perf, iostat[=<ms>], verify, gen=<n>, threads, procs, json=<file>, heatmap[=<r>x<s>][,json], a pattern option, a buffer option, a slow log option, a vectored I/O option or a seed\n", argv[i]);
+            exit (EXIT_FAILURE);
+        }
+    }
 
-    thread_load* load = (thread_load*) malloc (sizeof (thread_load) * num_threads);
+    timed = debug || offset_heatmap.enabled || json_path != NULL;
+
+    workers_init (&pool, num_threads);
+    thread_load* load = (thread_load*) workers_calloc (&pool, num_threads, sizeof (thread_load));
+    verify_stats* verified = (verify_stats*) workers_calloc (&pool, num_threads, sizeof (verify_stats));
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) workers_calloc (&pool, 1, slowlog_size (&slow_spec, num_threads));
+        slowlog_init (slow_log, &slow_spec, num_threads);
+        requests.slow_log = slow_log;
+    }
+    if (requests.verify) {
+        //stamps cover whole VERIFY_BLOCKs, partial ones would be overwritten or never stamped
+        if (blksize % VERIFY_BLOCK != 0) {
+            fprintf (stderr, "verify needs a block size multiple of %d bytes\n", VERIFY_BLOCK);
+            exit (EXIT_FAILURE);
+        }
+        verify_init ();
+    }
     for (i = 0; i < num_threads; i++) {
 
-	snprintf (pathbuf, sizeof pathbuf, "%s%d", path, i);
+	//perm-slice splits one permutation between the threads, so they share <path>0
+	snprintf (pathbuf, sizeof pathbuf, "%s%d", path, offset_mode == PERM_SLICE_OFFSETS ? 0 : i);
 	fd = open (pathbuf, O_RDWR | O_LARGEFILE, ACCESS_PERMISSION);
 	if (fd < 0) {
   	    fprintf (stderr, "Error opening file: %s\n", strerror (errno));
@@ -113,30 +264,51 @@ int main (int argc, char* argv[]) {
 	load[i].fd = fd;
         load[i].thread_id = i;
 	load[i].nreq = num_ops_per_thread;
-	load[i].delay = delay;
 	load[i].blksize = blksize;
-	load[i].buf = (char*) malloc (sizeof (char) * blksize);
-	load[i].rt_count = (ssize_t*) calloc (num_ops_per_thread, sizeof(ssize_t));
+	blockio_init (&load[i].io, &requests, fd, blksize, i, &verified[i], seed + i);
+	pacer_init (&load[i].pace, 0, i, num_threads, 0, delay * 1000ULL);
+	load[i].rt_count = (ssize_t*) workers_calloc (&pool, num_ops_per_thread, sizeof(ssize_t));
 
-	if (debug) {
-	    load[i].begin = (uint64_t*) calloc (num_ops_per_thread, sizeof(uint64_t));
-	    load[i].end = (uint64_t*) calloc (num_ops_per_thread, sizeof(uint64_t));
-	    load[i].offset = (long*) calloc (num_ops_per_thread, sizeof(long));
+	if (timed) {
+	    load[i].begin = (uint64_t*) workers_calloc (&pool, num_ops_per_thread, sizeof(uint64_t));
+	    load[i].end = (uint64_t*) workers_calloc (&pool, num_ops_per_thread, sizeof(uint64_t));
+	    load[i].offset = (long*) workers_calloc (&pool, num_ops_per_thread, sizeof(long));
 	} else {
 	    load[i].begin = NULL;
 	    load[i].end = NULL;
-	    load[i].offset = (long*) calloc (num_ops_per_thread, sizeof(long));
+	    load[i].offset = (long*) workers_calloc (&pool, num_ops_per_thread, sizeof(long));
+	}
+
+	//random offsets stay on whole VERIFY_BLOCKs in verify mode
+	if (offsets_init (&load[i].where, offset_mode, st.st_size, blksize, requests.verify ? VERIFY_BLOCK : 1,
+			i, num_threads, seed) < 0) {
+  	    fprintf (stderr, "File %s has fewer blocks than threads\n", pathbuf);
+	    exit (EXIT_FAILURE);
 	}
     }
 
-    pthread_t *requesters = (pthread_t*) malloc (sizeof (pthread_t) * num_threads);
-    for (i = 0; i < num_threads; i++) {
-        pthread_create (&requesters[i], NULL, request, (void *) &load[i]);
+    io_stats iostats;
+    if (iostat_interval_ms >= 0) {
+        snprintf (pathbuf, sizeof pathbuf, "%s0", path);
+        io_stats_init (&iostats, pathbuf);
+        io_stats_start (&iostats, iostat_interval_ms);
     }
 
-    for (i = 0; i < num_threads; i++) {
-        pthread_join (requesters[i], NULL);
+    workers_start (&pool, request, load, sizeof (thread_load));
+    workers_join (&pool);
+
+    if (iostat_interval_ms >= 0) {
+        uint64_t app_bytes = 0;
+        for (i = 0; i < num_threads; i++) {
+            for (j = 0; j < load[i].nreq; j++) {
+                if (load[i].rt_count[j] > 0) {
+                    app_bytes += load[i].rt_count[j];
+                }
+            }
+        }
+        io_stats_stop (&iostats, 0, app_bytes);
     }
+
     if (debug) {
         for (i = 0; i < num_threads; i++) {
 	    for (j = 0; j < load[i].nreq; j++) {
@@ -146,6 +318,34 @@ int main (int argc, char* argv[]) {
 	}
     }
 
+    if (offset_heatmap.enabled) {
+        print_heatmap (load, num_threads);
+    }
+
+    //buffer, vectored I/O and perf summaries of the requests: perf,write,ops,cycles,instructions,llc-misses,cs,faults,migrations
+    blockio_totals total;
+    uint64_t bytes = 0;
+    blockio_totals_init (&total);
+    for (i = 0; i < num_threads; i++) {
+        for (j = 0; j < load[i].nreq; j++) {
+            if (load[i].rt_count[j] > 0) {
+                bytes += load[i].rt_count[j];
+            }
+        }
+        blockio_merge (&total, &load[i].io);
+    }
+    blockio_print_summary (stdout, "write", &requests, blksize, bytes, (uint64_t) num_threads * num_ops_per_thread, &total);
+
+    if (requests.verify) {
+        verify_print (stdout, verified, num_threads);
+    }
+
+    slowlog_print (stdout, slow_log);
+
+    if (json_path != NULL) {
+        write_report (load, num_threads, path, delay, argc, argv);
+    }
+
     return 0;
 }
 
@@ -1,9 +1,10 @@
 #define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE //readahead
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
-#include <unistd.h> //usleep
+#include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -15,67 +16,151 @@
 #define __STDC_FORMAT_MACRO
 #include <inttypes.h>
 
+#include "blockio.h"
+#include "iostats.h"
+#include "workers.h"
+#include "streams.h"
+#include "report.h"
+
 #define ACCESS_PERMISSION 0777
 
 //FIXME: add header and explain the parts we used from zev code
-//FIXME: refactor workload code they share a lot
 
 int debug;
 
+//request timestamps, kept for debug and the JSON report
+int timed;
+
+//JSON report of the run for ./compare, NULL when disabled
+const char *json_path;
+
 //the sequential operation batch start at a random offset
 long start_offset;
 
+//streams, stride and direction of the requests, advice and readahead
+stream_spec layout;
+
+//kernel and device accounting of the measured phase, -1 when disabled
+int iostat_interval_ms;
+
+//pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+
+//buffers, counters, vectored calls and the check of the block stamps written by the verify mode of rw/seqw
+blockio_spec requests;
+
+//slow requests with the context switches and faults of their thread, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+
 typedef struct thread_load {
     int thread_id;
     int fd;
     long file_size;
     ssize_t * rt_count;
+    long start;
     int nreq;
-    useconds_t delay;
-    char * buf;
     int blksize;
     uint64_t * begin;
     uint64_t * end;
+    uint64_t first_begin;
+    uint64_t last_end;
+    pacer pace;
+    blockio io;
 } thread_load;
 
-static uint64_t stamp (void) {
-   struct timespec tspec;
-   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
-       fprintf (stderr, "Error getting timestamp: %s\n", strerror(errno));
-       exit (EXIT_FAILURE);
-   }
-   return (tspec.tv_sec * 1000000000ULL) + tspec.tv_nsec;
-}
-
 static void *request (void *arg) {
 
     int i;
+    long ra_offset, ra_length;
     thread_load* load = arg;
 
-    lseek (load->fd, start_offset, SEEK_SET);
+    blockio_begin (&load->io, &requests);
+
+    //plain forward scans keep using the file position, the other layouts pread/pwrite
+    load->io.plain = stream_is_plain (&layout, load->blksize);
+    long pos = load->start;
+    lseek (load->fd, load->start, SEEK_SET);
+
+    load->first_begin = stamp ();
 
     for (i = 0; i < load->nreq; i++) {
-        if (load->delay > 0) {
-	    usleep (load->delay);
-	}
+        pacer_wait (&load->pace, UINT64_MAX, NULL);
 
-	if (debug) {
-	    load->begin[i] = stamp ();
+	if (!load->io.plain) {
+	    pos = stream_offset (&layout, load->start, load->nreq, load->blksize, i);
+	}
+	if (stream_readahead_due (&layout, load->blksize, i, &ra_offset, &ra_length)) {
+	    readahead (load->fd, pos + ra_offset > 0 ? pos + ra_offset : 0, ra_length);
 	}
-        load->rt_count[i] = read (load->fd, load->buf, load->blksize);
-	if (debug) {
-	    load->end[i] = stamp ();
+	load->rt_count[i] = blockio_read (&load->io, &requests, pos,
+			timed ? &load->begin[i] : NULL, timed ? &load->end[i] : NULL);
+	if (load->io.plain && load->rt_count[i] > 0) {
+	    pos += load->rt_count[i];
 	}
     }
+    load->last_end = stamp ();
+    blockio_end (&load->io, &requests);
 
     return NULL;
 }
 
+//JSON report of the run for ./compare: the arguments, the environment and the read results
+static void write_report (thread_load *load, int num_threads, const char *path, int delay, int argc, char **argv) {
+
+    int i, j;
+    report r;
+    report_series series;
+    char pathbuf[256];
+    const char *file = pathbuf;
+    report_thread *threads = (report_thread*) calloc (num_threads, sizeof (report_thread));
+
+    for (i = 0; i < num_threads; i++) {
+        report_thread_init (&threads[i]);
+        for (j = 0; j < load[i].nreq; j++) {
+            report_thread_add (&threads[i], load[i].begin[j], load[i].end[j], load[i].rt_count[j]);
+        }
+    }
+    report_series_init (&series, threads, num_threads);
+    for (i = 0; i < num_threads; i++) {
+        for (j = 0; j < load[i].nreq; j++) {
+            report_series_add (&series, load[i].begin[j], load[i].end[j], load[i].rt_count[j]);
+        }
+    }
+
+    snprintf (pathbuf, sizeof pathbuf, "%s0", path);
+    report_open (&r, json_path);
+    report_string (&r, "tool", "seqr");
+    report_uint (&r, "format", 1);
+    report_begin_object (&r, "config");
+    report_args (&r, argc, argv);
+    report_string (&r, "path", path);
+    report_uint (&r, "threads", num_threads);
+    report_uint (&r, "ops", load[0].nreq);
+    report_uint (&r, "bs", load[0].blksize);
+    report_uint (&r, "delay_us", delay);
+    report_string (&r, "workers", pool.procs ? "procs" : "threads");
+    report_end_object (&r);
+    report_environment (&r, &file, 1);
+    report_begin_object (&r, "results");
+    report_begin_array (&r, "groups", 0);
+    report_op_group (&r, "read", threads, num_threads, &series);
+    report_end_array (&r);
+    report_end_object (&r);
+    report_close (&r);
+    free (threads);
+}
+
+// To run, type: ./seqr <num_threads> <delay> <num_ops_per_thread> <path> <blksize> debug|no-debug [perf] [iostat[=<interval_ms>]] [verify] [gen=<generation>] [threads|procs] [stream options] [json=<file>]
+//                      [bufs=<M>] [huge=none|thp|hugetlb] [mlock] [prefault]
+//                      [slow=<us>] [slowtop=<K>] [slowcap=<N>]
+//                      [iov=<N>] [seg=<bytes>] [rwf=nowait|hipri|dsync[,...]|none]
 int main (int argc, char* argv[]) {
 
     int i, j, fd;
     char pathbuf[256];
     struct stat st;
+    long extent;
 
     int num_threads = atoi (argv[1]);
     int delay = atoi (argv[2]);
@@ -92,9 +177,56 @@ int main (int argc, char* argv[]) {
 	exit (EXIT_FAILURE);
     }
 
+    //optional, in any order: perf, iostat[=<interval_ms>], verify, gen=<generation>, threads|procs, json=<file>,
+    //streams=<K>, stride=<bytes>, reverse, randstart, fadvise=sequential|random|noreuse, readahead=<KB>, ra_kb=<KB>,
+    //bufs=<M>, huge=none|thp|hugetlb, mlock, prefault, slow=<us>, slowtop=<K>, slowcap=<N>,
+    //iov=<N>, seg=<bytes>, rwf=nowait|hipri|dsync[,...]
+    json_path = NULL;
+    iostat_interval_ms = -1;
+    stream_spec_init (&layout);
+    blockio_spec_init (&requests, 0);
+    slowlog_spec_init (&slow_spec);
+    for (i = 7; i < argc; i++) {
+        if (strcmp (argv[i], "iostat") == 0) {
+            iostat_interval_ms = 0;
+        } else if (strncmp (argv[i], "iostat=", 7) == 0) {
+            iostat_interval_ms = atoi (argv[i] + 7);
+        } else if (strncmp (argv[i], "json=", 5) == 0) {
+            json_path = argv[i] + 5;
+        } else if (workers_parse_option (&pool, argv[i])) {
+            continue;
+        } else if (blockio_parse_option (&requests, argv[i], 0)) {
+            continue;
+        } else if (slowlog_parse_option (&slow_spec, argv[i])) {
+            continue;
+        } else if (stream_parse_option (&layout, argv[i])) {
+            continue;
+        } else {
+            fprintf (stderr, "Invalid option %s, must be one of: perf, iostat[=<ms>], verify, gen=<n>, threads, procs, json=<file>, a buffer option, a slow log option, a vectored I/O option or a stream option\n", argv[i]);
+            exit (EXIT_FAILURE);
+        }
+    }
+
     srand(time(NULL));
 
-    thread_load* load = (thread_load*) malloc (sizeof (thread_load) * num_threads);
+    timed = debug || json_path != NULL;
+
+    workers_init (&pool, num_threads);
+    thread_load* load = (thread_load*) workers_calloc (&pool, num_threads, sizeof (thread_load));
+    verify_stats* verified = (verify_stats*) workers_calloc (&pool, num_threads, sizeof (verify_stats));
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) workers_calloc (&pool, 1, slowlog_size (&slow_spec, num_threads));
+        slowlog_init (slow_log, &slow_spec, num_threads);
+        requests.slow_log = slow_log;
+    }
+    if (requests.verify) {
+        //stamps cover whole VERIFY_BLOCKs, partial ones would be overwritten or never stamped
+        if (blksize % VERIFY_BLOCK != 0 || layout.stride % VERIFY_BLOCK != 0) {
+            fprintf (stderr, "verify needs a block size and stride multiple of %d bytes\n", VERIFY_BLOCK);
+            exit (EXIT_FAILURE);
+        }
+        verify_init ();
+    }
     for (i = 0; i < num_threads; i++) {
 
 	snprintf (pathbuf, sizeof pathbuf, "%s%d", path, i);
@@ -107,16 +239,17 @@ int main (int argc, char* argv[]) {
 
 	load[i].file_size = st.st_size;
 	load[i].fd = fd;
+	stream_advise (&layout, fd);
         load[i].thread_id = i;
 	load[i].nreq = num_ops_per_thread;
-	load[i].delay = delay;
 	load[i].blksize = blksize;
-	load[i].buf = (char*) malloc (sizeof (char) * blksize);
-	load[i].rt_count = (ssize_t*) calloc (num_ops_per_thread, sizeof(ssize_t));
+	blockio_init (&load[i].io, &requests, fd, blksize, i, &verified[i], rand ());
+	pacer_init (&load[i].pace, 0, i, num_threads, 0, delay * 1000ULL);
+	load[i].rt_count = (ssize_t*) workers_calloc (&pool, num_ops_per_thread, sizeof(ssize_t));
 
-	if (debug) {
-	    load[i].begin = (uint64_t*) calloc (num_ops_per_thread, sizeof(uint64_t));
-	    load[i].end = (uint64_t*) calloc (num_ops_per_thread, sizeof(uint64_t));
+	if (timed) {
+	    load[i].begin = (uint64_t*) workers_calloc (&pool, num_ops_per_thread, sizeof(uint64_t));
+	    load[i].end = (uint64_t*) workers_calloc (&pool, num_ops_per_thread, sizeof(uint64_t));
 	} else {
 	    load[i].begin = NULL;
 	    load[i].end = NULL;
@@ -125,26 +258,93 @@ int main (int argc, char* argv[]) {
 
     //safe random offset function, we are going to execute nops sequential
     //requests, each requesting blksize bytes
-    start_offset = (long) ((rand() / (double) RAND_MAX) *
-		    (load[0].file_size - (blksize * num_ops_per_thread)));
-
-    pthread_t *requesters = (pthread_t*) malloc (sizeof (pthread_t) * num_threads);
+    extent = stream_extent (&layout, num_ops_per_thread, blksize);
     for (i = 0; i < num_threads; i++) {
-        pthread_create (&requesters[i], NULL, request, (void *) &load[i]);
+        if (i == 0 || layout.randstart) {
+            start_offset = (long) ((rand() / (double) RAND_MAX) * (load[i].file_size - extent));
+            if (start_offset < 0) {
+                start_offset = 0;
+            }
+            if (requests.verify) {
+                start_offset -= start_offset % VERIFY_BLOCK;
+            }
+        }
+        load[i].start = start_offset;
     }
 
-   for (i = 0; i < num_threads; i++) {
-       pthread_join (requesters[i], NULL);
+    snprintf (pathbuf, sizeof pathbuf, "%s0", path);
+    long old_read_ahead_kb = stream_set_read_ahead_kb (pathbuf, layout.read_ahead_kb);
+
+    io_stats iostats;
+    if (iostat_interval_ms >= 0) {
+        snprintf (pathbuf, sizeof pathbuf, "%s0", path);
+        io_stats_init (&iostats, pathbuf);
+        io_stats_start (&iostats, iostat_interval_ms);
+    }
+
+    workers_start (&pool, request, load, sizeof (thread_load));
+    workers_join (&pool);
+
+    if (iostat_interval_ms >= 0) {
+        uint64_t app_bytes = 0;
+        for (i = 0; i < num_threads; i++) {
+            for (j = 0; j < load[i].nreq; j++) {
+                if (load[i].rt_count[j] > 0) {
+                    app_bytes += load[i].rt_count[j];
+                }
+            }
+        }
+        io_stats_stop (&iostats, app_bytes, 0);
     }
+
     if (debug) {
         for (i = 0; i < num_threads; i++) {
 	    for (j = 0; j < load[i].nreq; j++) {
     	        printf ("%d %d %" PRIu64 " %" PRIu64" %ld %d\n", i, j, load[i].begin[j],
-				load[i].end[j], (start_offset + (blksize * j)), load[i].rt_count[j]);
+				load[i].end[j], stream_offset (&layout, load[i].start, load[i].nreq, blksize, j), load[i].rt_count[j]);
 	    }
 	}
     }
 
+    //throughput over the first request start to the last request end, with the layout
+    uint64_t bytes = 0, first_begin = UINT64_MAX, last_end = 0;
+    for (i = 0; i < num_threads; i++) {
+        for (j = 0; j < load[i].nreq; j++) {
+            if (load[i].rt_count[j] > 0) {
+                bytes += load[i].rt_count[j];
+            }
+        }
+        if (load[i].first_begin < first_begin) {
+            first_begin = load[i].first_begin;
+        }
+        if (load[i].last_end > last_end) {
+            last_end = load[i].last_end;
+        }
+    }
+    stream_print_summary (stdout, "read", &layout, bytes, last_end - first_begin,
+            layout.read_ahead_kb >= 0 ? layout.read_ahead_kb : old_read_ahead_kb);
+    if (layout.read_ahead_kb >= 0 && old_read_ahead_kb >= 0) {
+        stream_set_read_ahead_kb (pathbuf, old_read_ahead_kb);
+    }
+
+    //buffer, vectored I/O and perf summaries of the requests: perf,read,ops,cycles,instructions,llc-misses,cs,faults,migrations
+    blockio_totals total;
+    blockio_totals_init (&total);
+    for (i = 0; i < num_threads; i++) {
+        blockio_merge (&total, &load[i].io);
+    }
+    blockio_print_summary (stdout, "read", &requests, blksize, bytes, (uint64_t) num_threads * num_ops_per_thread, &total);
+
+    if (requests.verify) {
+        verify_print (stdout, verified, num_threads);
+    }
+
+    slowlog_print (stdout, slow_log);
+
+    if (json_path != NULL) {
+        write_report (load, num_threads, path, delay, argc, argv);
+    }
+
     return 0;
 }
 
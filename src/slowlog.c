@@ -0,0 +1,239 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h> //getrusage
+#include "slowlog.h"
+
+#define DEFAULT_CAPACITY 4096
+
+/*
+ Sets the default: nothing recorded, room for 4096 threshold records
+
+ Params:
+  - spec: slow log specification
+
+ Returns: none
+*/
+void slowlog_spec_init(slowlog_spec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->capacity = DEFAULT_CAPACITY;
+}
+
+/*
+ Parses one slow log option of the command line
+
+ Accepted options:
+  - slow=<us> (record every operation taking at least that long)
+  - slowtop=<K> (record the K slowest operations of every worker, K overall are printed)
+  - slowcap=<N> (threshold records kept, later ones are only counted)
+
+ Params:
+  - spec: slow log specification being built
+  - option: command line option
+
+ Errors: It fails and exits the program if the option value is invalid
+ Returns: 1 if the option was a slow log option, 0 otherwise
+*/
+int slowlog_parse_option(slowlog_spec *spec, const char *option) {
+    if (strncmp(option, "slow=", 5) == 0) {
+        spec->threshold_ns = strtoull(option + 5, NULL, 10) * 1000ULL;
+        spec->enabled = spec->threshold_ns > 0 || spec->top_k > 0;
+    } else if (strncmp(option, "slowtop=", 8) == 0) {
+        spec->top_k = atoi(option + 8);
+        if (spec->top_k < 0) {
+            fprintf(stderr, "Invalid %s, must be a number of operations\n", option);
+            exit(EXIT_FAILURE);
+        }
+        spec->enabled = spec->threshold_ns > 0 || spec->top_k > 0;
+    } else if (strncmp(option, "slowcap=", 8) == 0) {
+        spec->capacity = atoi(option + 8);
+        if (spec->capacity < 1) {
+            fprintf(stderr, "Invalid %s, need room for at least one record\n", option);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// bytes of the block slowlog_init() lays the log out in
+size_t slowlog_size(const slowlog_spec *spec, int num_threads) {
+    return sizeof(slowlog) + ((size_t) spec->capacity + (size_t) spec->top_k * num_threads) * sizeof(slowlog_record);
+}
+
+static uint64_t slowlog_stamp(void) {
+    struct timespec tspec;
+
+    clock_gettime(CLOCK_MONOTONIC, &tspec);
+    return (tspec.tv_sec * 1000000000ULL) + tspec.tv_nsec;
+}
+
+/*
+ Lays out a slow log in a zeroed block of slowlog_size() bytes
+
+ Params:
+  - log: the block
+  - spec: slow log specification
+  - num_threads: workers recording into it
+
+ Returns: none
+*/
+void slowlog_init(slowlog *log, const slowlog_spec *spec, int num_threads) {
+    log->spec = *spec;
+    log->num_threads = num_threads;
+    log->init_ns = slowlog_stamp();
+    log->records = (slowlog_record*) (log + 1);
+    log->top = log->records + spec->capacity;
+}
+
+/*
+ Marks the start of an operation. getrusage() is taken every time, as the
+ deltas of a slow operation need the counters from before it started.
+
+ Params:
+  - log: slow log, NULL when disabled
+  - probe: state of the operation
+
+ Returns: none
+*/
+void slowlog_begin(const slowlog *log, slowlog_probe *probe) {
+    if (log == NULL) {
+        return;
+    }
+    getrusage(RUSAGE_THREAD, &probe->usage);
+    probe->begin = slowlog_stamp();
+}
+
+/*
+ Marks the end of an operation and records it if it was slow
+
+ Params:
+  - log: slow log, NULL when disabled
+  - probe: state given to slowlog_begin()
+  - thread: worker index
+  - op: operation name
+  - path: file of the operation, or NULL
+  - offset: offset of the operation, or -1
+
+ Returns: none
+*/
+void slowlog_end(slowlog *log, const slowlog_probe *probe, int thread, const char *op, const char *path, long offset) {
+    slowlog_record rec, *top = NULL;
+    struct rusage usage;
+    uint64_t latency;
+    int over;
+
+    if (log == NULL) {
+        return;
+    }
+    latency = slowlog_stamp() - probe->begin;
+    over = log->spec.threshold_ns > 0 && latency >= log->spec.threshold_ns;
+    // the fastest of the worker's top-K is the one to replace
+    for (int i = 0; i < log->spec.top_k; i++) {
+        slowlog_record *slot = &log->top[thread * log->spec.top_k + i];
+        if (top == NULL || slot->latency_ns < top->latency_ns) {
+            top = slot;
+        }
+    }
+    if (top != NULL && top->latency_ns >= latency) {
+        top = NULL;
+    }
+    if (!over && top == NULL) {
+        return;
+    }
+
+    getrusage(RUSAGE_THREAD, &usage);
+    memset(&rec, 0, sizeof(rec));
+    rec.start_ns = probe->begin;
+    rec.latency_ns = latency;
+    rec.thread = thread;
+    snprintf(rec.op, sizeof rec.op, "%s", op);
+    if (path != NULL) {
+        size_t len = strlen(path);
+        snprintf(rec.path, sizeof rec.path, "%s", len < sizeof rec.path ? path : path + len - (sizeof rec.path - 1));
+    }
+    rec.offset = offset;
+    rec.voluntary_cs = usage.ru_nvcsw - probe->usage.ru_nvcsw;
+    rec.involuntary_cs = usage.ru_nivcsw - probe->usage.ru_nivcsw;
+    rec.minor_faults = usage.ru_minflt - probe->usage.ru_minflt;
+    rec.major_faults = usage.ru_majflt - probe->usage.ru_majflt;
+    rec.in_blocks = usage.ru_inblock - probe->usage.ru_inblock;
+    rec.out_blocks = usage.ru_oublock - probe->usage.ru_oublock;
+
+    if (over) {
+        uint64_t slot = __atomic_fetch_add(&log->next, 1, __ATOMIC_RELAXED);
+        if (slot < (uint64_t) log->spec.capacity) {
+            log->records[slot] = rec;
+        } else {
+            __atomic_fetch_add(&log->dropped, 1, __ATOMIC_RELAXED);
+        }
+    }
+    if (top != NULL) {
+        *top = rec;
+    }
+}
+
+static int by_start(const void *a, const void *b) {
+    const slowlog_record *x = a, *y = b;
+    return (x->start_ns > y->start_ns) - (x->start_ns < y->start_ns);
+}
+
+static int by_latency_desc(const void *a, const void *b) {
+    const slowlog_record *x = a, *y = b;
+    return (x->latency_ns < y->latency_ns) - (x->latency_ns > y->latency_ns);
+}
+
+static void print_record(FILE *out, const char *kind, int index, const slowlog *log, const slowlog_record *rec) {
+    fprintf(out, "%s,%d,%d,%s,%s,%ld,%lu,%.3f,%lu,%ld,%ld,%ld,%ld,%ld,%ld\n", kind, index, rec->thread, rec->op,
+            rec->path, rec->offset, (unsigned long) rec->start_ns, (rec->start_ns - log->init_ns) / 1e6,
+            (unsigned long) rec->latency_ns, rec->voluntary_cs, rec->involuntary_cs, rec->minor_faults,
+            rec->major_faults, rec->in_blocks, rec->out_blocks);
+}
+
+/*
+ Dumps the slow log once the workers are done:
+   slowlog,<threshold_ns>,<recorded>,<dropped>,<top_k>
+   slowlog-op,<n>,<thread>,<op>,<path>,<offset>,<start_ns>,<start_ms>,<latency_ns>,<vcs>,<ivcs>,<minflt>,<majflt>,<inblock>,<oublock>
+   slowlog-top,<rank>,... (same fields)
+ Threshold records come by start time, start_ns being CLOCK_MONOTONIC (as
+ in ftrace and perf) and start_ms relative to slowlog_init(). The top-K are
+ the slowest of all the workers' top-K.
+
+ Params:
+  - out: output stream
+  - log: slow log, NULL when disabled
+
+ Returns: none
+*/
+void slowlog_print(FILE *out, const slowlog *log) {
+    uint64_t recorded;
+    int num_top = 0, k = log ? log->spec.top_k : 0;
+    slowlog_record *all;
+
+    if (log == NULL) {
+        return;
+    }
+    recorded = log->next < (uint64_t) log->spec.capacity ? log->next : (uint64_t) log->spec.capacity;
+    fprintf(out, "slowlog,%lu,%lu,%lu,%d\n", (unsigned long) log->spec.threshold_ns, (unsigned long) recorded,
+            (unsigned long) log->dropped, k);
+
+    qsort(log->records, recorded, sizeof(slowlog_record), by_start);
+    for (uint64_t i = 0; i < recorded; i++) {
+        print_record(out, "slowlog-op", (int) i, log, &log->records[i]);
+    }
+
+    all = (slowlog_record*) malloc(((size_t) k * log->num_threads + 1) * sizeof(slowlog_record));
+    for (int i = 0; i < k * log->num_threads; i++) {
+        if (log->top[i].latency_ns > 0) {
+            all[num_top++] = log->top[i];
+        }
+    }
+    qsort(all, num_top, sizeof(slowlog_record), by_latency_desc);
+    for (int i = 0; i < num_top && i < k; i++) {
+        print_record(out, "slowlog-top", i, log, &all[i]);
+    }
+    free(all);
+}
@@ -0,0 +1,62 @@
+#ifndef SLOWLOG_H
+#define SLOWLOG_H
+
+#include <stdio.h>
+#include <stddef.h> //size_t
+#include <stdint.h> //uint64_t
+#include <sys/resource.h> //struct rusage
+
+// Slow operations are recorded when they take at least <threshold_ns>, into
+// a bounded buffer shared by the workers, and/or when they are among the
+// <top_k> slowest of their worker.
+typedef struct slowlog_spec {
+    uint64_t threshold_ns;  // 0 disables the threshold
+    int top_k;              // 0 disables the top-K
+    int capacity;           // records of the threshold buffer
+    int enabled;
+} slowlog_spec;
+
+// One slow operation, with what the worker's thread went through meanwhile
+typedef struct slowlog_record {
+    uint64_t start_ns;      // CLOCK_MONOTONIC
+    uint64_t latency_ns;
+    int thread;
+    char op[16];
+    char path[64];          // tail of the path, empty if none
+    long offset;            // -1 if none
+    long voluntary_cs;
+    long involuntary_cs;
+    long minor_faults;
+    long major_faults;
+    long in_blocks;
+    long out_blocks;
+} slowlog_record;
+
+// Lives in one block of slowlog_size() bytes (shared memory in process mode):
+// the header, the threshold records claimed with an atomic add, then top_k
+// records per worker, each written by its worker only.
+typedef struct slowlog {
+    slowlog_spec spec;
+    int num_threads;
+    uint64_t init_ns;
+    uint64_t next;
+    uint64_t dropped;
+    slowlog_record *records;
+    slowlog_record *top;
+} slowlog;
+
+// State of one operation between slowlog_begin() and slowlog_end()
+typedef struct slowlog_probe {
+    uint64_t begin;
+    struct rusage usage;
+} slowlog_probe;
+
+void slowlog_spec_init(slowlog_spec *spec);
+int slowlog_parse_option(slowlog_spec *spec, const char *option);
+size_t slowlog_size(const slowlog_spec *spec, int num_threads);
+void slowlog_init(slowlog *log, const slowlog_spec *spec, int num_threads);
+void slowlog_begin(const slowlog *log, slowlog_probe *probe);
+void slowlog_end(slowlog *log, const slowlog_probe *probe, int thread, const char *op, const char *path, long offset);
+void slowlog_print(FILE *out, const slowlog *log);
+
+#endif
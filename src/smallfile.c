@@ -0,0 +1,531 @@
+#define _LARGEFILE64_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h> //log
+#include <sys/types.h>
+#include <stdint.h> //uint64_t
+#include <stdlib.h> //rand_r
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "workers.h"
+#include "slowlog.h"
+
+#define ACCESS_PERMISSION 0777
+#define NSEC 1000000000ULL
+#define MAX_MIX_ENTRIES 16
+
+// Phases every file goes through, in order
+enum phases {
+    CREATE,
+    WRITE,
+    SYNC,
+    CLOSE,
+    READ,
+    UNLINK,
+    NUM_PHASES
+};
+
+enum sync_modes {
+    NO_SYNC,
+    FSYNC,
+    FDATASYNC
+};
+
+enum dist_types {
+    FIXED,
+    UNIFORM,
+    EXPONENTIAL,
+    MIX
+};
+
+typedef struct size_dist {
+    int type;
+    size_t min;
+    size_t max;
+    double mean;
+    int num_entries;
+    size_t sizes[MAX_MIX_ENTRIES];
+    int weights[MAX_MIX_ENTRIES];
+    int total_weight;
+} size_dist;
+
+typedef struct thread_load {
+    int thread_id;
+    char *root_path;
+    int num_files;
+    unsigned int seed;
+    char *buf;
+    size_t *sizes;
+    // latencies[phase][file], indexed from the thread's first file
+    uint64_t *latencies[NUM_PHASES];
+    // wall time of the create/write pass, the read pass and the unlink pass
+    uint64_t create_pass_ns;
+    uint64_t read_pass_ns;
+    uint64_t unlink_pass_ns;
+} thread_load;
+
+size_dist file_sizes;
+int sync_mode;
+int detailed_latency;
+// pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+// slow operations with the context switches and faults of their thread, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+
+/*
+ Gets the current timestamp in nanoseconds
+
+ Params: none
+
+ Errors: It fails and exits the program if it's not possible to get the timestamp
+ Returns: The current timestamp in nanoseconds
+*/
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
+       perror("Error getting timestamp");
+       exit(EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+/*
+ Gets the mean of an array
+
+ Params:
+  - numbers: Array of numbers
+  - size: Array size
+
+ Returns: The mean of the array elements
+*/
+uint64_t mean(uint64_t * numbers, size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        sum += numbers[i];
+    }
+    return sum/size;
+}
+
+/*
+ Parses a file size distribution
+
+ Accepted formats:
+  - fixed:SIZE
+  - uniform:MIN:MAX
+  - exp:MEAN:MAX (exponential, truncated at MAX)
+  - mix:SIZExWEIGHT,SIZExWEIGHT,... (e.g. mix:4096x70,65536x25,1048576x5)
+
+ Params:
+  - spec: user inputed distribution
+  - dist: distribution to be filled
+
+ Errors: It fails and exits the program if the spec can't be parsed
+ Returns: none
+*/
+void parse_size_dist(char *spec, size_dist *dist) {
+    char *cursor;
+
+    memset(dist, 0, sizeof(*dist));
+
+    if (sscanf(spec, "fixed:%zu", &dist->max) == 1) {
+        dist->type = FIXED;
+        dist->min = dist->max;
+    } else if (sscanf(spec, "uniform:%zu:%zu", &dist->min, &dist->max) == 2) {
+        dist->type = UNIFORM;
+    } else if (sscanf(spec, "exp:%lf:%zu", &dist->mean, &dist->max) == 2) {
+        dist->type = EXPONENTIAL;
+    } else if (strncmp(spec, "mix:", 4) == 0) {
+        dist->type = MIX;
+        cursor = spec + 4;
+        while (*cursor != '\0' && dist->num_entries < MAX_MIX_ENTRIES) {
+            int consumed = 0;
+            if (sscanf(cursor, "%zux%d%n", &dist->sizes[dist->num_entries],
+                        &dist->weights[dist->num_entries], &consumed) != 2) {
+                break;
+            }
+            if (dist->sizes[dist->num_entries] > dist->max) {
+                dist->max = dist->sizes[dist->num_entries];
+            }
+            dist->total_weight += dist->weights[dist->num_entries];
+            dist->num_entries++;
+            cursor += consumed;
+            if (*cursor == ',') {
+                cursor++;
+            }
+        }
+        if (dist->num_entries == 0 || dist->total_weight <= 0 || *cursor != '\0') {
+            fprintf(stderr, "Invalid size mix %s.\n", spec);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        fprintf(stderr, "Invalid size distribution %s, must be one of: "
+                "fixed:SIZE, uniform:MIN:MAX, exp:MEAN:MAX or mix:SIZExWEIGHT,...\n", spec);
+        exit(EXIT_FAILURE);
+    }
+
+    if (dist->max < dist->min || (dist->type == EXPONENTIAL && dist->mean <= 0)) {
+        fprintf(stderr, "Invalid size distribution %s.\n", spec);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ Draws a file size from the distribution
+
+ Params:
+  - dist: file size distribution
+  - seed: per-thread random state
+
+ Returns: The file size in bytes
+*/
+size_t draw_size(size_dist *dist, unsigned int *seed) {
+    double u;
+    int pick;
+    size_t size;
+
+    switch (dist->type) {
+    case UNIFORM:
+        return dist->min + (size_t) ((rand_r(seed) / ((double) RAND_MAX + 1)) * (dist->max - dist->min + 1));
+    case EXPONENTIAL:
+        u = (rand_r(seed) + 1.0) / ((double) RAND_MAX + 1);
+        size = (size_t) (-log(u) * dist->mean);
+        return size > dist->max ? dist->max : size;
+    case MIX:
+        pick = rand_r(seed) % dist->total_weight;
+        for (int i = 0; i < dist->num_entries; i++) {
+            if (pick < dist->weights[i]) {
+                return dist->sizes[i];
+            }
+            pick -= dist->weights[i];
+        }
+        return dist->sizes[dist->num_entries - 1];
+    default:
+        return dist->max;
+    }
+}
+
+/*
+ Creates, writes, optionally syncs and closes one file
+
+ Params:
+  - load: thread load
+  - dst_path: file path
+  - file: index of the file in the thread load
+
+ Errors: It fails and exits the program if one of the operations can't be made
+ Returns: none
+*/
+void issue_create(thread_load *load, char *dst_path, int file) {
+    uint64_t begin, end;
+    size_t done = 0;
+    ssize_t ret;
+    int fd;
+    slowlog_probe probe;
+
+    slowlog_begin(slow_log, &probe);
+    begin = stamp();
+    fd = open(dst_path, O_CREAT | O_EXCL | O_WRONLY, ACCESS_PERMISSION);
+    end = stamp();
+    slowlog_end(slow_log, &probe, load->thread_id, "create", dst_path, -1);
+    if (fd < 0) {
+        fprintf(stderr, "Couldn't open(O_CREAT) to %s: %s\n", dst_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    load->latencies[CREATE][file] = end - begin;
+
+    slowlog_begin(slow_log, &probe);
+    begin = stamp();
+    while (done < load->sizes[file]) {
+        ret = write(fd, load->buf + done, load->sizes[file] - done);
+        if (ret < 0) {
+            fprintf(stderr, "Couldn't write() to %s: %s\n", dst_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        done += ret;
+    }
+    end = stamp();
+    slowlog_end(slow_log, &probe, load->thread_id, "write", dst_path, -1);
+    load->latencies[WRITE][file] = end - begin;
+
+    slowlog_begin(slow_log, &probe);
+    begin = stamp();
+    if ((sync_mode == FSYNC && fsync(fd) != 0) || (sync_mode == FDATASYNC && fdatasync(fd) != 0)) {
+        fprintf(stderr, "Couldn't sync %s: %s\n", dst_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    end = stamp();
+    slowlog_end(slow_log, &probe, load->thread_id, "sync", dst_path, -1);
+    load->latencies[SYNC][file] = (sync_mode == NO_SYNC) ? 0 : end - begin;
+
+    slowlog_begin(slow_log, &probe);
+    begin = stamp();
+    if (close(fd) != 0) {
+        fprintf(stderr, "Couldn't close() %s: %s\n", dst_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    end = stamp();
+    slowlog_end(slow_log, &probe, load->thread_id, "close", dst_path, -1);
+    load->latencies[CLOSE][file] = end - begin;
+}
+
+/*
+ Reads one file back (open, read until EOF, close)
+
+ Params:
+  - load: thread load
+  - dst_path: file path
+  - file: index of the file in the thread load
+
+ Errors: It fails and exits the program if the file can't be read back
+ Returns: none
+*/
+void issue_read(thread_load *load, char *dst_path, int file) {
+    uint64_t begin, end;
+    size_t done = 0;
+    ssize_t ret;
+    int fd;
+    slowlog_probe probe;
+
+    slowlog_begin(slow_log, &probe);
+    begin = stamp();
+    fd = open(dst_path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Couldn't open() to %s: %s\n", dst_path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    while ((ret = read(fd, load->buf, file_sizes.max + 1)) > 0) {
+        done += ret;
+    }
+    close(fd);
+    end = stamp();
+    slowlog_end(slow_log, &probe, load->thread_id, "read", dst_path, -1);
+
+    if (ret < 0 || done != load->sizes[file]) {
+        fprintf(stderr, "Couldn't read back %s (got %zu of %zu bytes)\n", dst_path, done, load->sizes[file]);
+        exit(EXIT_FAILURE);
+    }
+    load->latencies[READ][file] = end - begin;
+}
+
+/*
+ Runs the three passes of the thread: create/write/sync/close every file,
+ read every file back and unlink every file
+
+ Params:
+  - args: struct of thread load
+
+ Errors: none
+ Returns: NULL
+*/
+static void* thread_init(void* args) {
+    thread_load* load = (thread_load*) args;
+    char dst_path[256];
+    uint64_t begin, end, pass_begin;
+    slowlog_probe probe;
+
+    pass_begin = stamp();
+    for (int file = 0; file < load->num_files; ++file) {
+        snprintf(dst_path, sizeof dst_path, "%s/sf-%d-%d", load->root_path, load->thread_id, file);
+        issue_create(load, dst_path, file);
+    }
+    load->create_pass_ns = stamp() - pass_begin;
+
+    pass_begin = stamp();
+    for (int file = 0; file < load->num_files; ++file) {
+        snprintf(dst_path, sizeof dst_path, "%s/sf-%d-%d", load->root_path, load->thread_id, file);
+        issue_read(load, dst_path, file);
+    }
+    load->read_pass_ns = stamp() - pass_begin;
+
+    pass_begin = stamp();
+    for (int file = 0; file < load->num_files; ++file) {
+        snprintf(dst_path, sizeof dst_path, "%s/sf-%d-%d", load->root_path, load->thread_id, file);
+        slowlog_begin(slow_log, &probe);
+        begin = stamp();
+        if (unlink(dst_path) != 0) {
+            fprintf(stderr, "Couldn't unlink() to %s: %s\n", dst_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        end = stamp();
+        slowlog_end(slow_log, &probe, load->thread_id, "unlink", dst_path, -1);
+        load->latencies[UNLINK][file] = end - begin;
+    }
+    load->unlink_pass_ns = stamp() - pass_begin;
+
+    return NULL;
+}
+
+/*
+ Prints the latencies collected in nanoseconds, followed by the throughput
+ of each pass in files/s.
+
+ The latency output depends on the latency flag being used:
+  - Full latency (FLAG=full-lat): one line per file (size, create, write, sync, close, read, unlink)
+  - Resumed latency (FLAG=res-lat): one-line with the average latencies of all threads
+    (create, write, sync, close, read, unlink)
+
+ The last line is always the throughput of each pass (create, read, unlink) in
+ files/s, taken over the slowest thread.
+
+ Params:
+  - load: thread loads
+  - num_threads: number of threads
+  - files_per_thread: number of files of each thread
+
+ Errors: none
+ Returns: none
+*/
+void print_results(thread_load *load, int num_threads, int files_per_thread) {
+    uint64_t create_pass = 0, read_pass = 0, unlink_pass = 0;
+    double total_files = (double) num_threads * files_per_thread;
+
+    if (detailed_latency) {
+        for (int thread = 0; thread < num_threads; ++thread) {
+            for (int file = 0; file < files_per_thread; ++file) {
+                printf("%zu", load[thread].sizes[file]);
+                for (int phase = 0; phase < NUM_PHASES; ++phase) {
+                    printf(",%" PRIu64, load[thread].latencies[phase][file]);
+                }
+                printf("\n");
+            }
+        }
+    } else {
+        for (int phase = 0; phase < NUM_PHASES; ++phase) {
+            // the per-phase arrays of all threads are contiguous
+            printf("%s%" PRIu64, phase ? "," : "",
+                    mean(load[0].latencies[phase], (size_t) num_threads * files_per_thread));
+        }
+        printf("\n");
+    }
+
+    for (int thread = 0; thread < num_threads; ++thread) {
+        if (load[thread].create_pass_ns > create_pass) create_pass = load[thread].create_pass_ns;
+        if (load[thread].read_pass_ns > read_pass) read_pass = load[thread].read_pass_ns;
+        if (load[thread].unlink_pass_ns > unlink_pass) unlink_pass = load[thread].unlink_pass_ns;
+    }
+    printf("%.1f,%.1f,%.1f\n",
+            total_files * NSEC / create_pass,
+            total_files * NSEC / read_pass,
+            total_files * NSEC / unlink_pass);
+}
+
+/*
+ Evaluates whether the input is one of the two options given in the params
+
+ Params:
+  - input: user inputed value
+  - first_op: First option to the value
+  - second_op: Second option to the value
+
+ Error: It fails and exits the program if the input doesn't corresponds to any option
+ Returns: 1 in case the input it is equal to the first option
+          0 otherwise
+*/
+int parse_bool_flag(char * input, char * first_op, char * second_op) {
+    if (strcmp(input, first_op) == 0) {
+        return 1;
+    } else if (strcmp(input, second_op) == 0) {
+        return 0;
+    } else {
+        fprintf(stderr, "Invalid parameter %s, must be one of: %s or %s.\n", input, first_op, second_op);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// To run, type: ./smallfile <path> <files_per_thread> <num_threads> <size_dist> fsync|fdatasync|nosync full-lat|res-lat [threads|procs]
+//                          [slow=<us>] [slowtop=<K>] [slowcap=<N>]
+int main(int argc, char* argv[]) {
+    if (argc < 7) {
+        fprintf(stderr, "Usage: ./smallfile <path> <files_per_thread> <num_threads> "
+                "fixed:S|uniform:MIN:MAX|exp:MEAN:MAX|mix:SxW,... fsync|fdatasync|nosync full-lat|res-lat [threads|procs] [slow=<us>] [slowtop=<K>] [slowcap=<N>]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Directory in which the files will be created
+    char* path = argv[1];
+    // Number of files each thread creates, reads back and deletes
+    int files_per_thread = atoi(argv[2]);
+    // Number of threads being used
+    int num_threads = atoi(argv[3]);
+    // Distribution of the file sizes
+    parse_size_dist(argv[4], &file_sizes);
+
+    if (strcmp(argv[5], "fsync") == 0) {
+        sync_mode = FSYNC;
+    } else if (strcmp(argv[5], "fdatasync") == 0) {
+        sync_mode = FDATASYNC;
+    } else if (strcmp(argv[5], "nosync") == 0) {
+        sync_mode = NO_SYNC;
+    } else {
+        fprintf(stderr, "Invalid parameter %s, must be one of: fsync, fdatasync or nosync.\n", argv[5]);
+        exit(EXIT_FAILURE);
+    }
+
+    // Whether the latency will be detailed or not
+    detailed_latency = parse_bool_flag(argv[6], "full-lat", "res-lat");
+    // Optional: threads|procs, slow=<us>, slowtop=<K>, slowcap=<N>
+    slowlog_spec_init(&slow_spec);
+    for (int i = 7; i < argc; ++i) {
+        if (!workers_parse_option(&pool, argv[i]) && !slowlog_parse_option(&slow_spec, argv[i])) {
+            fprintf(stderr, "Invalid option %s, must be one of: threads, procs, slow=<us>, slowtop=<K> or slowcap=<N>.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (files_per_thread <= 0 || num_threads <= 0) {
+        fprintf(stderr, "The number of files and threads must be positive.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    srand(time(NULL));
+
+    workers_init(&pool, num_threads);
+    thread_load* load = (thread_load*) workers_calloc(&pool, num_threads, sizeof(struct thread_load));
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) workers_calloc(&pool, 1, slowlog_size(&slow_spec, num_threads));
+        slowlog_init(slow_log, &slow_spec, num_threads);
+    }
+
+    // one array per phase, each thread writes its own slice
+    uint64_t* latencies[NUM_PHASES];
+    for (int phase = 0; phase < NUM_PHASES; ++phase) {
+        latencies[phase] = (uint64_t*) workers_calloc(&pool, (size_t) files_per_thread * num_threads, sizeof(uint64_t));
+    }
+
+    for (int thread = 0; thread < num_threads; ++thread) {
+        load[thread].thread_id = thread;
+        load[thread].root_path = path;
+        load[thread].num_files = files_per_thread;
+        load[thread].seed = rand();
+        load[thread].buf = (char*) malloc(file_sizes.max + 1);
+        for (size_t i = 0; i <= file_sizes.max; ++i) {
+            load[thread].buf[i] = (char) rand_r(&load[thread].seed);
+        }
+        load[thread].sizes = (size_t*) calloc(files_per_thread, sizeof(size_t));
+        for (int file = 0; file < files_per_thread; ++file) {
+            load[thread].sizes[file] = draw_size(&file_sizes, &load[thread].seed);
+        }
+        for (int phase = 0; phase < NUM_PHASES; ++phase) {
+            load[thread].latencies[phase] = &latencies[phase][(size_t) thread * files_per_thread];
+        }
+    }
+
+    workers_start(&pool, thread_init, load, sizeof(thread_load));
+    workers_join(&pool);
+
+    print_results(load, num_threads, files_per_thread);
+    slowlog_print(stdout, slow_log);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,437 @@
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE // fallocate
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h> //FS_IOC_FIEMAP
+#include <linux/fiemap.h>
+#include <linux/falloc.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <stdint.h> //uint64_t
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "hist.h"
+#include "workers.h"
+#include "slowlog.h"
+
+#define ACCESS_PERMISSION 0777
+#define NSEC 1000000000ULL
+#define BLOCK 4096
+#define SEQ_READ_SIZE (1024 * 1024)
+#define RANDOM_READS 1024
+
+/*
+ Times space-management calls on per-thread files (<path><thread>) and
+ measures how the layout they leave behind changes read throughput.
+
+ For every operation class the files are rebuilt (fully written, or sparse
+ for allocate), their extents are counted with FIEMAP and sequential (1 MiB)
+ and random (4 KiB) read throughput is measured with a cold page cache. Then
+ every thread issues <ops_per_thread> calls of <op_size> bytes at random
+ block-aligned offsets, and the extents and read throughput are measured
+ again.
+*/
+
+enum space_ops {
+    ALLOCATE,        // fallocate(0) in a sparse file
+    KEEP_SIZE,       // fallocate(FALLOC_FL_KEEP_SIZE) past EOF
+    PUNCH_HOLE,
+    ZERO_RANGE,
+    COLLAPSE_RANGE,
+    TRUNCATE_SHRINK, // ftruncate() op_size bytes off the end
+    TRUNCATE_GROW,   // ftruncate() op_size bytes past the end
+    NUM_SPACE_OPS
+};
+
+static const char *op_names[NUM_SPACE_OPS] = {
+    "allocate", "keep-size", "punch-hole", "zero-range", "collapse-range", "truncate-shrink", "truncate-grow"
+};
+
+typedef struct read_stats {
+    uint64_t seq_begin;
+    uint64_t seq_end;
+    uint64_t seq_bytes;
+    uint64_t rand_begin;
+    uint64_t rand_end;
+    uint64_t rand_ops;
+} read_stats;
+
+typedef struct thread_load {
+    int thread_id;
+    char path[256];
+    int op;
+    unsigned int seed;
+    char *buf;
+    hist latencies;
+    uint64_t extents_before;
+    uint64_t extents_after;
+    read_stats before;
+    read_stats after;
+    int error;
+} thread_load;
+
+long file_size;
+long op_size;
+int ops_per_thread;
+pthread_barrier_t *phase_barrier;
+// pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+// slow calls with the context switches and faults of their thread, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
+       perror("Error getting timestamp");
+       exit(EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+/*
+ Counts the extents of a file with FIEMAP
+
+ Params:
+  - fd: file descriptor
+
+ Returns: The number of extents, or 0 if FIEMAP is not supported
+*/
+uint64_t count_extents(int fd) {
+    struct fiemap map;
+
+    memset(&map, 0, sizeof(map));
+    map.fm_length = FIEMAP_MAX_OFFSET;
+    map.fm_flags = FIEMAP_FLAG_SYNC;
+    map.fm_extent_count = 0;
+    if (ioctl(fd, FS_IOC_FIEMAP, &map) < 0) {
+        return 0;
+    }
+    return map.fm_mapped_extents;
+}
+
+// drops the cached pages of the file so that reads go to the device
+static void drop_file_cache(int fd) {
+    fsync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+/*
+ Reads the whole file sequentially, then RANDOM_READS random blocks, each
+ pass from a cold cache and in step with the other threads
+
+ Params:
+  - load: thread load
+  - fd: file descriptor
+  - stats: filled with the timestamps and amounts of both passes
+
+ Errors: It fails and exits the program if a read fails
+ Returns: none
+*/
+void measure_reads(thread_load *load, int fd, read_stats *stats) {
+    struct stat st;
+    ssize_t ret;
+    long blocks;
+
+    fstat(fd, &st);
+    blocks = st.st_size / BLOCK;
+
+    drop_file_cache(fd);
+    pthread_barrier_wait(phase_barrier);
+    stats->seq_bytes = 0;
+    stats->seq_begin = stamp();
+    while ((ret = pread(fd, load->buf, SEQ_READ_SIZE, stats->seq_bytes)) > 0) {
+        stats->seq_bytes += ret;
+    }
+    stats->seq_end = stamp();
+    if (ret < 0) {
+        fprintf(stderr, "Couldn't read %s: %s\n", load->path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    drop_file_cache(fd);
+    pthread_barrier_wait(phase_barrier);
+    stats->rand_ops = 0;
+    stats->rand_begin = stamp();
+    for (int i = 0; i < RANDOM_READS && blocks > 0; i++) {
+        if (pread(fd, load->buf, BLOCK, (rand_r(&load->seed) % blocks) * (off_t) BLOCK) < 0) {
+            fprintf(stderr, "Couldn't read %s: %s\n", load->path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        stats->rand_ops++;
+    }
+    stats->rand_end = stamp();
+}
+
+/*
+ Rebuilds the file of the thread: fully written, or sparse for allocate
+
+ Params:
+  - load: thread load
+
+ Errors: It fails and exits the program if the file can't be written
+ Returns: The file descriptor
+*/
+int prepare_file(thread_load *load) {
+    int fd = open(load->path, O_RDWR | O_CREAT | O_TRUNC | O_LARGEFILE, ACCESS_PERMISSION);
+    if (fd < 0) {
+        fprintf(stderr, "Couldn't open %s: %s\n", load->path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (load->op == ALLOCATE) {
+        if (ftruncate(fd, file_size) != 0) {
+            fprintf(stderr, "Couldn't ftruncate() %s: %s\n", load->path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        return fd;
+    }
+    for (long offset = 0; offset < file_size; offset += SEQ_READ_SIZE) {
+        long len = file_size - offset < SEQ_READ_SIZE ? file_size - offset : SEQ_READ_SIZE;
+        if (pwrite(fd, load->buf, len, offset) != len) {
+            fprintf(stderr, "Couldn't write %s: %s\n", load->path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    fsync(fd);
+    return fd;
+}
+
+/*
+ Issues one space-management call
+
+ Params:
+  - load: thread load
+  - fd: file descriptor
+  - i: call index
+  - size: current file size (updated by the calls that change it)
+
+ Returns: 0 on success, the errno otherwise
+*/
+int issue_op(thread_load *load, int fd, int i, long *size) {
+    long blocks = (*size - op_size) / BLOCK;
+    off_t offset = blocks > 0 ? (rand_r(&load->seed) % blocks) * (off_t) BLOCK : 0;
+    int ret;
+
+    switch (load->op) {
+    case ALLOCATE:
+        ret = fallocate(fd, 0, offset, op_size);
+        break;
+    case KEEP_SIZE:
+        ret = fallocate(fd, FALLOC_FL_KEEP_SIZE, file_size + (off_t) i * op_size, op_size);
+        break;
+    case PUNCH_HOLE:
+        ret = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, op_size);
+        break;
+    case ZERO_RANGE:
+        ret = fallocate(fd, FALLOC_FL_ZERO_RANGE, offset, op_size);
+        break;
+    case COLLAPSE_RANGE:
+        ret = fallocate(fd, FALLOC_FL_COLLAPSE_RANGE, offset, op_size);
+        if (ret == 0) {
+            *size -= op_size;
+        }
+        break;
+    case TRUNCATE_SHRINK:
+        ret = ftruncate(fd, *size - op_size);
+        if (ret == 0) {
+            *size -= op_size;
+        }
+        break;
+    default:
+        ret = ftruncate(fd, *size + op_size);
+        if (ret == 0) {
+            *size += op_size;
+        }
+        break;
+    }
+    return ret == 0 ? 0 : errno;
+}
+
+/*
+ Rebuilds the file, measures it, runs the calls and measures it again
+
+ Params:
+  - args: struct of thread load
+
+ Errors: It fails and exits the program if the file can't be written or read
+ Returns: NULL
+*/
+static void* thread_init(void* args) {
+    thread_load* load = (thread_load*) args;
+    uint64_t begin, end;
+    long size = file_size;
+    slowlog_probe probe;
+
+    int fd = prepare_file(load);
+    load->extents_before = count_extents(fd);
+    measure_reads(load, fd, &load->before);
+
+    pthread_barrier_wait(phase_barrier);
+    hist_init(&load->latencies);
+    load->error = 0;
+    for (int i = 0; i < ops_per_thread && load->error == 0; i++) {
+        if (size < op_size && (load->op == COLLAPSE_RANGE || load->op == TRUNCATE_SHRINK)) {
+            break;
+        }
+        slowlog_begin(slow_log, &probe);
+        begin = stamp();
+        load->error = issue_op(load, fd, i, &size);
+        end = stamp();
+        slowlog_end(slow_log, &probe, load->thread_id, op_names[load->op], load->path, -1);
+        if (load->error == 0) {
+            hist_add(&load->latencies, end - begin);
+        }
+    }
+
+    load->extents_after = count_extents(fd);
+    measure_reads(load, fd, &load->after);
+    close(fd);
+
+    return NULL;
+}
+
+static double seq_mb_s(thread_load *load, int num_threads, int after) {
+    uint64_t bytes = 0, first = UINT64_MAX, last = 0;
+
+    for (int thread = 0; thread < num_threads; ++thread) {
+        read_stats *stats = after ? &load[thread].after : &load[thread].before;
+        bytes += stats->seq_bytes;
+        first = stats->seq_begin < first ? stats->seq_begin : first;
+        last = stats->seq_end > last ? stats->seq_end : last;
+    }
+    return last > first ? bytes / 1e6 / ((last - first) / (double) NSEC) : 0;
+}
+
+static double rand_iops(thread_load *load, int num_threads, int after) {
+    uint64_t ops = 0, first = UINT64_MAX, last = 0;
+
+    for (int thread = 0; thread < num_threads; ++thread) {
+        read_stats *stats = after ? &load[thread].after : &load[thread].before;
+        ops += stats->rand_ops;
+        first = stats->rand_begin < first ? stats->rand_begin : first;
+        last = stats->rand_end > last ? stats->rand_end : last;
+    }
+    return last > first ? ops * (double) NSEC / (last - first) : 0;
+}
+
+/*
+ Runs one operation class on every thread and prints
+   space,<op>,<extents_before>,<extents_after>,<seq_MB/s_before>,<seq_MB/s_after>,
+         <rand_IOPS_before>,<rand_IOPS_after>,<latency count,mean,p50,p90,p99,p99.9,max>
+ or space,<op>,unsupported,<error> when the filesystem refuses the call
+*/
+void run_op(thread_load *load, int num_threads, int op) {
+    hist total;
+    uint64_t extents_before = 0, extents_after = 0;
+    int error = 0;
+
+    for (int thread = 0; thread < num_threads; ++thread) {
+        load[thread].op = op;
+    }
+    workers_start(&pool, thread_init, load, sizeof(thread_load));
+    workers_join(&pool);
+
+    hist_init(&total);
+    for (int thread = 0; thread < num_threads; ++thread) {
+        if (load[thread].error != 0) {
+            error = load[thread].error;
+        }
+        hist_merge(&total, &load[thread].latencies);
+        extents_before += load[thread].extents_before;
+        extents_after += load[thread].extents_after;
+    }
+
+    if (error != 0 && total.count == 0) {
+        printf("space,%s,unsupported,%s\n", op_names[op], strerror(error));
+    } else {
+        printf("space,%s,%" PRIu64 ",%" PRIu64 ",%.1f,%.1f,%.0f,%.0f,", op_names[op], extents_before, extents_after,
+                seq_mb_s(load, num_threads, 0), seq_mb_s(load, num_threads, 1),
+                rand_iops(load, num_threads, 0), rand_iops(load, num_threads, 1));
+        hist_print_csv(stdout, &total);
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+// To run, type: ./space <path> <num_threads> <file_size> <op_size> <ops_per_thread> <op>|all [threads|procs]
+//                      [slow=<us>] [slowtop=<K>] [slowcap=<N>]
+int main(int argc, char* argv[]) {
+    int op;
+
+    if (argc < 7) {
+        fprintf(stderr, "Usage: ./space <path> <num_threads> <file_size> <op_size> <ops_per_thread> "
+                "allocate|keep-size|punch-hole|zero-range|collapse-range|truncate-shrink|truncate-grow|all [threads|procs] "
+                "[slow=<us>] [slowtop=<K>] [slowcap=<N>]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Prefix of the per-thread files, which are overwritten and removed at the end
+    char* path = argv[1];
+    int num_threads = atoi(argv[2]);
+    file_size = atol(argv[3]);
+    // Bytes of every call, rounded down to whole blocks
+    op_size = atol(argv[4]) / BLOCK * BLOCK;
+    ops_per_thread = atoi(argv[5]);
+
+    for (op = 0; op < NUM_SPACE_OPS && strcmp(argv[6], op_names[op]) != 0; op++);
+    if (op == NUM_SPACE_OPS && strcmp(argv[6], "all") != 0) {
+        fprintf(stderr, "Unknown operation %s\n", argv[6]);
+        exit(EXIT_FAILURE);
+    }
+
+    slowlog_spec_init(&slow_spec);
+    for (int i = 7; i < argc; ++i) {
+        if (slowlog_parse_option(&slow_spec, argv[i])) {
+            continue;
+        } else if (!workers_parse_option(&pool, argv[i])) {
+            fprintf(stderr, "Invalid option %s, must be one of: threads, procs, slow=<us>, slowtop=<K> or slowcap=<N>.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (num_threads <= 0 || op_size <= 0 || file_size < op_size) {
+        fprintf(stderr, "Need at least one thread and a file of at least one %d-byte block op.\n", BLOCK);
+        exit(EXIT_FAILURE);
+    }
+
+    srand(time(NULL));
+
+    workers_init(&pool, num_threads);
+    phase_barrier = (pthread_barrier_t*) workers_calloc(&pool, 1, sizeof(pthread_barrier_t));
+    workers_barrier_init(&pool, phase_barrier, num_threads);
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) workers_calloc(&pool, 1, slowlog_size(&slow_spec, num_threads));
+        slowlog_init(slow_log, &slow_spec, num_threads);
+    }
+
+    thread_load* load = (thread_load*) workers_calloc(&pool, num_threads, sizeof(struct thread_load));
+    for (int thread = 0; thread < num_threads; ++thread) {
+        load[thread].thread_id = thread;
+        snprintf(load[thread].path, sizeof load[thread].path, "%s%d", path, thread);
+        load[thread].seed = rand();
+        load[thread].buf = (char*) aligned_alloc(BLOCK, SEQ_READ_SIZE);
+        memset(load[thread].buf, 'a' + thread % 26, SEQ_READ_SIZE);
+    }
+
+    for (int i = 0; i < NUM_SPACE_OPS; ++i) {
+        if (op == NUM_SPACE_OPS || op == i) {
+            run_op(load, num_threads, i);
+        }
+    }
+    slowlog_print(stdout, slow_log);
+
+    for (int thread = 0; thread < num_threads; ++thread) {
+        unlink(load[thread].path);
+    }
+
+    return EXIT_SUCCESS;
+}
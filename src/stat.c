@@ -1,5 +1,5 @@
 #define _LARGEFILE64_SOURCE
-#define _XOPEN_SOURCE 500 // FTW_DEPTH | FTW_PHYS
+#define _XOPEN_SOURCE 600 // FTW_DEPTH | FTW_PHYS, pthread_barrier_t
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -16,11 +16,33 @@
 #define __STDC_FORMAT_MACRO
 #include <inttypes.h>
 
+#include "perfctr.h"
+#include "workers.h"
+#include "slowlog.h"
+#include "report.h"
+#include "livestats.h"
+
 #define ACCESS_PERMISSION 0777
 #define SECOND_NS 1000000000UL
 
 typedef int8_t error_t;
 
+// perf_event_open counters around every stat()
+int count_events;
+
+// pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+
+// slow stat() calls with the context switches and faults of their thread, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+
+// JSON report of the run, NULL when disabled
+const char *json_path;
+
+// stat() calls completed every live=<ms>, printed during the run for ./coord, NULL when disabled
+live_stats *live;
+
 typedef struct thread_stat_load {
     int thread_id;
     uint64_t* stat_latencies;
@@ -33,6 +55,8 @@ typedef struct thread_stat_load {
     uint64_t elapsed_time_ns;
     uint64_t maximum_time_ns;
     error_t error;
+    perf_counters counters;
+    report_thread results;
 } thread_stat_load;
 
 static uint64_t stamp (void) {
@@ -48,6 +72,7 @@ error_t issue_stat(struct thread_stat_load* load) {
     int dir_id, file_id;
     uint64_t begin, end;
     char pathbuf[256];
+    slowlog_probe probe;
 
     struct stat st;
 
@@ -56,15 +81,31 @@ error_t issue_stat(struct thread_stat_load* load) {
 
     snprintf(pathbuf, sizeof pathbuf, "%s/%d/%d", load->root_path, dir_id, file_id);
 
+    if (count_events) {
+        perf_counters_enable(&load->counters);
+    }
+
+    slowlog_begin(slow_log, &probe);
     begin = stamp();
 
-    if (stat(pathbuf, &st) != 0) {
+    int failed = stat(pathbuf, &st) != 0;
+
+    end = stamp();
+    slowlog_end(slow_log, &probe, load->thread_id, "stat", pathbuf, -1);
+    report_thread_add(&load->results, begin, end, failed ? -1 : 0);
+    if (!failed) {
+        live_stats_add(live, load->thread_id, begin, end);
+    }
+
+    if (count_events) {
+        perf_counters_disable(&load->counters);
+    }
+
+    if (failed) {
         fprintf(stderr, "Couldn't stat() to %s\n", pathbuf);
         return -1;
     }
 
-    end = stamp();
-
     load->elapsed_time_ns += end - begin;
     ++load->num_ops;
 
@@ -80,14 +121,24 @@ error_t issue_stat(struct thread_stat_load* load) {
 static void* thread_init(void* args) {
     thread_stat_load* load = (thread_stat_load*) args;
 
+    if (count_events && perf_counters_open(&load->counters) < 0) {
+        perror("No perf events available");
+        exit(EXIT_FAILURE);
+    }
+
     while ((load->elapsed_time_ns < load->maximum_time_ns) && (load->num_ops < load->max_ops)) {
         load->error = issue_stat(load);
         if (-1 == load->error) {
             fprintf(stderr, "Aborting on thread %d due stat() error.\n", load->thread_id);
-            return NULL;
+            break;
         }
     }
 
+    if (count_events) {
+        perf_counters_read(&load->counters);
+        perf_counters_close(&load->counters);
+    }
+
     return NULL;
 }
 
@@ -117,6 +168,21 @@ void print_latencies(thread_stat_load* load, int threads, int detailed_latency)
     }
 }
 
+// Print the perf counters per stat(): perf,stat,ops,cycles,instructions,llc-misses,cs,faults,migrations
+void print_counters(thread_stat_load* load, int threads) {
+    perf_counters total;
+    uint64_t total_ops = 0UL;
+
+    memset(&total, 0, sizeof(total));
+    for (int thread = 0; thread < threads; ++thread) {
+        perf_counters_merge(&total, &load[thread].counters);
+        total_ops += load[thread].num_ops;
+    }
+    printf("perf,stat,%" PRIu64 ",", total_ops);
+    perf_counters_print_csv(stdout, &total, total_ops);
+    printf("\n");
+}
+
 void create_file_tree(char* root_path, int num_dirs, int files_per_dir, int deep) {
     char* dst_path = (char*) calloc(256, sizeof(char));
     if (0 == deep) {
@@ -141,6 +207,54 @@ void create_file_tree(char* root_path, int num_dirs, int files_per_dir, int deep
     }
 }
 
+/*
+ Writes the JSON report of a bench run: the arguments, the environment and
+ the stat() results
+
+ Params:
+  - json: report file, - for stdout
+  - path: root of the file tree
+  - stat_load: seconds (time-based) or stat() calls per thread (no-time)
+  - num_dirs, files_per_dir: shape of the file tree
+  - num_threads: number of threads
+  - time_based: whether stat_load is in seconds
+  - load: thread loads
+  - argc, argv: command line
+
+ Errors: It fails and exits the program if the report can't be created
+ Returns: none
+*/
+void write_report(const char *json, const char *path, int stat_load, int num_dirs, int files_per_dir,
+        int num_threads, int time_based, thread_stat_load *load, int argc, char **argv) {
+    report_thread* threads = (report_thread*) calloc(num_threads, sizeof(report_thread));
+    report r;
+
+    for (int thread = 0; thread < num_threads; ++thread) {
+        threads[thread] = load[thread].results;
+    }
+
+    report_open(&r, json);
+    report_string(&r, "tool", "stat");
+    report_uint(&r, "format", 1);
+    report_begin_object(&r, "config");
+    report_args(&r, argc, argv);
+    report_string(&r, "path", path);
+    report_uint(&r, time_based ? "runtime_s" : "ops", stat_load);
+    report_uint(&r, "dirs", num_dirs);
+    report_uint(&r, "files", files_per_dir);
+    report_uint(&r, "threads", num_threads);
+    report_string(&r, "workers", pool.procs ? "procs" : "threads");
+    report_end_object(&r);
+    report_environment(&r, &path, 1);
+    report_begin_object(&r, "results");
+    report_begin_array(&r, "groups", 0);
+    report_op_group(&r, "stat", threads, num_threads, NULL);
+    report_end_array(&r);
+    report_end_object(&r);
+    report_close(&r);
+    free(threads);
+}
+
 int unlink_cb(const char *fpath, const struct stat *sb, int typeflag, struct FTW *ftwbuf) {
     int rv = remove(fpath);
     if (rv) {
@@ -192,10 +306,11 @@ int parse_bool_flag(char * input, char * first_op, char * second_op, int exit_on
     }
 }
 
-// To run, type: ./stat <path> <load> <num_dirs> <files_per_dir> full-lat|res-lat  time-based|no-time create|remove|bench
+// To run, type: ./stat <path> <load> <num_dirs> <files_per_dir> <num_threads> full-lat|res-lat  time-based|no-time create|remove|bench [perf] [threads|procs]
+//                      [slow=<us>] [slowtop=<K>] [slowcap=<N>] [json=<file>] [live=<ms>]
 int main(int argc, char* argv[]) {
     if (argc < 7) {
-        fprintf(stderr, "Usage: ./stat <path> <load> <num_dirs> <files_per_dir> <num_threads> full-lat|res-lat  time-based|no-time create|remove|bench.\n");
+        fprintf(stderr, "Usage: ./stat <path> <load> <num_dirs> <files_per_dir> <num_threads> full-lat|res-lat  time-based|no-time create|remove|bench [perf] [threads|procs] [slow=<us>] [slowtop=<K>] [slowcap=<N>] [json=<file>] [live=<ms>].\n");
         exit(EXIT_FAILURE);
     }
 
@@ -213,6 +328,26 @@ int main(int argc, char* argv[]) {
     int time_based = parse_bool_flag(argv[7], "time-based", "no-time", 1);
     int create_files = parse_bool_flag(argv[8], "create", "remove", 0);
 
+    // Optional: perf, threads|procs, slow=<us>, slowtop=<K>, slowcap=<N>, json=<file>, live=<ms>
+    int live_interval_ms = 0;
+    count_events = 0;
+    json_path = NULL;
+    slowlog_spec_init(&slow_spec);
+    for (int i = 9; i < argc; ++i) {
+        if (strcmp(argv[i], "perf") == 0) {
+            count_events = 1;
+        } else if (strncmp(argv[i], "json=", 5) == 0) {
+            json_path = argv[i] + 5;
+        } else if (slowlog_parse_option(&slow_spec, argv[i])) {
+            continue;
+        } else if (live_stats_parse_option(&live_interval_ms, argv[i])) {
+            continue;
+        } else if (!workers_parse_option(&pool, argv[i])) {
+            fprintf(stderr, "Invalid option %s, must be one of: perf, threads, procs, slow=<us>, slowtop=<K>, slowcap=<N>, json=<file> or live=<ms>.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     if (create_files == 1) {
         printf("Creating file tree...\n");
         create_file_tree(path, num_dirs, files_per_dir, 1);
@@ -225,10 +360,19 @@ int main(int argc, char* argv[]) {
         // Creating random seed
         srand(time(NULL));
 
-        thread_stat_load* load = (thread_stat_load*) calloc(num_threads, sizeof(struct thread_stat_load));
+        workers_init(&pool, num_threads);
+        thread_stat_load* load = (thread_stat_load*) workers_calloc(&pool, num_threads, sizeof(struct thread_stat_load));
+        if (slow_spec.enabled) {
+            slow_log = (slowlog*) workers_calloc(&pool, 1, slowlog_size(&slow_spec, num_threads));
+            slowlog_init(slow_log, &slow_spec, num_threads);
+        }
+        if (live_interval_ms > 0) {
+            live = (live_stats*) workers_calloc(&pool, 1, live_stats_size(num_threads));
+            live_stats_init(live, live_interval_ms, num_threads);
+        }
 
         if (time_based) {
-            uint64_t* stat_latencies = (uint64_t*) calloc(num_threads, sizeof(uint64_t));
+            uint64_t* stat_latencies = (uint64_t*) workers_calloc(&pool, num_threads, sizeof(uint64_t));
             for (int thread = 0; thread < num_threads; ++thread) {
                 load[thread].thread_id = thread;
                 load[thread].stat_latencies = &(stat_latencies[thread]);
@@ -243,7 +387,7 @@ int main(int argc, char* argv[]) {
                 load[thread].error = 0;
             }
         } else {
-            uint64_t * stat_latencies = (uint64_t*) calloc(num_threads * stat_load, sizeof(uint64_t));
+            uint64_t * stat_latencies = (uint64_t*) workers_calloc(&pool, num_threads * stat_load, sizeof(uint64_t));
             for (int thread = 0; thread < num_threads; ++thread) {
                 load[thread].thread_id = thread;
                 load[thread].stat_latencies = &(stat_latencies[thread * stat_load]);
@@ -259,17 +403,23 @@ int main(int argc, char* argv[]) {
             }
         }
 
-        pthread_t* requesters = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
         for (int thread = 0; thread < num_threads; ++thread) {
-            pthread_create(&requesters[thread], NULL, thread_init, (void*) &load[thread]);
+            report_thread_init(&load[thread].results);
         }
 
-        for (int thread = 0; thread < num_threads; ++thread) {
-            pthread_join(requesters[thread], NULL);
-        }
+        live_stats_start(live);
+        workers_start(&pool, thread_init, load, sizeof(thread_stat_load));
+        workers_join(&pool);
+        live_stats_stop(live);
 
         print_latencies(load, num_threads, detailed_latency);
-
+        if (count_events) {
+            print_counters(load, num_threads);
+        }
+        slowlog_print(stdout, slow_log);
+        if (json_path != NULL) {
+            write_report(json_path, path, stat_load, num_dirs, files_per_dir, num_threads, time_based, load, argc, argv);
+        }
     }
 
     return EXIT_SUCCESS;
@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h> //major, minor
+#include "streams.h"
+
+static const char *advice_names[] = { "none", "sequential", "random", "noreuse" };
+
+/*
+ Sets the default layout: one forward stream of contiguous requests from a
+ start offset shared by every thread, no advice and no readahead changes
+
+ Params:
+  - spec: stream specification
+
+ Returns: none
+*/
+void stream_spec_init(stream_spec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->streams = 1;
+    spec->advice = ADVICE_NONE;
+    spec->read_ahead_kb = -1;
+}
+
+/*
+ Parses one stream option of the command line
+
+ Accepted options:
+  - streams=<K> (interleaved streams per thread)
+  - stride=<bytes> (e.g. stride=65536 with 4K blocks reads 4K and skips 60K)
+  - reverse (backward scans)
+  - randstart (per-thread random start instead of one shared start)
+  - fadvise=sequential|random|noreuse
+  - readahead=<KB> (readahead() that far ahead of each stream)
+  - ra_kb=<KB> (read_ahead_kb of the backing device during the run, needs root)
+
+ Params:
+  - spec: stream specification being built
+  - option: command line option
+
+ Errors: It fails and exits the program if the option value is invalid
+ Returns: 1 if the option was a stream option, 0 otherwise
+*/
+int stream_parse_option(stream_spec *spec, const char *option) {
+    if (strncmp(option, "streams=", 8) == 0) {
+        spec->streams = atoi(option + 8);
+        if (spec->streams < 1) {
+            fprintf(stderr, "Invalid %s, need at least one stream\n", option);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strncmp(option, "stride=", 7) == 0) {
+        spec->stride = atol(option + 7);
+    } else if (strcmp(option, "reverse") == 0) {
+        spec->reverse = 1;
+    } else if (strcmp(option, "randstart") == 0) {
+        spec->randstart = 1;
+    } else if (strncmp(option, "fadvise=", 8) == 0) {
+        for (spec->advice = ADVICE_SEQUENTIAL; spec->advice <= ADVICE_NOREUSE; spec->advice++) {
+            if (strcmp(option + 8, advice_names[spec->advice]) == 0) {
+                break;
+            }
+        }
+        if (spec->advice > ADVICE_NOREUSE) {
+            fprintf(stderr, "Invalid %s, must be one of: sequential, random or noreuse\n", option);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strncmp(option, "readahead=", 10) == 0) {
+        spec->readahead_kb = atol(option + 10);
+    } else if (strncmp(option, "ra_kb=", 6) == 0) {
+        spec->read_ahead_kb = atol(option + 6);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static long stream_stride(const stream_spec *spec, int blksize) {
+    return spec->stride > blksize ? spec->stride : blksize;
+}
+
+// requests of the longest stream
+static long stream_requests(const stream_spec *spec, int nreq) {
+    return (nreq + spec->streams - 1) / spec->streams;
+}
+
+// whether the requests are the plain forward scan read()/write() can do on their own
+int stream_is_plain(const stream_spec *spec, int blksize) {
+    return spec->streams == 1 && stream_stride(spec, blksize) == blksize && !spec->reverse;
+}
+
+// bytes of the file one thread goes over
+long stream_extent(const stream_spec *spec, int nreq, int blksize) {
+    return spec->streams * stream_requests(spec, nreq) * stream_stride(spec, blksize);
+}
+
+/*
+ Gets the offset of one request of a thread
+
+ Params:
+  - spec: stream specification
+  - start: first byte of the thread's extent
+  - nreq: requests of the thread
+  - blksize: request size
+  - i: request index
+
+ Returns: The offset of the i-th request
+*/
+long stream_offset(const stream_spec *spec, long start, int nreq, int blksize, int i) {
+    long stride = stream_stride(spec, blksize);
+    long per_stream = stream_requests(spec, nreq);
+    long stream = i % spec->streams, index = i / spec->streams;
+
+    if (spec->reverse) {
+        index = per_stream - 1 - index;
+    }
+    return start + stream * per_stream * stride + index * stride;
+}
+
+/*
+ Tells whether the application readahead window of the stream of a request
+ starts at that request, and which bytes to read ahead then
+
+ Params:
+  - spec: stream specification
+  - blksize: request size
+  - i: request index
+  - offset, length: filled with the window, relative to the request offset
+
+ Returns: 1 if readahead() should be issued before the request, 0 otherwise
+*/
+int stream_readahead_due(const stream_spec *spec, int blksize, int i, long *offset, long *length) {
+    long stride = stream_stride(spec, blksize);
+    long window = spec->readahead_kb * 1024;
+    long per_window = window / stride > 0 ? window / stride : 1;
+
+    if (spec->readahead_kb <= 0 || (i / spec->streams) % per_window != 0) {
+        return 0;
+    }
+    *length = window;
+    *offset = spec->reverse ? blksize - window : 0;
+    return 1;
+}
+
+void stream_advise(const stream_spec *spec, int fd) {
+    static const int advices[] = { POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM, POSIX_FADV_NOREUSE };
+    int err;
+
+    if (spec->advice != ADVICE_NONE && (err = posix_fadvise(fd, 0, 0, advices[spec->advice])) != 0) {
+        fprintf(stderr, "posix_fadvise(%s) failed: %s\n", advice_names[spec->advice], strerror(err));
+    }
+}
+
+/*
+ Reads, and optionally sets, the read_ahead_kb of the device backing a file:
+ the queue of its block device (or of the disk of its partition), or its bdi
+
+ Params:
+  - path: file on the device
+  - kb: new read_ahead_kb, -1 to only read it
+
+ Errors: It warns if the setting can't be changed (it needs root)
+ Returns: The read_ahead_kb before the change, -1 if it can't be found
+*/
+long stream_set_read_ahead_kb(const char *path, long kb) {
+    const char *formats[] = {
+        "/sys/dev/block/%u:%u/queue/read_ahead_kb",
+        "/sys/dev/block/%u:%u/../queue/read_ahead_kb",
+        "/sys/class/bdi/%u:%u/read_ahead_kb"
+    };
+    char sysfs[256];
+    struct stat st;
+    long old_kb = -1;
+    FILE *f;
+
+    if (stat(path, &st) < 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        snprintf(sysfs, sizeof sysfs, formats[i], major(st.st_dev), minor(st.st_dev));
+        f = fopen(sysfs, "r");
+        if (f == NULL) {
+            continue;
+        }
+        if (fscanf(f, "%ld", &old_kb) != 1) {
+            old_kb = -1;
+        }
+        fclose(f);
+        if (old_kb < 0) {
+            continue;
+        }
+        if (kb >= 0) {
+            f = fopen(sysfs, "w");
+            if (f == NULL || fprintf(f, "%ld\n", kb) < 0 || fclose(f) != 0) {
+                fprintf(stderr, "Couldn't set %s to %ld: %s\n", sysfs, kb, strerror(errno));
+            }
+        }
+        return old_kb;
+    }
+    if (kb >= 0) {
+        fprintf(stderr, "No read_ahead_kb found for %s\n", path);
+    }
+    return -1;
+}
+
+/*
+ Prints the throughput of the run along with the layout that produced it:
+   seq,<op>,<bytes>,<span_ns>,<MB/s>,<streams>,<stride>,<reverse>,<randstart>,<fadvise>,<readahead_kb>,<read_ahead_kb>
+
+ Params:
+  - out: output stream
+  - op: read or write
+  - spec: stream specification
+  - bytes: bytes transferred by every thread
+  - span_ns: first request start to last request end
+  - read_ahead_kb: read_ahead_kb in effect, -1 if unknown
+
+ Returns: none
+*/
+void stream_print_summary(FILE *out, const char *op, const stream_spec *spec, uint64_t bytes, uint64_t span_ns, long read_ahead_kb) {
+    fprintf(out, "seq,%s,%lu,%lu,%.1f,%d,%ld,%d,%d,%s,%ld,%ld\n", op, (unsigned long) bytes, (unsigned long) span_ns,
+            span_ns ? bytes / 1e6 / (span_ns / 1e9) : 0, spec->streams, spec->stride, spec->reverse, spec->randstart,
+            advice_names[spec->advice], spec->readahead_kb, read_ahead_kb);
+}
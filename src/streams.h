@@ -0,0 +1,38 @@
+#ifndef STREAMS_H
+#define STREAMS_H
+
+#include <stdio.h>
+#include <stdint.h> //uint64_t
+
+enum stream_advice {
+    ADVICE_NONE,
+    ADVICE_SEQUENTIAL,
+    ADVICE_RANDOM,
+    ADVICE_NOREUSE
+};
+
+// Layout of the sequential requests of a thread: <streams> interleaved
+// streams over disjoint, consecutive regions of the file, each request
+// <stride> bytes after the previous one of its stream (backwards when
+// reverse). Request i goes to stream i % streams.
+typedef struct stream_spec {
+    int streams;
+    long stride;         // 0 for blksize, i.e. contiguous requests
+    int reverse;
+    int randstart;       // every thread starts at its own random offset
+    int advice;          // posix_fadvise() on the whole file before the run
+    long readahead_kb;   // readahead() this far ahead of every stream, 0 to disable
+    long read_ahead_kb;  // bdi read_ahead_kb during the run, -1 to leave it
+} stream_spec;
+
+void stream_spec_init(stream_spec *spec);
+int stream_parse_option(stream_spec *spec, const char *option);
+int stream_is_plain(const stream_spec *spec, int blksize);
+long stream_extent(const stream_spec *spec, int nreq, int blksize);
+long stream_offset(const stream_spec *spec, long start, int nreq, int blksize, int i);
+int stream_readahead_due(const stream_spec *spec, int blksize, int i, long *offset, long *length);
+void stream_advise(const stream_spec *spec, int fd);
+long stream_set_read_ahead_kb(const char *path, long kb);
+void stream_print_summary(FILE *out, const char *op, const stream_spec *spec, uint64_t bytes, uint64_t span_ns, long read_ahead_kb);
+
+#endif
@@ -0,0 +1,228 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h> //IOV_MAX
+#include <time.h>
+#include <sys/uio.h> //preadv2, pwritev2, RWF_*
+#include "vecio.h"
+
+static const struct {
+    const char *name;
+    int flag;
+} rwf_names[] = {
+    { "nowait", RWF_NOWAIT },
+    { "hipri", RWF_HIPRI },
+    { "dsync", RWF_DSYNC }
+};
+
+#define NUM_RWF (sizeof(rwf_names) / sizeof(rwf_names[0]))
+
+/*
+ Sets the default: plain pread/pwrite/read/write, no vectored calls
+
+ Params:
+  - spec: vectored I/O specification
+
+ Returns: none
+*/
+void vecio_spec_init(vecio_spec *spec) {
+    memset(spec, 0, sizeof(*spec));
+}
+
+/*
+ Parses one vectored I/O option of the command line. Any of them switches
+ the requests to preadv2()/pwritev2().
+
+ Accepted options:
+  - iov=<N> (segments per call, the request size split evenly)
+  - seg=<bytes> (bytes per segment, as many segments as the request needs)
+  - rwf=<flag>[,<flag>...] with flags nowait, hipri and dsync (rwf=none for none)
+
+ Params:
+  - spec: vectored I/O specification being built
+  - option: command line option
+
+ Errors: It fails and exits the program if the option value is invalid
+ Returns: 1 if the option was a vectored I/O option, 0 otherwise
+*/
+int vecio_parse_option(vecio_spec *spec, const char *option) {
+    if (strncmp(option, "iov=", 4) == 0) {
+        spec->iov = atoi(option + 4);
+        spec->seg = 0;
+        if (spec->iov < 1 || spec->iov > IOV_MAX) {
+            fprintf(stderr, "Invalid %s, must be 1 to %d segments\n", option, IOV_MAX);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strncmp(option, "seg=", 4) == 0) {
+        spec->seg = strtoul(option + 4, NULL, 10);
+        spec->iov = 0;
+        if (spec->seg == 0) {
+            fprintf(stderr, "Invalid %s, segments need at least one byte\n", option);
+            exit(EXIT_FAILURE);
+        }
+    } else if (strncmp(option, "rwf=", 4) == 0) {
+        char flags[64], *save = NULL;
+
+        snprintf(flags, sizeof flags, "%s", option + 4);
+        spec->flags = 0;
+        for (char *tok = strtok_r(flags, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+            size_t i;
+            for (i = 0; i < NUM_RWF && strcmp(tok, rwf_names[i].name) != 0; i++);
+            if (i < NUM_RWF) {
+                spec->flags |= rwf_names[i].flag;
+            } else if (strcmp(tok, "none") != 0) {
+                fprintf(stderr, "Invalid flag %s in %s, must be one of: nowait, hipri, dsync or none\n", tok, option);
+                exit(EXIT_FAILURE);
+            }
+        }
+    } else {
+        return 0;
+    }
+    spec->enabled = 1;
+    return 1;
+}
+
+void vecio_stats_init(vecio_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    hist_init(&stats->latencies);
+}
+
+static uint64_t vecio_stamp(void) {
+    struct timespec tspec;
+
+    clock_gettime(CLOCK_MONOTONIC, &tspec);
+    return (tspec.tv_sec * 1000000000ULL) + tspec.tv_nsec;
+}
+
+// splits the request buffer in the segments of the spec
+static int vecio_split(const vecio_spec *spec, char *buf, size_t len, struct iovec *iov) {
+    size_t seg = spec->seg ? spec->seg : (len + (spec->iov ? spec->iov : 1) - 1) / (spec->iov ? spec->iov : 1);
+    int n = 0;
+
+    for (size_t done = 0; done < len; done += seg) {
+        if (n == IOV_MAX) {
+            fprintf(stderr, "A request of %zu bytes needs more than %d segments of %zu bytes\n", len, IOV_MAX, seg);
+            exit(EXIT_FAILURE);
+        }
+        iov[n].iov_base = buf + done;
+        iov[n].iov_len = len - done < seg ? len - done : seg;
+        n++;
+    }
+    return n;
+}
+
+/*
+ Issues one vectored request. A RWF_NOWAIT call that would block (EAGAIN,
+ e.g. a page cache miss) is counted and reissued without RWF_NOWAIT, as an
+ engine would hand it to a blocking thread; its latency covers both calls.
+
+ Params:
+  - spec: vectored I/O specification
+  - fd: file descriptor
+  - buf, len: request buffer and size
+  - offset: file offset, -1 to use and advance the file position
+  - write: 1 for pwritev2(), 0 for preadv2()
+  - stats: statistics of the worker
+
+ Errors: none, the caller checks the result as it would for pread/pwrite
+ Returns: Bytes moved, -1 with errno set on failure
+*/
+static ssize_t vecio_call(const vecio_spec *spec, int fd, char *buf, size_t len, off_t offset, int write, vecio_stats *stats) {
+    struct iovec iov[IOV_MAX];
+    int n = vecio_split(spec, buf, len, iov);
+    uint64_t begin, end;
+    ssize_t ret;
+
+    begin = vecio_stamp();
+    ret = write ? pwritev2(fd, iov, n, offset, spec->flags) : preadv2(fd, iov, n, offset, spec->flags);
+    if (ret < 0 && errno == EAGAIN && (spec->flags & RWF_NOWAIT)) {
+        stats->eagain++;
+        ret = write ? pwritev2(fd, iov, n, offset, spec->flags & ~RWF_NOWAIT)
+                    : preadv2(fd, iov, n, offset, spec->flags & ~RWF_NOWAIT);
+    }
+    end = vecio_stamp();
+
+    if (stats->calls == 0) {
+        stats->first_begin = begin;
+    }
+    stats->last_end = end;
+    stats->calls++;
+    if (ret < 0) {
+        stats->errors++;
+        stats->last_errno = errno;
+        return ret;
+    }
+    stats->bytes += ret;
+    if ((size_t) ret < len) {
+        stats->short_calls++;
+    }
+    hist_add(&stats->latencies, end - begin);
+    return ret;
+}
+
+ssize_t vecio_read(const vecio_spec *spec, int fd, char *buf, size_t len, off_t offset, vecio_stats *stats) {
+    return vecio_call(spec, fd, buf, len, offset, 0, stats);
+}
+
+ssize_t vecio_write(const vecio_spec *spec, int fd, const char *buf, size_t len, off_t offset, vecio_stats *stats) {
+    return vecio_call(spec, fd, (char*) buf, len, offset, 1, stats);
+}
+
+// adds the calls of a worker to a zeroed total
+void vecio_merge(vecio_stats *total, const vecio_stats *stats) {
+    if (stats->calls == 0) {
+        return;
+    }
+    if (total->calls == 0 || stats->first_begin < total->first_begin) {
+        total->first_begin = stats->first_begin;
+    }
+    if (stats->last_end > total->last_end) {
+        total->last_end = stats->last_end;
+    }
+    total->calls += stats->calls;
+    total->eagain += stats->eagain;
+    total->short_calls += stats->short_calls;
+    total->bytes += stats->bytes;
+    total->errors += stats->errors;
+    if (stats->errors) {
+        total->last_errno = stats->last_errno;
+    }
+    hist_merge(&total->latencies, &stats->latencies);
+}
+
+/*
+ Prints the throughput and latency of the vectored calls with the flags that produced them:
+   vecio,<op>,<iov>,<seg>,<flags>,<calls>,<eagain>,<short>,<errors>,<last_error>,<bytes>,<span_ns>,<MB/s>,<latency count,mean,p50,p90,p99,p99.9,max>
+ iov and seg are those of a <len>-byte request, flags are joined by + (none without flags),
+ last_error is the strerror() of the last failed call (none if none failed).
+
+ Params:
+  - out: output stream
+  - op: read or write
+  - spec: vectored I/O specification
+  - len: request size
+  - total: merged statistics of the workers
+
+ Returns: none
+*/
+void vecio_print_summary(FILE *out, const char *op, const vecio_spec *spec, size_t len, const vecio_stats *total) {
+    size_t seg = spec->seg ? spec->seg : (len + (spec->iov ? spec->iov : 1) - 1) / (spec->iov ? spec->iov : 1);
+    uint64_t span_ns = total->last_end - total->first_begin;
+    char flags[64] = "";
+
+    for (size_t i = 0; i < NUM_RWF; i++) {
+        if (spec->flags & rwf_names[i].flag) {
+            strcat(flags, flags[0] ? "+" : "");
+            strcat(flags, rwf_names[i].name);
+        }
+    }
+    fprintf(out, "vecio,%s,%zu,%zu,%s,%lu,%lu,%lu,%lu,%s,%lu,%lu,%.1f,", op, (len + seg - 1) / seg, seg,
+            flags[0] ? flags : "none", (unsigned long) total->calls, (unsigned long) total->eagain,
+            (unsigned long) total->short_calls, (unsigned long) total->errors,
+            total->errors ? strerror(total->last_errno) : "none", (unsigned long) total->bytes, (unsigned long) span_ns,
+            span_ns ? total->bytes / 1e6 / (span_ns / 1e9) : 0);
+    hist_print_csv(out, &total->latencies);
+    fprintf(out, "\n");
+}
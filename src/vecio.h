@@ -0,0 +1,41 @@
+#ifndef VECIO_H
+#define VECIO_H
+
+#include <stdio.h>
+#include <stddef.h> //size_t
+#include <stdint.h> //uint64_t
+#include <sys/types.h> //off_t, ssize_t
+#include "hist.h"
+
+// Requests issued with preadv2()/pwritev2(): the request buffer split in
+// <iov> segments of <seg> bytes (one of them derived from the other and the
+// request size), and RWF_* flags on every call.
+typedef struct vecio_spec {
+    int enabled;
+    int iov;        // segments per call, 0 to derive from seg
+    size_t seg;     // bytes per segment, 0 to derive from iov
+    int flags;      // RWF_NOWAIT, RWF_HIPRI, RWF_DSYNC
+} vecio_spec;
+
+// What the calls of one worker did
+typedef struct vecio_stats {
+    uint64_t calls;
+    uint64_t eagain;        // RWF_NOWAIT calls that would have blocked, reissued without it
+    uint64_t short_calls;   // calls that moved fewer bytes than asked
+    uint64_t errors;
+    int last_errno;         // e.g. EOPNOTSUPP for RWF_NOWAIT on buffered writes of older kernels
+    uint64_t bytes;
+    uint64_t first_begin;
+    uint64_t last_end;
+    hist latencies;
+} vecio_stats;
+
+void vecio_spec_init(vecio_spec *spec);
+int vecio_parse_option(vecio_spec *spec, const char *option);
+void vecio_stats_init(vecio_stats *stats);
+ssize_t vecio_read(const vecio_spec *spec, int fd, char *buf, size_t len, off_t offset, vecio_stats *stats);
+ssize_t vecio_write(const vecio_spec *spec, int fd, const char *buf, size_t len, off_t offset, vecio_stats *stats);
+void vecio_merge(vecio_stats *total, const vecio_stats *stats);
+void vecio_print_summary(FILE *out, const char *op, const vecio_spec *spec, size_t len, const vecio_stats *total);
+
+#endif
@@ -0,0 +1,233 @@
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h> //_mm_crc32_u64
+#endif
+
+#include "verify.h"
+
+#define NSEC 1000000000ULL
+#define CRC32C_POLY 0x82F63B78U
+
+static const char *reason_names[] = { "no-stamp", "bad-offset", "bad-generation", "bad-crc" };
+
+static uint32_t crc_table[8][256];
+static int crc_hw = -1;
+
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   clock_gettime (CLOCK_MONOTONIC, &tspec);
+   return (tspec.tv_sec * NSEC) + tspec.tv_nsec;
+}
+
+/*
+ Builds the CRC32C tables and picks the implementation; call it before
+ starting the threads
+
+ Params: none
+
+ Returns: none
+*/
+void verify_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0U - (crc & 1)));
+        }
+        crc_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int slice = 1; slice < 8; slice++) {
+            crc_table[slice][i] = (crc_table[slice - 1][i] >> 8) ^ crc_table[0][crc_table[slice - 1][i] & 0xFF];
+        }
+    }
+#if defined(__x86_64__)
+    crc_hw = __builtin_cpu_supports("sse4.2");
+#else
+    crc_hw = 0;
+#endif
+}
+
+// slicing-by-8 table fallback
+static uint32_t crc32c_table(uint32_t crc, const unsigned char *data, size_t len) {
+    uint64_t word;
+
+    while (len >= 8) {
+        memcpy(&word, data, 8);
+        word ^= crc;
+        crc = crc_table[7][word & 0xFF] ^ crc_table[6][(word >> 8) & 0xFF] ^
+              crc_table[5][(word >> 16) & 0xFF] ^ crc_table[4][(word >> 24) & 0xFF] ^
+              crc_table[3][(word >> 32) & 0xFF] ^ crc_table[2][(word >> 40) & 0xFF] ^
+              crc_table[1][(word >> 48) & 0xFF] ^ crc_table[0][word >> 56];
+        data += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t len) {
+    uint64_t crc64 = crc, word;
+
+    while (len >= 8) {
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        len -= 8;
+    }
+    crc = (uint32_t) crc64;
+    while (len-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+/*
+ Computes the CRC32C (Castagnoli) of a buffer, with the SSE4.2 instruction
+ when the CPU has it and a table otherwise
+
+ Params:
+  - crc: CRC of the previous data, 0 to start
+  - data: buffer
+  - len: buffer length
+
+ Returns: The updated CRC
+*/
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    if (crc_hw < 0) {
+        verify_init();
+    }
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (crc_hw) {
+        return ~crc32c_sse42(crc, data, len);
+    }
+#endif
+    return ~crc32c_table(crc, data, len);
+}
+
+const char *crc32c_impl(void) {
+    if (crc_hw < 0) {
+        verify_init();
+    }
+    return crc_hw ? "sse4.2" : "table";
+}
+
+static uint32_t block_crc(const char *block) {
+    uint32_t crc = crc32c(0, block, offsetof(verify_header, crc));
+    return crc32c(crc, block + sizeof(verify_header), VERIFY_BLOCK - sizeof(verify_header));
+}
+
+/*
+ Stamps every VERIFY_BLOCK-aligned block fully covered by a write
+
+ Params:
+  - buf: buffer about to be written (modified)
+  - len: write length
+  - offset: file offset of the write
+  - generation: generation number of this pass
+  - stats: verification results of the calling thread
+
+ Returns: none
+*/
+void verify_stamp(char *buf, size_t len, uint64_t offset, uint64_t generation, verify_stats *stats) {
+    uint64_t begin = stamp();
+    uint64_t first = (offset + VERIFY_BLOCK - 1) / VERIFY_BLOCK * VERIFY_BLOCK;
+    verify_header header;
+
+    for (uint64_t block = first; block + VERIFY_BLOCK <= offset + len; block += VERIFY_BLOCK) {
+        char *data = buf + (block - offset);
+        header.magic = VERIFY_MAGIC;
+        header.offset = block;
+        header.generation = generation;
+        header.crc = 0;
+        header.reserved = 0;
+        memcpy(data, &header, sizeof(header));
+        header.crc = block_crc(data);
+        memcpy(data, &header, sizeof(header));
+        stats->blocks++;
+    }
+    stats->ns += stamp() - begin;
+}
+
+static void record_error(verify_stats *stats, uint64_t offset, int reason) {
+    stats->mismatches++;
+    if (stats->num_errors < VERIFY_MAX_ERRORS) {
+        stats->errors[stats->num_errors].offset = offset;
+        stats->errors[stats->num_errors].reason = reason;
+        stats->num_errors++;
+    }
+}
+
+/*
+ Checks every VERIFY_BLOCK-aligned block fully covered by a read
+
+ Params:
+  - buf: buffer read
+  - len: bytes read
+  - offset: file offset of the read
+  - generation: expected generation, 0 to accept any
+  - stats: verification results of the calling thread
+
+ Returns: none
+*/
+void verify_check(const char *buf, size_t len, uint64_t offset, uint64_t generation, verify_stats *stats) {
+    uint64_t begin = stamp();
+    uint64_t first = (offset + VERIFY_BLOCK - 1) / VERIFY_BLOCK * VERIFY_BLOCK;
+    verify_header header;
+
+    for (uint64_t block = first; block + VERIFY_BLOCK <= offset + len; block += VERIFY_BLOCK) {
+        const char *data = buf + (block - offset);
+        memcpy(&header, data, sizeof(header));
+        stats->blocks++;
+        if (header.magic != VERIFY_MAGIC) {
+            record_error(stats, block, VERIFY_NO_STAMP);
+        } else if (header.offset != block) {
+            record_error(stats, block, VERIFY_BAD_OFFSET);
+        } else if (generation != 0 && header.generation != generation) {
+            record_error(stats, block, VERIFY_BAD_GENERATION);
+        } else if (header.crc != block_crc(data)) {
+            record_error(stats, block, VERIFY_BAD_CRC);
+        }
+    }
+    stats->ns += stamp() - begin;
+}
+
+/*
+ Prints the verification results of every thread: one line per recorded
+ mismatch (verify-error,<thread>,<offset>,<reason>) followed by
+ verify,<blocks>,<mismatches>,<verify_ns>,<ns_per_block>,<MB/s>,<crc32c implementation>
+ where MB/s is how fast stamping/checking goes on a single core.
+
+ Params:
+  - out: output stream
+  - stats: per-thread results
+  - num_threads: number of threads
+
+ Returns: none
+*/
+void verify_print(FILE *out, const verify_stats *stats, int num_threads) {
+    uint64_t blocks = 0, mismatches = 0, ns = 0;
+
+    for (int thread = 0; thread < num_threads; thread++) {
+        for (int i = 0; i < stats[thread].num_errors; i++) {
+            fprintf(out, "verify-error,%d,%" PRIu64 ",%s\n", thread, stats[thread].errors[i].offset,
+                    reason_names[stats[thread].errors[i].reason]);
+        }
+        blocks += stats[thread].blocks;
+        mismatches += stats[thread].mismatches;
+        ns += stats[thread].ns;
+    }
+    fprintf(out, "verify,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.1f,%.1f,%s\n", blocks, mismatches, ns,
+            blocks ? (double) ns / blocks : 0, ns ? blocks * (double) VERIFY_BLOCK * 1000 / ns : 0, crc32c_impl());
+}
@@ -0,0 +1,50 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h> //uint64_t
+
+#define VERIFY_BLOCK 4096
+#define VERIFY_MAGIC 0x6673766572696679ULL
+#define VERIFY_MAX_ERRORS 64
+
+enum verify_reasons {
+    VERIFY_NO_STAMP,
+    VERIFY_BAD_OFFSET,
+    VERIFY_BAD_GENERATION,
+    VERIFY_BAD_CRC
+};
+
+// Header at the start of every VERIFY_BLOCK written in verify mode. The CRC32C
+// covers the whole block except the crc field itself.
+typedef struct verify_header {
+    uint64_t magic;
+    uint64_t offset;
+    uint64_t generation;
+    uint32_t crc;
+    uint32_t reserved;
+} verify_header;
+
+typedef struct verify_error {
+    uint64_t offset;
+    int reason;
+} verify_error;
+
+// Per-thread verification results; ns is the time spent stamping/checking.
+typedef struct verify_stats {
+    uint64_t blocks;
+    uint64_t mismatches;
+    uint64_t ns;
+    int num_errors;
+    verify_error errors[VERIFY_MAX_ERRORS];
+} verify_stats;
+
+void verify_init(void);
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+const char *crc32c_impl(void);
+void verify_stamp(char *buf, size_t len, uint64_t offset, uint64_t generation, verify_stats *stats);
+void verify_check(const char *buf, size_t len, uint64_t offset, uint64_t generation, verify_stats *stats);
+void verify_print(FILE *out, const verify_stats *stats, int num_threads);
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "workers.h"
+
+/*
+ Parses the worker mode option: threads (the default) or procs
+
+ Params:
+  - w: workers to set up, before workers_init()
+  - opt: command line token
+
+ Returns: 1 if the token was a worker mode option, 0 otherwise
+*/
+int workers_parse_option(workers *w, const char *opt) {
+    if (strcmp(opt, "procs") == 0) {
+        w->procs = 1;
+    } else if (strcmp(opt, "threads") == 0) {
+        w->procs = 0;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Sets up room for num_workers workers, after the mode was parsed
+void workers_init(workers *w, int num_workers) {
+    w->num_workers = num_workers;
+    w->threads = (pthread_t*) calloc(num_workers, sizeof(pthread_t));
+    w->pids = (pid_t*) calloc(num_workers, sizeof(pid_t));
+}
+
+/*
+ Allocates zeroed memory the workers can hand results back through: plain
+ calloc() for threads, a shared anonymous mapping for processes
+
+ Params:
+  - w: workers
+  - nmemb: number of elements
+  - size: size of each element
+
+ Errors: It fails and exits the program if the memory can't be allocated
+ Returns: The zeroed memory, never freed
+*/
+void *workers_calloc(workers *w, size_t nmemb, size_t size) {
+    void *mem;
+
+    if (!w->procs) {
+        mem = calloc(nmemb, size);
+        if (mem == NULL && nmemb * size > 0) {
+            perror("Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        return mem;
+    }
+    if (nmemb * size == 0) {
+        return NULL;
+    }
+    mem = mmap(NULL, nmemb * size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("Error mapping shared memory");
+        exit(EXIT_FAILURE);
+    }
+    return mem;
+}
+
+/*
+ Initializes a barrier the workers wait on, process-shared in process mode
+ (the barrier itself must then live in workers_calloc() memory)
+*/
+void workers_barrier_init(workers *w, pthread_barrier_t *barrier, unsigned count) {
+    pthread_barrierattr_t attr;
+
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, w->procs ? PTHREAD_PROCESS_SHARED : PTHREAD_PROCESS_PRIVATE);
+    pthread_barrier_init(barrier, &attr, count);
+    pthread_barrierattr_destroy(&attr);
+}
+
+/*
+ Starts one worker per element of args
+
+ Params:
+  - w: initialized workers
+  - routine: worker body, called with a pointer to its element of args
+  - args: array of num_workers elements
+  - arg_size: size of each element
+
+ Errors: It fails and exits the program if a worker can't be started
+ Returns: none
+*/
+void workers_start(workers *w, void *(*routine)(void *), void *args, size_t arg_size) {
+    int i, err;
+
+    // don't let every child flush a copy of what is still buffered
+    fflush(NULL);
+    for (i = 0; i < w->num_workers; i++) {
+        void *arg = (char*) args + i * arg_size;
+
+        if (!w->procs) {
+            err = pthread_create(&w->threads[i], NULL, routine, arg);
+            if (err != 0) {
+                fprintf(stderr, "Error creating thread: %s\n", strerror(err));
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+        w->pids[i] = fork();
+        if (w->pids[i] < 0) {
+            perror("Error forking worker");
+            exit(EXIT_FAILURE);
+        }
+        if (w->pids[i] == 0) {
+            // the children would otherwise all replay the parent's rand() sequence
+            srand(time(NULL) ^ ((unsigned) getpid() << 16));
+            routine(arg);
+            exit(EXIT_SUCCESS);
+        }
+    }
+}
+
+/*
+ Waits for every worker
+
+ Params:
+  - w: started workers
+
+ Errors: It exits the program if a worker process failed, as a failing thread
+         would have taken the whole program down
+ Returns: none
+*/
+void workers_join(workers *w) {
+    int i, status, failed = 0;
+
+    for (i = 0; i < w->num_workers; i++) {
+        if (!w->procs) {
+            pthread_join(w->threads[i], NULL);
+            continue;
+        }
+        while (waitpid(w->pids[i], &status, 0) < 0) {
+            if (errno != EINTR) {
+                perror("Error waiting for worker");
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            failed++;
+        }
+    }
+    if (failed) {
+        fprintf(stderr, "%d worker process(es) failed\n", failed);
+        exit(EXIT_FAILURE);
+    }
+}
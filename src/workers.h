@@ -0,0 +1,26 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stddef.h> //size_t
+#include <pthread.h>
+#include <sys/types.h> //pid_t
+
+// Runs the workers of a benchmark either as pthreads of this process or as
+// fork()ed processes, each with its own fd table, mm and rand() state. In
+// process mode everything a worker reports back (its load and the arrays it
+// fills) must come from workers_calloc(), which maps it shared.
+typedef struct workers {
+    int procs;
+    int num_workers;
+    pthread_t *threads;
+    pid_t *pids;
+} workers;
+
+int workers_parse_option(workers *w, const char *opt);
+void workers_init(workers *w, int num_workers);
+void *workers_calloc(workers *w, size_t nmemb, size_t size);
+void workers_barrier_init(workers *w, pthread_barrier_t *barrier, unsigned count);
+void workers_start(workers *w, void *(*routine)(void *), void *args, size_t arg_size);
+void workers_join(workers *w);
+
+#endif
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include "workload.h"
+
+/*
+ Parses a metrics spec
+
+ Accepted specs:
+  - last
+  - lat:<col>[,<col>...] (0-based columns, at most WORKLOAD_MAX_COLUMNS)
+  - span:<begin_col>:<end_col>
+
+ Params:
+  - spec: filled with the parsed spec
+  - text: metrics spec
+
+ Returns: 1 if the spec is valid, 0 otherwise
+*/
+int metric_spec_parse(metric_spec *spec, const char *text) {
+    char *copy, *saveptr, *end;
+
+    memset(spec, 0, sizeof(*spec));
+    if (strcmp(text, "last") == 0) {
+        spec->source = METRIC_LAST;
+        return 1;
+    }
+    if (strncmp(text, "lat:", 4) == 0) {
+        spec->source = METRIC_LATENCY;
+        copy = strdup(text + 4);
+        for (char *tok = strtok_r(copy, ",", &saveptr); tok != NULL; tok = strtok_r(NULL, ",", &saveptr)) {
+            long col = strtol(tok, &end, 10);
+            if (*end != '\0' || col < 0 || spec->num_columns == WORKLOAD_MAX_COLUMNS) {
+                spec->num_columns = 0;
+                break;
+            }
+            spec->columns[spec->num_columns++] = (int) col;
+        }
+        free(copy);
+        return spec->num_columns > 0;
+    }
+    if (sscanf(text, "span:%d:%d", &spec->columns[0], &spec->columns[1]) == 2
+            && spec->columns[0] >= 0 && spec->columns[1] >= 0) {
+        spec->source = METRIC_SPAN;
+        spec->num_columns = 1;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ Splits a line in numbers (separated by commas or whitespace)
+
+ Params:
+  - line: output line (modified)
+  - numbers: filled with the numbers found
+  - max: capacity of numbers
+
+ Returns: The number of fields, or 0 if any field is not a number
+*/
+int parse_numbers(char *line, double *numbers, int max) {
+    char *saveptr, *end;
+    int count = 0;
+
+    for (char *tok = strtok_r(line, ", \t\r\n", &saveptr); tok != NULL; tok = strtok_r(NULL, ", \t\r\n", &saveptr)) {
+        if (count == max) {
+            break;
+        }
+        numbers[count] = strtod(tok, &end);
+        if (*end != '\0') {
+            return 0;
+        }
+        count++;
+    }
+    return count;
+}
+
+/*
+ Starts a workload with its standard output on a pipe
+
+ Params:
+  - argv: argv of the workload, NULL terminated
+  - out_fd: set to the read end of the pipe
+
+ Errors: It fails and exits the program if the pipe or the process can't be created
+ Returns: The pid of the workload
+*/
+pid_t workload_spawn(char **argv, int *out_fd) {
+    int pipe_fds[2];
+    pid_t pid;
+
+    if (pipe(pipe_fds) < 0) {
+        perror("Couldn't create pipe");
+        exit(EXIT_FAILURE);
+    }
+    pid = fork();
+    if (pid < 0) {
+        perror("Couldn't fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        execvp(argv[0], argv);
+        fprintf(stderr, "Couldn't run %s: %s\n", argv[0], strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    close(pipe_fds[1]);
+    *out_fd = pipe_fds[0];
+    return pid;
+}
+
+// waits for a workload: its exit status, 128 + the signal that killed it, or -1
+int workload_wait(pid_t pid) {
+    int status;
+
+    if (waitpid(pid, &status, 0) < 0) {
+        return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
@@ -0,0 +1,28 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <sys/types.h> //pid_t
+
+#define WORKLOAD_MAX_COLUMNS 8
+
+enum metric_sources {
+    METRIC_LAST,        // every number of the last line with numbers
+    METRIC_LATENCY,     // latencies in nanoseconds at some columns of every line
+    METRIC_SPAN         // begin and end timestamps in nanoseconds at two columns of every line
+};
+
+// Where the metrics of a workload run by repeat or coord are in its standard
+// output. columns holds the latency columns (one histogram each), or the
+// begin and end columns of a span (one histogram).
+typedef struct metric_spec {
+    int source;
+    int columns[WORKLOAD_MAX_COLUMNS];
+    int num_columns;
+} metric_spec;
+
+int metric_spec_parse(metric_spec *spec, const char *text);
+int parse_numbers(char *line, double *numbers, int max);
+pid_t workload_spawn(char **argv, int *out_fd);
+int workload_wait(pid_t pid);
+
+#endif
@@ -0,0 +1,379 @@
+#define _LARGEFILE64_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <stdint.h> //uint64_t
+
+#define __STDC_FORMAT_MACRO
+#include <inttypes.h>
+
+#include "hist.h"
+#include "workers.h"
+#include "slowlog.h"
+
+#define SECOND_NS 1000000000UL
+#define MAX_THREAD_COUNTS 16
+#define LIST_BUFFER (64 * 1024)
+
+/*
+ Extended-attribute workload over the file tree of stat (<path>/<dir>/<file>,
+ created with ./stat <path> 0 <num_dirs> <files_per_dir> 1 res-lat no-time create).
+
+ Every file first gets <attrs_per_file> attributes user.b<k> of <value_size>
+ bytes (small values stay inline in the inode, large ones spill to external
+ blocks; the populate line shows the blocks per file). Then every thread
+ issues a weighted mix of setxattr/getxattr/listxattr/removexattr on random
+ files and attributes. A comma-separated list of thread counts runs the mix
+ once per count, each from a fully populated tree: the attributes removed by
+ the previous count are set again, untimed, before the next one starts.
+*/
+
+enum xattr_ops {
+    SET,
+    GET,
+    LIST,
+    REMOVE,
+    NUM_OPS
+};
+
+static const char *op_names[NUM_OPS] = { "set", "get", "list", "remove" };
+
+typedef struct thread_load {
+    int thread_id;
+    int num_threads;
+    unsigned int seed;
+    uint64_t max_ops;
+    uint64_t maximum_time_ns;
+    uint64_t elapsed_time_ns;
+    uint64_t misses[NUM_OPS];
+    hist latencies[NUM_OPS];
+} thread_load;
+
+char *root_path;
+int num_dirs;
+int files_per_dir;
+int attrs_per_file;
+size_t value_size;
+char *value;
+int weights[NUM_OPS];
+int total_weight;
+// pthreads, or fork()ed processes reporting through shared memory
+workers pool;
+// slow operations with the context switches and faults of their thread, NULL when disabled
+slowlog_spec slow_spec;
+slowlog *slow_log;
+
+static uint64_t stamp (void) {
+   struct timespec tspec;
+   if (clock_gettime (CLOCK_MONOTONIC, &tspec)) {
+       perror("Error getting timestamp");
+       exit(EXIT_FAILURE);
+   }
+   return (tspec.tv_sec * 1000000000ULL) + tspec.tv_nsec;
+}
+
+/*
+ Parses the operation mix: <op>:<weight>[,<op>:<weight>...] with op one of
+ set, get, list or remove
+
+ Params:
+  - spec: mix spec
+
+ Errors: It fails and exits the program if the mix is invalid
+ Returns: none
+*/
+void parse_mix(char *spec) {
+    char name[16];
+    int weight, op;
+
+    total_weight = 0;
+    for (char *tok = strtok(spec, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (sscanf(tok, "%15[^:]:%d", name, &weight) != 2 || weight < 0) {
+            fprintf(stderr, "Invalid mix entry %s, must be <op>:<weight>.\n", tok);
+            exit(EXIT_FAILURE);
+        }
+        for (op = 0; op < NUM_OPS && strcmp(name, op_names[op]) != 0; op++);
+        if (op == NUM_OPS) {
+            fprintf(stderr, "Invalid operation %s, must be one of: set, get, list or remove.\n", name);
+            exit(EXIT_FAILURE);
+        }
+        weights[op] = weight;
+        total_weight += weight;
+    }
+    if (total_weight == 0) {
+        fprintf(stderr, "The mix needs at least one operation with a positive weight.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void file_path(char *buf, size_t size, long file) {
+    snprintf(buf, size, "%s/%ld/%ld", root_path, file / files_per_dir, file % files_per_dir);
+}
+
+/*
+ Sets every attribute of the files of one thread
+
+ Params:
+  - args: struct of thread load
+
+ Errors: It fails and exits the program if an attribute can't be set
+ Returns: NULL
+*/
+static void* populate(void* args) {
+    thread_load* load = (thread_load*) args;
+    char pathbuf[256], name[32];
+    long files = (long) num_dirs * files_per_dir;
+
+    for (long file = load->thread_id; file < files; file += load->num_threads) {
+        file_path(pathbuf, sizeof pathbuf, file);
+        for (int attr = 0; attr < attrs_per_file; ++attr) {
+            snprintf(name, sizeof name, "user.b%d", attr);
+            if (setxattr(pathbuf, name, value, value_size, 0) != 0) {
+                fprintf(stderr, "Couldn't setxattr() %s on %s: %s\n", name, pathbuf, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ Issues one operation of the mix on a random file and attribute
+
+ Params:
+  - load: thread load
+
+ Errors: It fails and exits the program on errors other than a missing attribute
+ Returns: none
+*/
+void issue_op(thread_load *load) {
+    static __thread char list[LIST_BUFFER];
+    char pathbuf[256], name[32];
+    uint64_t begin, end;
+    int op, pick = rand_r(&load->seed) % total_weight;
+    ssize_t ret;
+    slowlog_probe probe;
+
+    for (op = 0; pick >= weights[op]; pick -= weights[op], op++);
+    file_path(pathbuf, sizeof pathbuf, rand_r(&load->seed) % ((long) num_dirs * files_per_dir));
+    snprintf(name, sizeof name, "user.b%d", rand_r(&load->seed) % attrs_per_file);
+
+    slowlog_begin(slow_log, &probe);
+    begin = stamp();
+    switch (op) {
+    case SET:
+        ret = setxattr(pathbuf, name, value, value_size, 0);
+        break;
+    case GET:
+        ret = getxattr(pathbuf, name, list, value_size);
+        break;
+    case LIST:
+        ret = listxattr(pathbuf, list, sizeof list);
+        break;
+    default:
+        ret = removexattr(pathbuf, name);
+        break;
+    }
+    end = stamp();
+    slowlog_end(slow_log, &probe, load->thread_id, op_names[op], pathbuf, -1);
+
+    if (ret < 0) {
+        if (errno != ENODATA) {
+            fprintf(stderr, "Couldn't %sxattr() %s on %s: %s\n", op_names[op], name, pathbuf, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        load->misses[op]++;
+    }
+    hist_add(&load->latencies[op], end - begin);
+    load->elapsed_time_ns += end - begin;
+}
+
+static void* thread_init(void* args) {
+    thread_load* load = (thread_load*) args;
+    uint64_t ops = 0;
+
+    while (load->elapsed_time_ns < load->maximum_time_ns && ops < load->max_ops) {
+        issue_op(load);
+        ops++;
+    }
+    return NULL;
+}
+
+/*
+ Sets every attribute of every file, with the largest thread count
+
+ Params:
+  - num_threads: number of threads
+
+ Errors: It fails and exits the program if an attribute can't be set
+ Returns: The wall time it took
+*/
+uint64_t populate_tree(int num_threads) {
+    uint64_t begin;
+
+    workers_init(&pool, num_threads);
+    thread_load* load = (thread_load*) workers_calloc(&pool, num_threads, sizeof(thread_load));
+    for (int thread = 0; thread < num_threads; ++thread) {
+        load[thread].thread_id = thread;
+        load[thread].num_threads = num_threads;
+    }
+    begin = stamp();
+    workers_start(&pool, populate, load, sizeof(thread_load));
+    workers_join(&pool);
+    return stamp() - begin;
+}
+
+/*
+ Prints the populate phase:
+   xattr-populate,<files>,<attrs_per_file>,<value_size>,<wall_ns>,<attrs/s>,<blocks_per_file>
+ where blocks_per_file is the mean st_blocks (512-byte units) of the files,
+ which grows when the attributes spill out of the inode
+*/
+void print_populate(uint64_t wall_ns) {
+    char pathbuf[256];
+    struct stat st;
+    long files = (long) num_dirs * files_per_dir;
+    uint64_t blocks = 0;
+
+    for (long file = 0; file < files; ++file) {
+        file_path(pathbuf, sizeof pathbuf, file);
+        if (stat(pathbuf, &st) == 0) {
+            blocks += st.st_blocks;
+        }
+    }
+    printf("xattr-populate,%ld,%d,%zu,%" PRIu64 ",%.1f,%.2f\n", files, attrs_per_file, value_size, wall_ns,
+            wall_ns ? files * attrs_per_file * (double) SECOND_NS / wall_ns : 0, files ? blocks / (double) files : 0);
+}
+
+/*
+ Runs the mix with one thread count and prints, for every operation of the mix:
+   xattr,<threads>,<op>,<misses>,<ops/s>,<latency count,mean,p50,p90,p99,p99.9,max>
+ then xattr-total,<threads>,<ops>,<wall_ns>,<ops/s>
+ Misses are get/remove calls on an attribute a remove already dropped.
+ With a slow log, its records of this thread count follow.
+*/
+void run_mix(int num_threads, int time_based, uint64_t mix_load) {
+    hist total[NUM_OPS];
+    uint64_t misses[NUM_OPS] = { 0 }, ops = 0, begin, wall;
+
+    workers_init(&pool, num_threads);
+    thread_load* load = (thread_load*) workers_calloc(&pool, num_threads, sizeof(thread_load));
+    if (slow_spec.enabled) {
+        slow_log = (slowlog*) workers_calloc(&pool, 1, slowlog_size(&slow_spec, num_threads));
+        slowlog_init(slow_log, &slow_spec, num_threads);
+    }
+    for (int thread = 0; thread < num_threads; ++thread) {
+        load[thread].thread_id = thread;
+        load[thread].num_threads = num_threads;
+        load[thread].seed = rand();
+        load[thread].max_ops = time_based ? UINT64_MAX : mix_load;
+        load[thread].maximum_time_ns = time_based ? mix_load * SECOND_NS : UINT64_MAX;
+        for (int op = 0; op < NUM_OPS; ++op) {
+            hist_init(&load[thread].latencies[op]);
+        }
+    }
+
+    begin = stamp();
+    workers_start(&pool, thread_init, load, sizeof(thread_load));
+    workers_join(&pool);
+    wall = stamp() - begin;
+
+    for (int op = 0; op < NUM_OPS; ++op) {
+        hist_init(&total[op]);
+        for (int thread = 0; thread < num_threads; ++thread) {
+            hist_merge(&total[op], &load[thread].latencies[op]);
+            misses[op] += load[thread].misses[op];
+        }
+        ops += total[op].count;
+        if (weights[op] == 0) {
+            continue;
+        }
+        printf("xattr,%d,%s,%" PRIu64 ",%.1f,", num_threads, op_names[op], misses[op],
+                total[op].count * (double) SECOND_NS / wall);
+        hist_print_csv(stdout, &total[op]);
+        printf("\n");
+    }
+    printf("xattr-total,%d,%" PRIu64 ",%" PRIu64 ",%.1f\n", num_threads, ops, wall, ops * (double) SECOND_NS / wall);
+    slowlog_print(stdout, slow_log);
+    fflush(stdout);
+}
+
+// To run, type: ./xattr <path> <load> <num_dirs> <files_per_dir> <num_threads>[,<num_threads>...] time-based|no-time
+//                       <attrs_per_file> <value_size> <op>:<weight>[,<op>:<weight>...] [threads|procs]
+//                       [slow=<us>] [slowtop=<K>] [slowcap=<N>]
+int main(int argc, char* argv[]) {
+    int thread_counts[MAX_THREAD_COUNTS], num_counts = 0, max_threads = 0, time_based;
+
+    if (argc < 10) {
+        fprintf(stderr, "Usage: ./xattr <path> <load> <num_dirs> <files_per_dir> <num_threads>[,<num_threads>...] "
+                "time-based|no-time <attrs_per_file> <value_size> set:W,get:W,list:W,remove:W [threads|procs] [slow=<us>] [slowtop=<K>] [slowcap=<N>]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Root of the stat file tree
+    root_path = argv[1];
+    // Seconds (time-based) or operations per thread (no-time)
+    uint64_t mix_load = strtoull(argv[2], NULL, 10);
+    num_dirs = atoi(argv[3]);
+    files_per_dir = atoi(argv[4]);
+    for (char *tok = strtok(argv[5], ","); tok != NULL && num_counts < MAX_THREAD_COUNTS; tok = strtok(NULL, ",")) {
+        thread_counts[num_counts] = atoi(tok);
+        if (thread_counts[num_counts] <= 0) {
+            fprintf(stderr, "Invalid thread count %s\n", tok);
+            exit(EXIT_FAILURE);
+        }
+        if (thread_counts[num_counts] > max_threads) {
+            max_threads = thread_counts[num_counts];
+        }
+        num_counts++;
+    }
+
+    if (strcmp(argv[6], "time-based") == 0) {
+        time_based = 1;
+    } else if (strcmp(argv[6], "no-time") == 0) {
+        time_based = 0;
+    } else {
+        fprintf(stderr, "Invalid parameter %s, must be one of: time-based or no-time.\n", argv[6]);
+        exit(EXIT_FAILURE);
+    }
+
+    attrs_per_file = atoi(argv[7]);
+    value_size = (size_t) atol(argv[8]);
+    parse_mix(argv[9]);
+
+    slowlog_spec_init(&slow_spec);
+    for (int i = 10; i < argc; ++i) {
+        if (!workers_parse_option(&pool, argv[i]) && !slowlog_parse_option(&slow_spec, argv[i])) {
+            fprintf(stderr, "Invalid option %s, must be one of: threads, procs, slow=<us>, slowtop=<K> or slowcap=<N>.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (num_dirs <= 0 || files_per_dir <= 0 || attrs_per_file <= 0 || num_counts == 0) {
+        fprintf(stderr, "Need at least one directory, file, attribute and thread.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    srand(time(NULL));
+    value = (char*) malloc(value_size + 1);
+    memset(value, 'x', value_size + 1);
+
+    print_populate(populate_tree(max_threads));
+    for (int i = 0; i < num_counts; ++i) {
+        // restore what the removes of the previous thread count dropped
+        if (i > 0) {
+            populate_tree(max_threads);
+        }
+        run_mix(thread_counts[i], time_based, mix_load);
+    }
+
+    return EXIT_SUCCESS;
+}